@@ -0,0 +1,177 @@
+#include "bvh.h"
+#include <algorithm>
+
+// 叶子中最多的物体数
+#define BVH_LEAF_SIZE 4
+
+AABB AABB::transformed(const glm::mat4& matrix) const {
+    AABB result;
+    result.min = result.max = glm::vec3(matrix[3]);
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            float a = matrix[column][row] * min[column];
+            float b = matrix[column][row] * max[column];
+            result.min[row] += std::min(a, b);
+            result.max[row] += std::max(a, b);
+        }
+    }
+    return result;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& m) {
+    // glm按列存储，m[c][r]；第r行为(m[0][r], m[1][r], m[2][r], m[3][r])
+    auto row = [&m](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+    glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+    Frustum frustum;
+    frustum.planes[0] = r3 + r0;    // 左
+    frustum.planes[1] = r3 - r0;    // 右
+    frustum.planes[2] = r3 + r1;    // 下
+    frustum.planes[3] = r3 - r1;    // 上
+    frustum.planes[4] = r3 + r2;    // 近
+    frustum.planes[5] = r3 - r2;    // 远
+    for (glm::vec4& plane : frustum.planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f) plane /= length;
+    }
+    return frustum;
+}
+
+Frustum::Result Frustum::test(const AABB& box) const {
+    Result result = Inside;
+    for (const glm::vec4& plane : planes) {
+        glm::vec3 normal(plane);
+        // 沿法线方向最远和最近的角点
+        glm::vec3 positive(normal.x >= 0.0f ? box.max.x : box.min.x,
+                           normal.y >= 0.0f ? box.max.y : box.min.y,
+                           normal.z >= 0.0f ? box.max.z : box.min.z);
+        glm::vec3 negative(normal.x >= 0.0f ? box.min.x : box.max.x,
+                           normal.y >= 0.0f ? box.min.y : box.max.y,
+                           normal.z >= 0.0f ? box.min.z : box.max.z);
+        if (glm::dot(normal, positive) + plane.w < 0.0f) {
+            return Outside;
+        }
+        if (glm::dot(normal, negative) + plane.w < 0.0f) {
+            result = Intersecting;
+        }
+    }
+    return result;
+}
+
+void BVH::clear() {
+    nodes.clear();
+    items.clear();
+    itemBounds.clear();
+}
+
+void BVH::build(const std::vector<AABB>& bounds) {
+    clear();
+    if (bounds.empty()) return;
+
+    itemBounds = bounds;
+    items.resize(bounds.size());
+    std::vector<glm::vec3> centers(bounds.size());
+    for (uint32_t i = 0; i < bounds.size(); i++) {
+        items[i] = i;
+        centers[i] = bounds[i].center();
+    }
+
+    nodes.reserve(bounds.size() * 2);
+    Node root;
+    root.bounds = bounds[0];
+    for (const AABB& box : bounds) root.bounds.expand(box);
+    root.first = 0;
+    root.count = static_cast<uint32_t>(bounds.size());
+    nodes.push_back(root);
+    subdivide(0, bounds, centers);
+}
+
+void BVH::subdivide(uint32_t nodeIndex, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers) {
+    // nodes会扩容，不能持有引用
+    uint32_t first = nodes[nodeIndex].first;
+    uint32_t count = nodes[nodeIndex].count;
+    if (count <= BVH_LEAF_SIZE) return;
+
+    // 按中心点包围盒最长的轴在中位数处划分
+    glm::vec3 centerMin = centers[items[first]], centerMax = centerMin;
+    for (uint32_t i = first; i < first + count; i++) {
+        centerMin = glm::min(centerMin, centers[items[i]]);
+        centerMax = glm::max(centerMax, centers[items[i]]);
+    }
+    glm::vec3 extent = centerMax - centerMin;
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+    if (extent[axis] <= 0.0f) return;   // 中心点全部重合，无法再分
+
+    uint32_t half = count / 2;
+    std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+                     [&](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+    uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+    for (int side = 0; side < 2; side++) {
+        Node child;
+        child.first = side == 0 ? first : first + half;
+        child.count = side == 0 ? half : count - half;
+        child.bounds = bounds[items[child.first]];
+        for (uint32_t i = child.first; i < child.first + child.count; i++) {
+            child.bounds.expand(bounds[items[i]]);
+        }
+        nodes.push_back(child);
+    }
+    nodes[nodeIndex].first = leftIndex;
+    nodes[nodeIndex].count = 0;
+
+    subdivide(leftIndex, bounds, centers);
+    subdivide(leftIndex + 1, bounds, centers);
+}
+
+void BVH::collect(uint32_t nodeIndex, std::vector<uint32_t>& visible) const {
+    const Node& node = nodes[nodeIndex];
+    if (node.count > 0) {
+        visible.insert(visible.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+    } else {
+        collect(node.first, visible);
+        collect(node.first + 1, visible);
+    }
+}
+
+void BVH::cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats& stats) const {
+    visible.clear();
+    stats = CullStats();
+    if (nodes.empty()) return;
+
+    // 显式栈，深度不超过树高的两倍
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        stats.nodesVisited++;
+
+        Frustum::Result result = frustum.test(node.bounds);
+        if (result == Frustum::Outside) continue;
+        if (result == Frustum::Inside) {
+            collect(static_cast<uint32_t>(&node - nodes.data()), visible);
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (frustum.test(itemBounds[items[i]]) != Frustum::Outside) {
+                    visible.push_back(items[i]);
+                }
+            }
+        } else if (top + 2 <= 64) {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+        } else {
+            // 树过深（退化输入），剩余部分不再剔除
+            collect(node.first, visible);
+            collect(node.first + 1, visible);
+        }
+    }
+
+    stats.drawn = static_cast<uint32_t>(visible.size());
+    stats.culled = static_cast<uint32_t>(items.size()) - stats.drawn;
+}
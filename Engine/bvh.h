@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm.hpp>
+
+// 轴对齐包围盒
+struct AABB {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return max - min; }
+    void expand(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+    // 变换后重新求轴对齐包围盒（Arvo方法，不需要变换8个角点）
+    AABB transformed(const glm::mat4& matrix) const;
+};
+
+// 视锥体，六个平面法线朝内
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // 从view-projection矩阵提取平面（OpenGL裁剪空间，z在[-w, w]）
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    enum Result { Outside, Intersecting, Inside };
+    Result test(const AABB& box) const;
+};
+
+// 剔除统计
+struct CullStats {
+    uint32_t drawn = 0;          // 通过剔除的物体数
+    uint32_t culled = 0;         // 被剔除的物体数
+    uint32_t nodesVisited = 0;   // 遍历的BVH节点数
+};
+
+// 静态物体的包围体层次结构，叶子存物体下标
+class BVH {
+public:
+    // 按包围盒构建，物体下标即bounds中的位置
+    void build(const std::vector<AABB>& bounds);
+    void clear();
+    // 收集与视锥相交的物体下标，完全在视锥内的子树不再逐个测试
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible, CullStats& stats) const;
+
+    size_t itemCount() const { return items.size(); }
+
+private:
+    struct Node {
+        AABB bounds;
+        uint32_t first;     // 叶子：items中的起始位置；内部节点：左孩子下标（右孩子紧随其后）
+        uint32_t count;     // 叶子中的物体数，0表示内部节点
+    };
+
+    void subdivide(uint32_t nodeIndex, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers);
+    void collect(uint32_t nodeIndex, std::vector<uint32_t>& visible) const;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> items;
+    std::vector<AABB> itemBounds;   // 叶子中的物体逐个测试时使用
+};
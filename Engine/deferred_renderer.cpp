@@ -0,0 +1,310 @@
+#include "deferred_renderer.h"
+#include "scene.h"
+#include "gl_state.h"
+#include "uniform_buffer.h"
+#include "engine_paths.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <cmath>
+#include <cstddef>
+#include <initializer_list>
+
+// 实例缓冲按这个数量起步，不够时翻倍
+#define LIGHT_INSTANCE_INITIAL_CAPACITY 256
+
+bool DeferredRenderer::init(const std::string& vertexPath, const std::string& fragmentPath) {
+    release();
+    gbufferShaders.init(vertexPath, fragmentPath, ShaderPass::GBuffer);
+
+    const std::string lightVertex = GL_RENDER_SHADER_DIR "deferred_light.vert";
+    const std::string lightFragment = GL_RENDER_SHADER_DIR "deferred_light.frag";
+    ResourceManager& resources = ResourceManager::get();
+    directionalShader = resources.acquireShader(lightVertex, lightFragment);
+    pointShader = resources.acquireShader(lightVertex, lightFragment, "#define POINT_LIGHTS\n");
+    compositeShader = resources.acquireShader(lightVertex, GL_RENDER_SHADER_DIR "deferred_composite.frag");
+    if (!gbufferShaders.active(nullptr) || !directionalShader->ID || !pointShader->ID || !compositeShader->ID) {
+        LOG_ERROR("DeferredRenderer: 着色器编译失败，只能使用前向渲染");
+        release();
+        return false;
+    }
+
+    glGenVertexArrays(1, &emptyVertexArray);
+    GLStateTracker::get().bindVertexArray(emptyVertexArray);
+    GLDebug::get().label(GL_VERTEX_ARRAY, emptyVertexArray, "Deferred fullscreen VAO");
+    createLightVolume();
+    initialized = true;
+    LOG_INFO("DeferredRenderer: 初始化完成");
+    return true;
+}
+
+void DeferredRenderer::createLightVolume() {
+    // 二十面体，面为逆时针朝外
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    glm::vec3 vertices[12] = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1},
+    };
+    static const GLushort indices[60] = {
+        0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+        1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+        3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+        4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1,
+    };
+    // 顶点在单位球上时面到中心的距离小于1，放大到内切球为单位球，光源体完整覆盖影响范围
+    for (glm::vec3& vertex : vertices) {
+        vertex = glm::normalize(vertex);
+    }
+    float inradius = glm::length((vertices[0] + vertices[11] + vertices[5]) / 3.0f);
+    for (glm::vec3& vertex : vertices) {
+        vertex /= inradius;
+    }
+    volumeIndexCount = 60;
+
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    glGenVertexArrays(1, &volumeVertexArray);
+    glGenBuffers(1, &volumeVertexBuffer);
+    glGenBuffers(1, &volumeIndexBuffer);
+    glGenBuffers(1, &instanceBuffer);
+    state.bindVertexArray(volumeVertexArray);
+
+    glBindBuffer(GL_ARRAY_BUFFER, volumeVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    renderStats.trackMemory(RenderMemory::Buffers, volumeVertexBuffer, sizeof(vertices));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    renderStats.trackMemory(RenderMemory::Buffers, volumeIndexBuffer, sizeof(indices));
+
+    // 每个实例一个光源：位置和半径、颜色
+    instanceCapacity = LIGHT_INSTANCE_INITIAL_CAPACITY;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(LightVolumeInstance), nullptr, GL_STREAM_DRAW);
+    renderStats.trackMemory(RenderMemory::Buffers, instanceBuffer, instanceCapacity * sizeof(LightVolumeInstance));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(LightVolumeInstance),
+                          (void*)offsetof(LightVolumeInstance, positionRadius));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(LightVolumeInstance),
+                          (void*)offsetof(LightVolumeInstance, color));
+    glVertexAttribDivisor(2, 1);
+    state.bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    GLDebug& debug = GLDebug::get();
+    debug.label(GL_VERTEX_ARRAY, volumeVertexArray, "Light volume VAO");
+    debug.label(GL_BUFFER, volumeVertexBuffer, "Light volume vertices");
+    debug.label(GL_BUFFER, volumeIndexBuffer, "Light volume indices");
+    debug.label(GL_BUFFER, instanceBuffer, "Light volume instances");
+}
+
+// 创建一个最近点采样的G-buffer纹理并记录显存
+static GLuint createTarget(GLuint unit, GLint internalFormat, GLenum format, GLenum type,
+                           int width, int height, int bytesPerPixel, const char* name) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    GLStateTracker::get().bindTexture(unit, GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    RenderStats::get().trackMemory(RenderMemory::Textures, texture,
+                                   RenderStats::textureBytes(width, height, bytesPerPixel, false));
+    GLDebug::get().label(GL_TEXTURE, texture, name);
+    return texture;
+}
+
+void DeferredRenderer::resize(int newWidth, int newHeight) {
+    releaseTargets();
+    width = newWidth;
+    height = newHeight;
+
+    albedoTexture = createTarget(GBUFFER_ALBEDO_TEXTURE_UNIT, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE,
+                                 width, height, 4, "GBuffer albedo/AO");
+    normalTexture = createTarget(GBUFFER_NORMAL_TEXTURE_UNIT, GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV,
+                                 width, height, 4, "GBuffer normal/roughness/metallic");
+    lightTexture = createTarget(LIGHT_ACCUM_TEXTURE_UNIT, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT,
+                                width, height, 4, "GBuffer light accumulation");
+    // 格式与默认帧缓冲一致，深度金字塔可以直接从G-buffer复制深度
+    depthTexture = createTarget(GBUFFER_DEPTH_TEXTURE_UNIT, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8,
+                                width, height, 4, "GBuffer depth");
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, lightTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    static const GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+    glDrawBuffers(3, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_ERROR("DeferredRenderer: G-buffer不完整");
+    }
+    GLDebug::get().label(GL_FRAMEBUFFER, framebuffer, "GBuffer");
+
+    glGenFramebuffers(1, &lightFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, lightFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_ERROR("DeferredRenderer: 光照累加帧缓冲不完整");
+    }
+    GLDebug::get().label(GL_FRAMEBUFFER, lightFramebuffer, "Light accumulation");
+    LOG_INFO("DeferredRenderer: G-buffer {}x{}", width, height);
+}
+
+GLsizei DeferredRenderer::uploadLights(const Scene& scene, const glm::mat4& viewProjection) {
+    // 光源体与视锥不相交时整个都会被裁掉，在CPU上先剔除
+    Frustum frustum = Frustum::fromMatrix(viewProjection);
+    instances.clear();
+    for (const PointLight& light : scene.pointLights) {
+        AABB bounds;
+        bounds.min = light.position - glm::vec3(light.radius);
+        bounds.max = light.position + glm::vec3(light.radius);
+        if (light.radius <= 0.0f || frustum.test(bounds) == Frustum::Outside) continue;
+        instances.push_back({glm::vec4(light.position, light.radius), glm::vec4(light.color, 1.0f)});
+    }
+    if (instances.empty()) return 0;
+
+    // 容量不够时翻倍；每帧重新指定存储，驱动不用等上一帧的绘制读完
+    while (instanceCapacity < static_cast<GLsizeiptr>(instances.size())) {
+        instanceCapacity *= 2;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(LightVolumeInstance), nullptr, GL_STREAM_DRAW);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, instanceBuffer, instanceCapacity * sizeof(LightVolumeInstance));
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(LightVolumeInstance), instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return static_cast<GLsizei>(instances.size());
+}
+
+void DeferredRenderer::render(Scene& scene, const glm::mat4& view, const glm::mat4& projection) {
+    PROFILE_SCOPE("DeferredRenderer::render");
+    if (!initialized) return;
+
+    // 合成的目标：调用时的帧缓冲和视口
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint targetFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFramebuffer);
+    if (viewport[2] <= 0 || viewport[3] <= 0) return;
+    if (viewport[2] != width || viewport[3] != height) {
+        resize(viewport[2], viewport[3]);
+    }
+
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    {
+        PROFILE_SCOPE("DeferredRenderer::geometry");
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+        static const GLfloat zero[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferfv(GL_COLOR, 2, zero);
+        glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+        // 剔除、排序和合批与前向渲染相同，只是网格使用G-buffer变体
+        scene.render(gbufferShaders, view, projection);
+    }
+
+    {
+        PROFILE_SCOPE("DeferredRenderer::lighting");
+        glBindFramebuffer(GL_FRAMEBUFFER, lightFramebuffer);
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        state.bindTexture(GBUFFER_ALBEDO_TEXTURE_UNIT, GL_TEXTURE_2D, albedoTexture);
+        state.bindTexture(GBUFFER_NORMAL_TEXTURE_UNIT, GL_TEXTURE_2D, normalTexture);
+        state.bindTexture(GBUFFER_DEPTH_TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+        glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+
+        // 主光源覆盖整个屏幕
+        directionalShader->use();
+        directionalShader->setMat4("inverseViewProjection", inverseViewProjection);
+        state.bindVertexArray(emptyVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        renderStats.addDraw(3);
+
+        // 点光源只画背面：相机在光源体内时正面被近平面裁掉，背面仍然覆盖受影响的像素
+        GLsizei lightCount = uploadLights(scene, projection * view);
+        if (lightCount > 0) {
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            pointShader->use();
+            pointShader->setMat4("inverseViewProjection", inverseViewProjection);
+            state.bindVertexArray(volumeVertexArray);
+            glDrawElementsInstanced(GL_TRIANGLES, volumeIndexCount, GL_UNSIGNED_SHORT, nullptr, lightCount);
+            renderStats.addDraw(volumeIndexCount, lightCount);
+            glCullFace(GL_BACK);
+            glDisable(GL_CULL_FACE);
+        }
+        renderStats.add(RenderCounter::PointLights, lightCount);
+
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    {
+        // 写回颜色和深度，背景像素不写，之前画的网格和坐标轴保留
+        PROFILE_SCOPE("DeferredRenderer::composite");
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        state.bindTexture(LIGHT_ACCUM_TEXTURE_UNIT, GL_TEXTURE_2D, lightTexture);
+        compositeShader->use();
+        compositeShader->setIVec2("viewportOrigin", glm::ivec2(viewport[0], viewport[1]));
+        state.bindVertexArray(emptyVertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        renderStats.addDraw(3);
+    }
+}
+
+void DeferredRenderer::releaseTargets() {
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    for (GLuint* texture : {&albedoTexture, &normalTexture, &lightTexture, &depthTexture}) {
+        if (*texture == 0) continue;
+        state.forgetTexture(*texture);
+        renderStats.releaseMemory(RenderMemory::Textures, *texture);
+        glDeleteTextures(1, texture);
+        *texture = 0;
+    }
+    if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+    if (lightFramebuffer) glDeleteFramebuffers(1, &lightFramebuffer);
+    framebuffer = 0;
+    lightFramebuffer = 0;
+    width = 0;
+    height = 0;
+}
+
+void DeferredRenderer::release() {
+    releaseTargets();
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    for (GLuint* vertexArray : {&emptyVertexArray, &volumeVertexArray}) {
+        if (*vertexArray == 0) continue;
+        state.forgetVertexArray(*vertexArray);
+        glDeleteVertexArrays(1, vertexArray);
+        *vertexArray = 0;
+    }
+    for (GLuint* buffer : {&volumeVertexBuffer, &volumeIndexBuffer, &instanceBuffer}) {
+        if (*buffer == 0) continue;
+        renderStats.releaseMemory(RenderMemory::Buffers, *buffer);
+        glDeleteBuffers(1, buffer);
+        *buffer = 0;
+    }
+    instanceCapacity = 0;
+    volumeIndexCount = 0;
+    gbufferShaders.release();
+    directionalShader.reset();
+    pointShader.reset();
+    compositeShader.reset();
+    initialized = false;
+}
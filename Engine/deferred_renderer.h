@@ -0,0 +1,74 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm.hpp>
+#include <vector>
+#include "shader.h"
+#include "resource_manager.h"
+
+class Scene;
+
+// 点光源体的实例数据，与deferred_light.vert的实例属性一致
+struct LightVolumeInstance {
+    glm::vec4 positionRadius;   // xyz: 位置，w: 半径
+    glm::vec4 color;            // rgb: 颜色（已乘强度）
+};
+static_assert(sizeof(LightVolumeInstance) == 32, "LightVolumeInstance必须紧密排列");
+
+// 延迟渲染
+// 几何通道把材质写入G-buffer，每像素16字节：
+//   0: RGBA8       反照率rgb + AO
+//   1: RGB10_A2    八面体法线(10+10位)，粗糙度和金属度各6位拼在b(10位)和a(2位)里
+//   2: R11G11B10F  光照累加，几何通道写入自发光，光照通道叠加
+//   深度: DEPTH24_STENCIL8，光照通道由它和逆view-projection重建世界位置
+// 光照通道只绑定累加目标，先用全屏三角形画主光源，再把视锥内的点光源作为实例化的二十面体画出（只画背面，
+// 相机在光源体内也能覆盖），加法混合到累加目标。最后合成到当前帧缓冲并写回深度，
+// 之后的绘制和深度金字塔与前向渲染相同。G-buffer不做多重采样。
+class DeferredRenderer {
+public:
+    // 编译G-buffer变体和光照着色器，失败时返回false
+    bool init(const std::string& vertexPath, const std::string& fragmentPath);
+    bool isInitialized() const { return initialized; }
+
+    // 渲染场景并合成到调用时绑定的帧缓冲和视口，相机uniform缓冲需要已经更新
+    void render(Scene& scene, const glm::mat4& view, const glm::mat4& projection);
+
+    // 重新编译G-buffer变体
+    void reload() { gbufferShaders.reload(); }
+    size_t variantCount() const { return gbufferShaders.size(); }
+
+    void release();
+
+private:
+    // 视口大小变化时重建G-buffer
+    void resize(int width, int height);
+    void releaseTargets();
+    void createLightVolume();
+    // 上传视锥内的点光源，返回数量
+    GLsizei uploadLights(const Scene& scene, const glm::mat4& viewProjection);
+
+    bool initialized = false;
+    ShaderVariants gbufferShaders;
+    ShaderHandle directionalShader;     // 全屏，主光源
+    ShaderHandle pointShader;           // 光源体，点光源
+    ShaderHandle compositeShader;       // 全屏，累加结果和深度写回目标帧缓冲
+
+    GLuint framebuffer = 0;             // 几何通道，三个颜色附件和深度
+    GLuint lightFramebuffer = 0;        // 光照通道，只有累加目标，采样G-buffer时不形成反馈环
+    GLuint albedoTexture = 0;
+    GLuint normalTexture = 0;
+    GLuint lightTexture = 0;
+    GLuint depthTexture = 0;
+    int width = 0;
+    int height = 0;
+
+    // 全屏三角形在顶点着色器中由gl_VertexID生成，只需要一个空VAO
+    GLuint emptyVertexArray = 0;
+    // 光源体：内切球为单位球的二十面体
+    GLuint volumeVertexArray = 0;
+    GLuint volumeVertexBuffer = 0;
+    GLuint volumeIndexBuffer = 0;
+    GLsizei volumeIndexCount = 0;
+    GLuint instanceBuffer = 0;
+    GLsizeiptr instanceCapacity = 0;
+    std::vector<LightVolumeInstance> instances;   // 每帧复用
+};
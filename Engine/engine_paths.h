@@ -0,0 +1,18 @@
+#pragma once
+// 资源路径配置
+// CMake会通过 GL_RENDER_ROOT 传入源码目录，未定义时沿用原来的绝对路径
+
+#ifndef GL_RENDER_ROOT
+#define GL_RENDER_ROOT "c:/Users/dutou/Documents/CppPrograms/GL_Render"
+#endif
+
+// 着色器目录
+#define GL_RENDER_SHADER_DIR GL_RENDER_ROOT "/Shader/"
+// 着色器程序二进制缓存目录，运行时生成
+#define GL_RENDER_SHADER_CACHE_DIR GL_RENDER_ROOT "/ShaderCache/"
+// 模型目录
+#define GL_RENDER_MODEL_DIR GL_RENDER_ROOT "/Assets/Models/"
+// 纹理目录
+#define GL_RENDER_TEXTURE_DIR GL_RENDER_ROOT "/Assets/Textures/"
+// 字体目录
+#define GL_RENDER_FONT_DIR GL_RENDER_ROOT "/fonts/"
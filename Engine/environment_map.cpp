@@ -0,0 +1,394 @@
+#include "environment_map.h"
+#include "mesh_cache.h"
+#include "shader.h"
+#include "resource_manager.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "engine_paths.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <vector>
+#include <glm.hpp>
+#include <stb/stb_image.h>
+
+// 文件格式（小端）：IblCacheHeader，辐照度贴图6个面，预过滤贴图逐级mip的6个面，BRDF查找表
+// 立方体贴图每像素3个半精度浮点（RGB），查找表2个（RG），行之间没有填充
+
+static const char kIblCacheMagic[4] = {'G', 'L', 'R', 'I'};
+
+struct IblCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t irradianceSize;
+    uint32_t prefilterSize;
+    uint32_t prefilterMips;
+    uint32_t brdfLUTSize;
+};
+static_assert(sizeof(IblCacheHeader) == 32, "IblCacheHeader不能有填充");
+
+// 立方体贴图一个面的基，方向 = x * s + y * t + z，s、t在[-1, 1]，与GL的立方体贴图面约定一致
+struct CubeFace {
+    glm::vec3 x;
+    glm::vec3 y;
+    glm::vec3 z;
+};
+static const CubeFace kCubeFaces[6] = {
+    {{0, 0, -1}, {0, -1, 0}, {1, 0, 0}},    // +X
+    {{0, 0, 1}, {0, -1, 0}, {-1, 0, 0}},    // -X
+    {{1, 0, 0}, {0, 0, 1}, {0, 1, 0}},      // +Y
+    {{1, 0, 0}, {0, 0, -1}, {0, -1, 0}},    // -Y
+    {{1, 0, 0}, {0, -1, 0}, {0, 0, 1}},     // +Z
+    {{-1, 0, 0}, {0, -1, 0}, {0, 0, -1}},   // -Z
+};
+
+static size_t cubeMipBytes(uint32_t size, uint32_t mip) {
+    size_t faceSize = std::max(size >> mip, 1u);
+    return faceSize * faceSize * 3 * sizeof(uint16_t) * 6;
+}
+
+static size_t prefilterBytes() {
+    size_t bytes = 0;
+    for (uint32_t mip = 0; mip < IBL_PREFILTER_MIPS; mip++) {
+        bytes += cubeMipBytes(IBL_PREFILTER_SIZE, mip);
+    }
+    return bytes;
+}
+
+static size_t brdfLUTBytes() {
+    return static_cast<size_t>(IBL_BRDF_LUT_SIZE) * IBL_BRDF_LUT_SIZE * 2 * sizeof(uint16_t);
+}
+
+// 创建空的RGB16F立方体贴图，mipLevels级
+static GLuint createCubeMap(int size, int mipLevels, const char* name) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    GLStateTracker::get().bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+    for (int mip = 0; mip < mipLevels; mip++) {
+        int faceSize = std::max(size >> mip, 1);
+        for (int face = 0; face < 6; face++) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB16F, faceSize, faceSize, 0,
+                         GL_RGB, GL_HALF_FLOAT, nullptr);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    GLDebug::get().label(GL_TEXTURE, texture, name);
+    return texture;
+}
+
+bool EnvironmentMap::load(const std::string& hdrPath) {
+    PROFILE_SCOPE("EnvironmentMap::load");
+    release();
+    uint64_t sourceHash = 0;
+    if (!MeshCache::hashFile(hdrPath, sourceHash)) {
+        LOG_ERROR("EnvironmentMap: 无法读取环境贴图 {}", hdrPath);
+        return false;
+    }
+    // 相邻面之间过滤，高粗糙度的mip没有接缝
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    const std::string cachePath = hdrPath + ".iblcache";
+    createTextures();
+    if (loadCache(cachePath, sourceHash)) {
+        LOG_INFO("EnvironmentMap: 从缓存加载 {}", cachePath);
+    } else {
+        if (!precompute(hdrPath)) {
+            release();
+            return false;
+        }
+        if (writeCache(cachePath, sourceHash)) {
+            LOG_INFO("EnvironmentMap: 预计算结果已写入 {}", cachePath);
+        }
+    }
+    loaded = true;
+    return true;
+}
+
+void EnvironmentMap::createTextures() {
+    irradianceMap = createCubeMap(IBL_IRRADIANCE_SIZE, 1, "IBL irradiance");
+    prefilterMap = createCubeMap(IBL_PREFILTER_SIZE, IBL_PREFILTER_MIPS, "IBL prefiltered specular");
+
+    glGenTextures(1, &brdfLUT);
+    GLStateTracker::get().bindTexture(0, GL_TEXTURE_2D, brdfLUT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, IBL_BRDF_LUT_SIZE, IBL_BRDF_LUT_SIZE, 0, GL_RG, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLDebug::get().label(GL_TEXTURE, brdfLUT, "IBL BRDF LUT");
+
+    RenderStats& renderStats = RenderStats::get();
+    renderStats.trackMemory(RenderMemory::Textures, irradianceMap, cubeMipBytes(IBL_IRRADIANCE_SIZE, 0));
+    renderStats.trackMemory(RenderMemory::Textures, prefilterMap, prefilterBytes());
+    renderStats.trackMemory(RenderMemory::Textures, brdfLUT, brdfLUTBytes());
+}
+
+bool EnvironmentMap::loadCache(const std::string& cachePath, uint64_t sourceHash) {
+    MappedFile file;
+    if (!file.open(cachePath)) return false;
+    IblCacheHeader header;
+    size_t expectedSize = sizeof(header) + cubeMipBytes(IBL_IRRADIANCE_SIZE, 0) + prefilterBytes() + brdfLUTBytes();
+    if (file.size() != expectedSize) {
+        LOG_WARN("EnvironmentMap: 缓存大小不符，重新预计算: {}", cachePath);
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kIblCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != IBL_CACHE_VERSION || header.sourceHash != sourceHash ||
+        header.irradianceSize != IBL_IRRADIANCE_SIZE || header.prefilterSize != IBL_PREFILTER_SIZE ||
+        header.prefilterMips != IBL_PREFILTER_MIPS || header.brdfLUTSize != IBL_BRDF_LUT_SIZE) {
+        LOG_INFO("EnvironmentMap: 缓存已过期，重新预计算: {}", cachePath);
+        return false;
+    }
+
+    // 半精度行宽不是4的倍数，按1字节对齐上传
+    const uint8_t* data = file.data() + sizeof(header);
+    GLint previousAlignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLStateTracker& state = GLStateTracker::get();
+    auto uploadCube = [&](GLuint texture, uint32_t size, uint32_t mipLevels) {
+        state.bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+        for (uint32_t mip = 0; mip < mipLevels; mip++) {
+            GLsizei faceSize = static_cast<GLsizei>(std::max(size >> mip, 1u));
+            size_t faceBytes = cubeMipBytes(size, mip) / 6;
+            for (int face = 0; face < 6; face++) {
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, 0, 0, faceSize, faceSize,
+                                GL_RGB, GL_HALF_FLOAT, data);
+                data += faceBytes;
+            }
+        }
+    };
+    uploadCube(irradianceMap, IBL_IRRADIANCE_SIZE, 1);
+    uploadCube(prefilterMap, IBL_PREFILTER_SIZE, IBL_PREFILTER_MIPS);
+    state.bindTexture(0, GL_TEXTURE_2D, brdfLUT);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, IBL_BRDF_LUT_SIZE, IBL_BRDF_LUT_SIZE, GL_RG, GL_HALF_FLOAT, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+    return true;
+}
+
+bool EnvironmentMap::writeCache(const std::string& cachePath, uint64_t sourceHash) const {
+    // 先读回全部数据，GL出错时不留下文件
+    std::vector<uint8_t> data(cubeMipBytes(IBL_IRRADIANCE_SIZE, 0) + prefilterBytes() + brdfLUTBytes());
+    GLint previousAlignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    GLStateTracker& state = GLStateTracker::get();
+    uint8_t* cursor = data.data();
+    auto readCube = [&](GLuint texture, uint32_t size, uint32_t mipLevels) {
+        state.bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+        for (uint32_t mip = 0; mip < mipLevels; mip++) {
+            size_t faceBytes = cubeMipBytes(size, mip) / 6;
+            for (int face = 0; face < 6; face++) {
+                glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB, GL_HALF_FLOAT, cursor);
+                cursor += faceBytes;
+            }
+        }
+    };
+    readCube(irradianceMap, IBL_IRRADIANCE_SIZE, 1);
+    readCube(prefilterMap, IBL_PREFILTER_SIZE, IBL_PREFILTER_MIPS);
+    state.bindTexture(0, GL_TEXTURE_2D, brdfLUT);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, cursor);
+    glPixelStorei(GL_PACK_ALIGNMENT, previousAlignment);
+
+    IblCacheHeader header;
+    std::memcpy(header.magic, kIblCacheMagic, sizeof(header.magic));
+    header.version = IBL_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.irradianceSize = IBL_IRRADIANCE_SIZE;
+    header.prefilterSize = IBL_PREFILTER_SIZE;
+    header.prefilterMips = IBL_PREFILTER_MIPS;
+    header.brdfLUTSize = IBL_BRDF_LUT_SIZE;
+
+    // 先写临时文件再替换，避免留下半个文件
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            LOG_WARN("无法写入环境贴图缓存: {}", tempPath);
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!out) {
+            LOG_WARN("写入环境贴图缓存失败: {}", tempPath);
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    std::remove(cachePath.c_str());
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        LOG_WARN("无法替换环境贴图缓存: {}", cachePath);
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool EnvironmentMap::precompute(const std::string& hdrPath) {
+    PROFILE_SCOPE("EnvironmentMap::precompute");
+    int width = 0, height = 0, channels = 0;
+    float* pixels = stbi_loadf(hdrPath.c_str(), &width, &height, &channels, 3);
+    if (!pixels) {
+        LOG_ERROR("EnvironmentMap: 无法解码 {}: {}", hdrPath, stbi_failure_reason());
+        return false;
+    }
+
+    const std::string vertexPath = GL_RENDER_SHADER_DIR "fullscreen.vert";
+    const std::string fragmentPath = GL_RENDER_SHADER_DIR "ibl_precompute.frag";
+    ResourceManager& resources = ResourceManager::get();
+    ShaderHandle equirectShader = resources.acquireShader(vertexPath, fragmentPath, "#define EQUIRECT_TO_CUBE\n");
+    ShaderHandle irradianceShader = resources.acquireShader(vertexPath, fragmentPath, "#define IRRADIANCE\n");
+    ShaderHandle prefilterShader = resources.acquireShader(vertexPath, fragmentPath, "#define PREFILTER\n");
+    ShaderHandle brdfShader = resources.acquireShader(vertexPath, fragmentPath, "#define BRDF_LUT\n");
+    if (!equirectShader->ID || !irradianceShader->ID || !prefilterShader->ID || !brdfShader->ID) {
+        LOG_ERROR("EnvironmentMap: 预计算着色器编译失败");
+        stbi_image_free(pixels);
+        return false;
+    }
+    LOG_INFO("EnvironmentMap: 预计算 {} ({}x{})", hdrPath, width, height);
+
+    // 等距柱状图：第一行是+Y方向，水平方向环绕
+    GLStateTracker& state = GLStateTracker::get();
+    GLuint equirectTexture = 0;
+    glGenTextures(1, &equirectTexture);
+    state.bindTexture(0, GL_TEXTURE_2D, equirectTexture);
+    GLint previousAlignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousAlignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, previousAlignment);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    stbi_image_free(pixels);
+
+    // 保存调用方的状态，预计算只画全屏三角形
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+
+    GLuint framebuffer = 0;
+    GLuint emptyVertexArray = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glGenVertexArrays(1, &emptyVertexArray);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    state.bindVertexArray(emptyVertexArray);
+    bool complete = true;
+
+    // 把立方体贴图的一级mip的六个面逐个画满
+    auto renderCube = [&](Shader& shader, GLuint target, int size, int mip) {
+        int faceSize = std::max(size >> mip, 1);
+        glViewport(0, 0, faceSize, faceSize);
+        for (int face = 0; face < 6; face++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face,
+                                   target, mip);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                complete = false;
+                return;
+            }
+            shader.setVec3("faceX", kCubeFaces[face].x);
+            shader.setVec3("faceY", kCubeFaces[face].y);
+            shader.setVec3("faceZ", kCubeFaces[face].z);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+    };
+
+    // 等距柱状图转成带mip的立方体贴图，卷积时按采样密度选mip，减少亮点噪声
+    int environmentMips = 1;
+    while ((IBL_ENVIRONMENT_SIZE >> environmentMips) > 0) environmentMips++;
+    GLuint environmentCube = createCubeMap(IBL_ENVIRONMENT_SIZE, environmentMips, "IBL environment");
+    equirectShader->use();
+    state.bindTexture(0, GL_TEXTURE_2D, equirectTexture);
+    renderCube(*equirectShader, environmentCube, IBL_ENVIRONMENT_SIZE, 0);
+    state.bindTexture(0, GL_TEXTURE_CUBE_MAP, environmentCube);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+    // 漫反射辐照度
+    irradianceShader->use();
+    irradianceShader->setFloat("sourceSize", static_cast<float>(IBL_ENVIRONMENT_SIZE));
+    renderCube(*irradianceShader, irradianceMap, IBL_IRRADIANCE_SIZE, 0);
+
+    // 镜面预过滤，粗糙度按mip均分
+    prefilterShader->use();
+    prefilterShader->setFloat("sourceSize", static_cast<float>(IBL_ENVIRONMENT_SIZE));
+    for (int mip = 0; mip < IBL_PREFILTER_MIPS && complete; mip++) {
+        prefilterShader->setFloat("roughness", static_cast<float>(mip) / (IBL_PREFILTER_MIPS - 1));
+        prefilterShader->setFloat("faceSize", static_cast<float>(std::max(IBL_PREFILTER_SIZE >> mip, 1)));
+        renderCube(*prefilterShader, prefilterMap, IBL_PREFILTER_SIZE, mip);
+    }
+
+    // 分裂求和的BRDF查找表，与环境无关
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUT, 0);
+    if (complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+        brdfShader->use();
+        glViewport(0, 0, IBL_BRDF_LUT_SIZE, IBL_BRDF_LUT_SIZE);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    } else {
+        complete = false;
+    }
+
+    // 恢复状态，删除临时资源
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    if (blend) glEnable(GL_BLEND);
+    if (cullFace) glEnable(GL_CULL_FACE);
+    state.bindVertexArray(0);
+    state.forgetVertexArray(emptyVertexArray);
+    glDeleteVertexArrays(1, &emptyVertexArray);
+    glDeleteFramebuffers(1, &framebuffer);
+    state.forgetTexture(environmentCube);
+    state.forgetTexture(equirectTexture);
+    glDeleteTextures(1, &environmentCube);
+    glDeleteTextures(1, &equirectTexture);
+
+    if (!complete) {
+        LOG_ERROR("EnvironmentMap: 预计算帧缓冲不完整");
+        return false;
+    }
+    return true;
+}
+
+void EnvironmentMap::bind() const {
+    if (!loaded) return;
+    GLStateTracker& state = GLStateTracker::get();
+    state.bindTexture(IRRADIANCE_TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP, irradianceMap);
+    state.bindTexture(PREFILTER_TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP, prefilterMap);
+    state.bindTexture(BRDF_LUT_TEXTURE_UNIT, GL_TEXTURE_2D, brdfLUT);
+}
+
+void EnvironmentMap::release() {
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    for (GLuint* texture : {&irradianceMap, &prefilterMap, &brdfLUT}) {
+        if (*texture == 0) continue;
+        renderStats.releaseMemory(RenderMemory::Textures, *texture);
+        state.forgetTexture(*texture);
+        glDeleteTextures(1, texture);
+        *texture = 0;
+    }
+    loaded = false;
+}
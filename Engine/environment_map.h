@@ -0,0 +1,47 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// 预计算结果的分辨率，修改后旧缓存自动失效（文件头记录了尺寸）
+#define IBL_ENVIRONMENT_SIZE 512    // 等距柱状图转成的中间立方体贴图，不保存
+#define IBL_IRRADIANCE_SIZE 32
+#define IBL_PREFILTER_SIZE 128
+#define IBL_PREFILTER_MIPS 5        // 粗糙度0~1均分到各级mip
+#define IBL_BRDF_LUT_SIZE 256
+// 缓存文件格式版本，格式或卷积算法变化时递增
+#define IBL_CACHE_VERSION 1
+
+// 基于图像的环境光照
+// 加载等距柱状HDR图，在GPU上生成漫反射辐照度立方体贴图、按粗糙度预过滤的GGX镜面
+// 立方体贴图（mip链）和分裂求和的BRDF查找表。卷积很慢，结果以半精度写入源文件旁的
+// .iblcache，文件头记录源文件哈希和各贴图尺寸，下次启动哈希一致时直接上传缓存内容。
+class EnvironmentMap {
+public:
+    EnvironmentMap() = default;
+    EnvironmentMap(const EnvironmentMap&) = delete;
+    EnvironmentMap& operator=(const EnvironmentMap&) = delete;
+
+    // 加载环境贴图，有有效缓存时跳过预计算；失败时保持未加载状态
+    bool load(const std::string& hdrPath);
+    bool isLoaded() const { return loaded; }
+    // 预过滤贴图的最大mip，粗糙度1对应这一级
+    float maxPrefilterLod() const { return static_cast<float>(IBL_PREFILTER_MIPS - 1); }
+    // 绑定三张贴图到IBL的纹理单元
+    void bind() const;
+    // 删除GL纹理，需要在GL上下文销毁前调用
+    void release();
+
+private:
+    // 按缓存文件头的尺寸创建三张空贴图
+    void createTextures();
+    bool loadCache(const std::string& cachePath, uint64_t sourceHash);
+    bool writeCache(const std::string& cachePath, uint64_t sourceHash) const;
+    // 在GPU上完成全部卷积，结果写入三张贴图
+    bool precompute(const std::string& hdrPath);
+
+    GLuint irradianceMap = 0;   // RGB16F立方体贴图
+    GLuint prefilterMap = 0;    // RGB16F立方体贴图，IBL_PREFILTER_MIPS级
+    GLuint brdfLUT = 0;         // RG16F，x: NdotV，y: 粗糙度
+    bool loaded = false;
+};
@@ -0,0 +1,192 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// 默认的固定帧率和刷新率
+#define FRAME_PACER_DEFAULT_HZ 60.0
+// 自旋时间的范围（秒），睡眠精度越差自旋越长
+#define FRAME_PACER_MIN_SPIN 0.0005
+#define FRAME_PACER_MAX_SPIN 0.004
+// 低延迟模式在预计工作时间之外留的余量（秒）
+#define FRAME_PACER_LOW_LATENCY_MARGIN 0.001
+// 低延迟模式取最近多少帧的最长工作时间作为预测
+#define FRAME_PACER_WORK_WINDOW 30
+// 模拟用的帧间隔上限（秒），拖动窗口或断点之后不会一步跳很远
+#define FRAME_PACER_MAX_DELTA 0.1
+
+static double toSeconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+static std::chrono::steady_clock::duration fromSeconds(double seconds) {
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+FramePacer::FramePacer()
+    : mode(FramePacingMode::VSync),
+      fixedPeriod(1.0 / FRAME_PACER_DEFAULT_HZ),
+      refreshPeriod(1.0 / FRAME_PACER_DEFAULT_HZ),
+      spinThreshold(FRAME_PACER_MIN_SPIN) {
+#ifdef _WIN32
+    // 默认的系统定时器精度约15.6ms，睡眠无法用于帧节奏
+    timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::setMode(FramePacingMode newMode) {
+    mode = newMode;
+    // 重新开始计时，避免按旧模式的截止时间补帧
+    fixedDeadline = Clock::now();
+}
+
+void FramePacer::setFixedRate(double hz) {
+    if (hz > 0.0) fixedPeriod = 1.0 / hz;
+}
+
+void FramePacer::setRefreshRate(double hz) {
+    if (hz > 0.0) refreshPeriod = 1.0 / hz;
+}
+
+int FramePacer::swapInterval() const {
+    return mode == FramePacingMode::VSync || mode == FramePacingMode::LowLatency ? 1 : 0;
+}
+
+double FramePacer::targetInterval() const {
+    switch (mode) {
+    case FramePacingMode::Fixed:
+        return fixedPeriod;
+    case FramePacingMode::VSync:
+    case FramePacingMode::LowLatency:
+        return refreshPeriod;
+    default:
+        return 0.0;
+    }
+}
+
+double FramePacer::predictWorkTime() const {
+    // 取最近几帧的最大值而不是平均值，预测偏短会错过垂直同步，代价是整整一帧
+    double work = 0.0;
+    size_t count = std::min<size_t>(historyCount, FRAME_PACER_WORK_WINDOW);
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (historyNext + FRAME_PACER_HISTORY - 1 - i) % FRAME_PACER_HISTORY;
+        work = std::max(work, history[index].workTime);
+    }
+    return work + FRAME_PACER_LOW_LATENCY_MARGIN;
+}
+
+void FramePacer::waitUntil(Clock::time_point deadline) {
+    Clock::time_point now = Clock::now();
+    if (deadline - now > fromSeconds(spinThreshold)) {
+        Clock::time_point wake = deadline - fromSeconds(spinThreshold);
+        std::this_thread::sleep_until(wake);
+        Clock::time_point woke = Clock::now();
+        current.sleepTime += toSeconds(woke - now);
+        // 睡过头时加大提前量，否则缓慢减小
+        double oversleep = toSeconds(woke - wake);
+        spinThreshold = std::max(spinThreshold * 0.95, oversleep * 1.25);
+        spinThreshold = std::clamp(spinThreshold, FRAME_PACER_MIN_SPIN, FRAME_PACER_MAX_SPIN);
+        now = woke;
+    }
+    Clock::time_point spinStart = now;
+    while (now < deadline) {
+        now = Clock::now();
+    }
+    current.spinTime += toSeconds(now - spinStart);
+}
+
+void FramePacer::beginFrame() {
+    current = FrameTiming();
+    Clock::time_point now = Clock::now();
+
+    if (mode == FramePacingMode::Fixed) {
+        // 截止时间按周期累加，单帧的误差不会累积；落后超过一帧时不再追赶
+        fixedDeadline += fromSeconds(fixedPeriod);
+        if (fixedDeadline < now - fromSeconds(fixedPeriod)) {
+            fixedDeadline = now;
+        }
+        waitUntil(fixedDeadline);
+    } else if (mode == FramePacingMode::LowLatency && hasPresented) {
+        // 下一次垂直同步前刚好完成一帧的时刻开始，输入越晚采样延迟越低
+        Clock::time_point nextPresent = lastPresent + fromSeconds(refreshPeriod);
+        while (nextPresent < now) {
+            nextPresent += fromSeconds(refreshPeriod);
+        }
+        waitUntil(nextPresent - fromSeconds(predictWorkTime()));
+    }
+
+    workStart = Clock::now();
+    workEnded = false;
+}
+
+void FramePacer::beforePresent() {
+    workEnd = Clock::now();
+    workEnded = true;
+}
+
+void FramePacer::endFrame() {
+    Clock::time_point now = Clock::now();
+    current.workTime = toSeconds((workEnded ? workEnd : now) - workStart);
+    if (hasPresented) {
+        current.frameTime = toSeconds(now - lastPresent);
+        double target = targetInterval();
+        current.pacingError = target > 0.0 ? current.frameTime - target : 0.0;
+        current.cpuIdle = current.frameTime > 0.0 ? current.sleepTime / current.frameTime : 0.0;
+    }
+    lastPresent = now;
+    hasPresented = true;
+
+    history[historyNext] = current;
+    historyNext = (historyNext + 1) % FRAME_PACER_HISTORY;
+    historyCount = std::min<size_t>(historyCount + 1, FRAME_PACER_HISTORY);
+}
+
+double FramePacer::getDeltaTime() const {
+    return std::min(getLastFrame().frameTime, FRAME_PACER_MAX_DELTA);
+}
+
+const FrameTiming& FramePacer::getLastFrame() const {
+    return history[(historyNext + FRAME_PACER_HISTORY - 1) % FRAME_PACER_HISTORY];
+}
+
+FrameTiming FramePacer::getAverage() const {
+    FrameTiming average;
+    if (historyCount == 0) return average;
+    for (size_t i = 0; i < historyCount; i++) {
+        const FrameTiming& timing = history[i];
+        average.frameTime += timing.frameTime;
+        average.workTime += timing.workTime;
+        average.sleepTime += timing.sleepTime;
+        average.spinTime += timing.spinTime;
+        average.pacingError += std::fabs(timing.pacingError);
+        average.cpuIdle += timing.cpuIdle;
+    }
+    double scale = 1.0 / historyCount;
+    average.frameTime *= scale;
+    average.workTime *= scale;
+    average.sleepTime *= scale;
+    average.spinTime *= scale;
+    average.pacingError *= scale;
+    average.cpuIdle *= scale;
+    return average;
+}
+
+const char* FramePacer::modeName(FramePacingMode mode) {
+    switch (mode) {
+    case FramePacingMode::Uncapped: return "不限帧";
+    case FramePacingMode::VSync: return "垂直同步";
+    case FramePacingMode::Fixed: return "固定帧率";
+    case FramePacingMode::LowLatency: return "低延迟";
+    default: return "未知";
+    }
+}
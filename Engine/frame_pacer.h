@@ -0,0 +1,87 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+
+// 保留多少帧的计时记录
+#define FRAME_PACER_HISTORY 120
+
+// 帧节奏模式
+enum class FramePacingMode {
+    Uncapped,       // 不等待，关闭垂直同步
+    VSync,          // 只靠交换缓冲等待垂直同步
+    Fixed,          // 关闭垂直同步，按固定帧率等待
+    LowLatency,     // 垂直同步，并推迟输入采样到预计呈现之前刚好来得及完成的时刻
+    Count,
+};
+
+// 一帧的计时，时间单位为秒
+struct FrameTiming {
+    double frameTime = 0.0;     // 与上一次呈现的间隔
+    double workTime = 0.0;      // 等待结束到呈现：输入、模拟、渲染和交换缓冲
+    double sleepTime = 0.0;     // 线程挂起的时间
+    double spinTime = 0.0;      // 睡眠之后自旋补足的时间
+    double pacingError = 0.0;   // frameTime减目标间隔，不限帧时为0
+    double cpuIdle = 0.0;       // sleepTime占frameTime的比例
+};
+
+// 帧节奏控制
+// 等待分两段：先睡眠到截止时间前一小段，再自旋补足，提前量根据实际睡过头的时间调整。
+// 帧间隔从上一次交换缓冲返回（呈现）开始计算，而不是从帧开始。
+class FramePacer {
+public:
+    FramePacer();
+    ~FramePacer();
+
+    void setMode(FramePacingMode mode);
+    FramePacingMode getMode() const { return mode; }
+    // 固定帧率模式的目标帧率
+    void setFixedRate(double hz);
+    // 显示器刷新率，垂直同步和低延迟模式的目标间隔
+    void setRefreshRate(double hz);
+    // 当前模式需要的交换间隔，传给glfwSwapInterval
+    int swapInterval() const;
+
+    // 帧开始时调用，按模式等待，返回后再采样输入
+    void beginFrame();
+    // 交换缓冲之前调用（可选），之后的时间不算工作时间
+    // 垂直同步时交换缓冲会等待，计入工作时间会让低延迟模式的预测越来越长
+    void beforePresent();
+    // 交换缓冲之后调用，记录呈现时间
+    void endFrame();
+
+    // 上一帧的呈现间隔，长时间卡顿后限制在FRAME_PACER_MAX_DELTA以内，用于移动等模拟
+    double getDeltaTime() const;
+    const FrameTiming& getLastFrame() const;
+    // 最近几帧的平均值，pacingError取绝对值的平均
+    FrameTiming getAverage() const;
+
+    static const char* modeName(FramePacingMode mode);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 目标帧间隔，不限帧时为0
+    double targetInterval() const;
+    // 预计从采样输入到交换完成需要的时间
+    double predictWorkTime() const;
+    void waitUntil(Clock::time_point deadline);
+
+    FramePacingMode mode;
+    double fixedPeriod;
+    double refreshPeriod;
+
+    Clock::time_point lastPresent;
+    Clock::time_point workStart;
+    Clock::time_point workEnd;
+    bool workEnded = false;
+    Clock::time_point fixedDeadline;
+    bool hasPresented = false;
+
+    // 睡眠提前醒来的量，按观察到的睡过头时间调整
+    double spinThreshold;
+
+    FrameTiming current;
+    FrameTiming history[FRAME_PACER_HISTORY];
+    size_t historyCount = 0;
+    size_t historyNext = 0;
+};
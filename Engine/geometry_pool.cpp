@@ -0,0 +1,259 @@
+#include "geometry_pool.h"
+#include "model.h"
+#include "gl_state.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <numeric>
+#include <initializer_list>
+
+void RangeAllocator::reset(uint32_t capacity) {
+    freeRanges.clear();
+    freeRanges[0] = capacity;
+    totalSize = capacity;
+    usedSize = 0;
+}
+
+bool RangeAllocator::allocate(uint32_t size, uint32_t& offset) {
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        if (it->second < size) continue;
+        offset = it->first;
+        uint32_t remaining = it->second - size;
+        freeRanges.erase(it);
+        if (remaining > 0) {
+            freeRanges[offset + size] = remaining;
+        }
+        usedSize += size;
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size) {
+    usedSize -= size;
+    auto next = freeRanges.lower_bound(offset);
+    // 与后一个空闲区间相接时合并
+    if (next != freeRanges.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+    // 与前一个空闲区间相接时合并
+    if (next != freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    freeRanges[offset] = size;
+}
+
+static GLsizeiptr indexSize(GLenum indexType) {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+GeometryPool& GeometryPool::get() {
+    static GeometryPool instance;
+    return instance;
+}
+
+bool GeometryPool::multiDrawSupported() const {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+GeometryBlock* GeometryPool::createBlock(VertexFormat format, GLenum indexType,
+                                         uint32_t vertexCapacity, uint32_t indexCapacity) {
+    // 绘制序号缓冲所有块共用，只创建一次
+    if (drawIndexBuffer == 0) {
+        std::vector<uint32_t> drawIndices(MULTI_DRAW_MAX_DRAWS);
+        std::iota(drawIndices.begin(), drawIndices.end(), 0u);
+        glGenBuffers(1, &drawIndexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(uint32_t), drawIndices.data(), GL_STATIC_DRAW);
+        RenderStats::get().trackMemory(RenderMemory::Buffers, drawIndexBuffer, drawIndices.size() * sizeof(uint32_t));
+        GLDebug::get().label(GL_BUFFER, drawIndexBuffer, "GeometryPool draw indices");
+    }
+
+    auto block = std::make_unique<GeometryBlock>();
+    block->format = format;
+    block->indexType = indexType;
+    block->vertices.reset(vertexCapacity);
+    block->indices.reset(indexCapacity);
+
+    glGenBuffers(1, &block->vertexBuffer);
+    glGenBuffers(1, &block->indexBuffer);
+    glGenBuffers(1, &block->positionBuffer);
+    glGenVertexArrays(1, &block->vertexArray);
+    glGenVertexArrays(1, &block->depthVertexArray);
+    if (block->vertexBuffer == 0 || block->indexBuffer == 0 || block->vertexArray == 0 ||
+        block->positionBuffer == 0 || block->depthVertexArray == 0) {
+        LOG_ERROR("GeometryPool: 创建缓冲失败");
+        destroyBlock(*block);
+        return nullptr;
+    }
+
+    GLStateTracker& state = GLStateTracker::get();
+    state.bindVertexArray(block->vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, block->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCapacity * Mesh::vertexStride(format), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * indexSize(indexType), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, block->positionBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * Mesh::positionStride(format), nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        LOG_ERROR("GeometryPool: 显存不足，无法创建 {} 顶点 / {} 索引的缓冲块", vertexCapacity, indexCapacity);
+        state.bindVertexArray(0);
+        destroyBlock(*block);
+        return nullptr;
+    }
+    RenderStats& renderStats = RenderStats::get();
+    renderStats.trackMemory(RenderMemory::Buffers, block->vertexBuffer,
+                            static_cast<size_t>(vertexCapacity) * Mesh::vertexStride(format));
+    renderStats.trackMemory(RenderMemory::Buffers, block->indexBuffer,
+                            static_cast<size_t>(indexCapacity) * indexSize(indexType));
+    renderStats.trackMemory(RenderMemory::Buffers, block->positionBuffer,
+                            static_cast<size_t>(vertexCapacity) * Mesh::positionStride(format));
+    Mesh::setupVertexAttributes(format);
+    GLDebug& debug = GLDebug::get();
+    debug.label(GL_VERTEX_ARRAY, block->vertexArray, "GeometryPool VAO");
+    debug.label(GL_BUFFER, block->vertexBuffer, "GeometryPool vertices");
+    debug.label(GL_BUFFER, block->indexBuffer, "GeometryPool indices");
+    debug.label(GL_BUFFER, block->positionBuffer, "GeometryPool positions");
+
+    // 每个实例前进一个，baseInstance就是绘制序号
+    glBindBuffer(GL_ARRAY_BUFFER, drawIndexBuffer);
+    glEnableVertexAttribArray(DRAW_INDEX_LOCATION);
+    glVertexAttribIPointer(DRAW_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+    glVertexAttribDivisor(DRAW_INDEX_LOCATION, 1);
+
+    // 深度通道的VAO：位置流和同一个索引缓冲，baseVertex与主VAO相同
+    state.bindVertexArray(block->depthVertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, block->positionBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block->indexBuffer);
+    Mesh::setupPositionAttribute(format);
+    debug.label(GL_VERTEX_ARRAY, block->depthVertexArray, "GeometryPool depth VAO");
+    state.bindVertexArray(0);
+
+    LOG_INFO("GeometryPool: 新建缓冲块 #{}，{}格式，{}位索引，{} 顶点 / {} 索引",
+                 blocks.size(), format == VertexFormat::Packed ? "压缩" : "浮点",
+                 indexType == GL_UNSIGNED_SHORT ? 16 : 32, vertexCapacity, indexCapacity);
+    blocks.push_back(std::move(block));
+    return blocks.back().get();
+}
+
+void GeometryPool::destroyBlock(GeometryBlock& block) {
+    for (GLuint* vertexArray : {&block.vertexArray, &block.depthVertexArray}) {
+        if (*vertexArray == 0) continue;
+        GLStateTracker::get().forgetVertexArray(*vertexArray);
+        glDeleteVertexArrays(1, vertexArray);
+    }
+    for (GLuint* buffer : {&block.vertexBuffer, &block.indexBuffer, &block.positionBuffer}) {
+        if (*buffer == 0) continue;
+        RenderStats::get().releaseMemory(RenderMemory::Buffers, *buffer);
+        glDeleteBuffers(1, buffer);
+    }
+    block.vertexArray = block.vertexBuffer = block.indexBuffer = 0;
+    block.positionBuffer = block.depthVertexArray = 0;
+}
+
+GeometryAllocation GeometryPool::allocate(VertexFormat format, GLenum indexType,
+                                          const void* vertexData, const void* positionData, uint32_t vertexCount,
+                                          const void* indexData, uint32_t indexCount) {
+    GeometryAllocation allocation;
+    if (vertexCount == 0 || indexCount == 0) {
+        return allocation;
+    }
+
+    uint32_t vertexOffset = 0, indexOffset = 0;
+    GeometryBlock* target = nullptr;
+    for (auto& block : blocks) {
+        if (block->format != format || block->indexType != indexType) continue;
+        if (!block->vertices.allocate(vertexCount, vertexOffset)) continue;
+        if (!block->indices.allocate(indexCount, indexOffset)) {
+            block->vertices.free(vertexOffset, vertexCount);
+            continue;
+        }
+        target = block.get();
+        break;
+    }
+    if (!target) {
+        target = createBlock(format, indexType,
+                             std::max(vertexCount, GEOMETRY_POOL_BLOCK_VERTICES),
+                             std::max(indexCount, GEOMETRY_POOL_BLOCK_INDICES));
+        if (!target) {
+            return allocation;
+        }
+        target->vertices.allocate(vertexCount, vertexOffset);
+        target->indices.allocate(indexCount, indexOffset);
+    }
+
+    // 用COPY_WRITE目标上传，不会改动当前绑定的VAO的索引缓冲
+    GLsizeiptr stride = Mesh::vertexStride(format);
+    GLsizeiptr elementSize = indexSize(indexType);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target->vertexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * stride, vertexCount * stride, vertexData);
+    GLsizeiptr positionStride = Mesh::positionStride(format);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target->positionBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset * positionStride, vertexCount * positionStride, positionData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, target->indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * elementSize, indexCount * elementSize, indexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    target->allocations++;
+    allocation.block = target;
+    allocation.baseVertex = static_cast<GLint>(vertexOffset);
+    allocation.firstIndex = indexOffset;
+    allocation.vertexCount = vertexCount;
+    allocation.indexCount = indexCount;
+    return allocation;
+}
+
+void GeometryPool::free(GeometryAllocation& allocation) {
+    GeometryBlock* block = allocation.block;
+    if (!block) return;
+    block->vertices.free(static_cast<uint32_t>(allocation.baseVertex), allocation.vertexCount);
+    block->indices.free(allocation.firstIndex, allocation.indexCount);
+    allocation = GeometryAllocation();
+
+    // 块空了就删除，模型卸载后显存能还给驱动
+    if (--block->allocations == 0) {
+        destroyBlock(*block);
+        blocks.erase(std::find_if(blocks.begin(), blocks.end(),
+                                  [block](const std::unique_ptr<GeometryBlock>& b) { return b.get() == block; }));
+    }
+}
+
+GeometryPool::Stats GeometryPool::getStats() const {
+    Stats stats;
+    stats.blocks = static_cast<uint32_t>(blocks.size());
+    for (const auto& block : blocks) {
+        // 顶点按主顶点流和位置流两份计算
+        GLsizeiptr stride = Mesh::vertexStride(block->format) + Mesh::positionStride(block->format);
+        GLsizeiptr elementSize = indexSize(block->indexType);
+        stats.allocations += block->allocations;
+        stats.reservedBytes += block->vertices.capacity() * stride + block->indices.capacity() * elementSize;
+        stats.usedBytes += block->vertices.used() * stride + block->indices.used() * elementSize;
+    }
+    return stats;
+}
+
+void GeometryPool::shutdown() {
+    if (!blocks.empty()) {
+        Stats stats = getStats();
+        if (stats.allocations > 0) {
+            LOG_WARN("GeometryPool: 仍有 {} 个网格未释放", stats.allocations);
+        }
+    }
+    for (auto& block : blocks) {
+        destroyBlock(*block);
+    }
+    // 泄漏的网格析构时还会归还空间，这些块对象保留到那时
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+                                [](const std::unique_ptr<GeometryBlock>& block) { return block->allocations == 0; }),
+                 blocks.end());
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, drawIndexBuffer);
+    if (drawIndexBuffer) glDeleteBuffers(1, &drawIndexBuffer);
+    drawIndexBuffer = 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+// 定义见model.h
+enum class VertexFormat;
+
+// 每块缓冲的默认容量，超过容量的网格单独占用一块刚好放得下的缓冲
+#define GEOMETRY_POOL_BLOCK_VERTICES (1u << 20)
+#define GEOMETRY_POOL_BLOCK_INDICES (4u << 20)
+// 绘制序号属性的位置，多重间接绘制时由baseInstance偏移得到每个绘制的序号
+#define DRAW_INDEX_LOCATION 7
+// 一帧内多重间接绘制的最大绘制数，同时是绘制序号缓冲的长度
+// 每个绘制的数据占9个texel，4096个绘制在纹理缓冲的最小保证尺寸(65536)之内
+#define MULTI_DRAW_MAX_DRAWS 4096
+
+// 区间分配器，首次适配，释放时与相邻空闲区间合并
+class RangeAllocator {
+public:
+    void reset(uint32_t capacity);
+    bool allocate(uint32_t size, uint32_t& offset);
+    void free(uint32_t offset, uint32_t size);
+    uint32_t capacity() const { return totalSize; }
+    uint32_t used() const { return usedSize; }
+
+private:
+    std::map<uint32_t, uint32_t> freeRanges;  // 起始位置 -> 长度
+    uint32_t totalSize = 0;
+    uint32_t usedSize = 0;
+};
+
+// 池中的一块共享缓冲，同一块中的网格顶点格式和索引类型相同，共用一个VAO
+struct GeometryBlock {
+    VertexFormat format;
+    GLenum indexType;
+    GLuint vertexArray = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint positionBuffer = 0;      // 只有位置的顶点流，与vertexBuffer按相同的顶点下标排列
+    GLuint depthVertexArray = 0;    // 只读positionBuffer的VAO，用于深度通道
+    RangeAllocator vertices;    // 以顶点为单位
+    RangeAllocator indices;     // 以索引为单位
+    uint32_t allocations = 0;
+};
+
+// 网格在池中的位置，block为空表示网格使用自己的缓冲
+struct GeometryAllocation {
+    GeometryBlock* block = nullptr;
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLuint vertexCount = 0;
+    GLuint indexCount = 0;
+};
+
+// 几何池：所有网格的顶点和索引放在少数几块大缓冲里
+// 网格只记录baseVertex和firstIndex，同一块中的网格可以用一次glMultiDrawElementsIndirect提交
+class GeometryPool {
+public:
+    static GeometryPool& get();
+
+    // 把顶点、位置流和索引复制到池中，索引是相对网格自身的下标；失败时返回的block为空
+    GeometryAllocation allocate(VertexFormat format, GLenum indexType,
+                                const void* vertexData, const void* positionData, uint32_t vertexCount,
+                                const void* indexData, uint32_t indexCount);
+    // 归还空间，块中已没有网格时删除整块
+    void free(GeometryAllocation& allocation);
+
+    // 是否支持多重间接绘制（需要GL 4.3）
+    bool multiDrawSupported() const;
+
+    // 删除所有块，需要在GL上下文销毁前调用
+    void shutdown();
+
+    struct Stats {
+        uint32_t blocks = 0;
+        uint32_t allocations = 0;
+        size_t reservedBytes = 0;   // 所有块的缓冲总大小
+        size_t usedBytes = 0;       // 已分配给网格的部分
+    };
+    Stats getStats() const;
+
+private:
+    GeometryPool() = default;
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    GeometryBlock* createBlock(VertexFormat format, GLenum indexType, uint32_t vertexCapacity, uint32_t indexCapacity);
+    void destroyBlock(GeometryBlock& block);
+
+    std::vector<std::unique_ptr<GeometryBlock>> blocks;
+    GLuint drawIndexBuffer = 0;     // 0, 1, 2, ...，所有块的VAO共用
+};
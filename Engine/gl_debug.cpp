@@ -0,0 +1,149 @@
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+
+// 没有调试输出时一次最多读出的错误数，上下文丢失时glGetError可能一直返回错误
+#define GL_DEBUG_MAX_ERRORS_PER_CHECK 16
+
+GLDebug& GLDebug::get() {
+    static GLDebug instance;
+    return instance;
+}
+
+GLDebug::GLDebug() = default;
+
+static bool hasExtension(const char* extension) {
+    // glad没有生成扩展，直接查扩展字符串
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name && std::strcmp(name, extension) == 0) return true;
+    }
+    return false;
+}
+
+void GLDebug::init(GLADloadproc loader) {
+    supported = GLAD_GL_VERSION_4_3 != 0;
+    if (!supported && hasExtension("GL_KHR_debug")) {
+        // glad只在4.3以上加载这些入口；KHR_debug在桌面GL上的入口名没有后缀，与核心相同
+        glad_glDebugMessageCallback = reinterpret_cast<PFNGLDEBUGMESSAGECALLBACKPROC>(loader("glDebugMessageCallback"));
+        glad_glDebugMessageControl = reinterpret_cast<PFNGLDEBUGMESSAGECONTROLPROC>(loader("glDebugMessageControl"));
+        glad_glObjectLabel = reinterpret_cast<PFNGLOBJECTLABELPROC>(loader("glObjectLabel"));
+        glad_glPushDebugGroup = reinterpret_cast<PFNGLPUSHDEBUGGROUPPROC>(loader("glPushDebugGroup"));
+        glad_glPopDebugGroup = reinterpret_cast<PFNGLPOPDEBUGGROUPPROC>(loader("glPopDebugGroup"));
+        supported = glad_glDebugMessageCallback && glad_glDebugMessageControl && glad_glObjectLabel &&
+                    glad_glPushDebugGroup && glad_glPopDebugGroup;
+    }
+    if (!supported) {
+        LOG_INFO("GLDebug: 不支持GL_KHR_debug{}", GL_DEBUG_CONTEXT ? "，退回glGetError检查" : "");
+        return;
+    }
+
+    glGetIntegerv(GL_MAX_LABEL_LENGTH, &maxLabelLength);
+    GLint maxStackDepth = 0;
+    glGetIntegerv(GL_MAX_DEBUG_GROUP_STACK_DEPTH, &maxStackDepth);
+    // 栈底是默认组，占一层
+    maxGroupDepth = static_cast<uint32_t>(std::max(maxStackDepth - 1, 0));
+    GLint contextFlags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &contextFlags);
+
+    glDebugMessageCallback(messageCallback, nullptr);
+    glEnable(GL_DEBUG_OUTPUT);
+#if GL_DEBUG_CONTEXT
+    // 同步输出，断点打在回调里就能看到出错的调用栈；通知级别的消息太多，不接收
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+#else
+    // 异步输出不会让驱动在每个调用后同步，只接收高严重度的消息
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_HIGH, 0, nullptr, GL_TRUE);
+#endif
+    LOG_INFO("GLDebug: 调试输出已开启，{}，{}调试上下文",
+        GL_DEBUG_CONTEXT ? "同步" : "异步",
+        (contextFlags & GL_CONTEXT_FLAG_DEBUG_BIT) ? "" : "非");
+}
+
+void GLDebug::label(GLenum identifier, GLuint name, const char* text) {
+    if (!ENABLE_GL_DEBUG_MARKERS || !supported || name == 0 || !text) return;
+    // 长度包括结尾的0，超过上限时GL报错而不是截断
+    GLsizei length = static_cast<GLsizei>(std::strlen(text));
+    length = std::min(length, maxLabelLength - 1);
+    glObjectLabel(identifier, name, length, text);
+}
+
+void GLDebug::pushGroup(const char* name) {
+    if (!ENABLE_GL_DEBUG_MARKERS || !supported) return;
+    // 超过栈深度的组只计数不下发，保证push和pop配对
+    if (groupDepth++ >= maxGroupDepth) return;
+    GLsizei length = static_cast<GLsizei>(std::strlen(name));
+    length = std::min(length, maxLabelLength - 1);
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, length, name);
+}
+
+void GLDebug::popGroup() {
+    if (!ENABLE_GL_DEBUG_MARKERS || !supported || groupDepth == 0) return;
+    if (--groupDepth >= maxGroupDepth) return;
+    glPopDebugGroup();
+}
+
+void GLDebug::checkErrors(const char* where) {
+    // 有调试输出时错误已经在回调里报告，不再查询
+    if (!GL_DEBUG_CONTEXT || supported) return;
+    for (int i = 0; i < GL_DEBUG_MAX_ERRORS_PER_CHECK; i++) {
+        GLenum error = glGetError();
+        if (error == GL_NO_ERROR) return;
+        LOG_ERROR("{} - OpenGL错误: {:#x}", where, error);
+    }
+}
+
+static const char* sourceName(GLenum source) {
+    switch (source) {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "窗口系统";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "着色器编译器";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "第三方";
+    case GL_DEBUG_SOURCE_APPLICATION: return "应用";
+    default: return "其他";
+    }
+}
+
+static const char* typeName(GLenum type) {
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR: return "错误";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "弃用";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "未定义行为";
+    case GL_DEBUG_TYPE_PORTABILITY: return "可移植性";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "性能";
+    case GL_DEBUG_TYPE_MARKER: return "标记";
+    default: return "其他";
+    }
+}
+
+void APIENTRY GLDebug::messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                       GLsizei, const GLchar* message, const void*) {
+    GLDebug::get().report(source, type, id, severity, message);
+}
+
+void GLDebug::report(GLenum source, GLenum type, GLuint id, GLenum severity, const GLchar* message) {
+    uint32_t count;
+    {
+        std::lock_guard<std::mutex> lock(repeatMutex);
+        uint64_t key = (static_cast<uint64_t>(source & 0xFFFF) << 48) |
+                       (static_cast<uint64_t>(type & 0xFFFF) << 32) | id;
+        count = ++repeats[key];
+    }
+    if (count > GL_DEBUG_MAX_REPEATS) return;
+
+    spdlog::level::level_enum level;
+    switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH: level = spdlog::level::err; break;
+    case GL_DEBUG_SEVERITY_MEDIUM: level = spdlog::level::warn; break;
+    case GL_DEBUG_SEVERITY_LOW: level = spdlog::level::info; break;
+    default: level = spdlog::level::debug; break;
+    }
+    spdlog::log(level, "GL {}/{} #{}: {}{}", sourceName(source), typeName(type), id, message,
+                count == GL_DEBUG_MAX_REPEATS ? "（之后不再输出）" : "");
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// 调试构建创建调试上下文，消息同步输出，在出错的GL调用栈上回调
+// 发布构建只异步接收高严重度的消息，热路径上没有任何错误查询
+#ifndef GL_DEBUG_CONTEXT
+#ifdef NDEBUG
+#define GL_DEBUG_CONTEXT 0
+#else
+#define GL_DEBUG_CONTEXT 1
+#endif
+#endif
+
+// 是否给对象命名并按区间插入调试组，供RenderDoc、Nsight等工具显示
+#ifndef ENABLE_GL_DEBUG_MARKERS
+#define ENABLE_GL_DEBUG_MARKERS 1
+#endif
+
+// 同一条消息最多输出的次数，之后静默
+#define GL_DEBUG_MAX_REPEATS 8
+
+// GL调试输出
+// 基于GL_KHR_debug：4.3核心或扩展，3.3上下文下通过加载器补齐glad没有加载的入口。
+// 不支持时调试构建退回glGetError，只在加载、创建对象等冷路径上检查。
+class GLDebug {
+public:
+    static GLDebug& get();
+
+    // gladLoadGLLoader之后调用，loader与之相同
+    void init(GLADloadproc loader);
+    bool available() const { return supported; }
+
+    // 给VAO(GL_VERTEX_ARRAY)、缓冲(GL_BUFFER)、纹理(GL_TEXTURE)、程序(GL_PROGRAM)等命名
+    // 对象必须已经绑定过一次，只调用过glGen*的名字还不是对象
+    void label(GLenum identifier, GLuint name, const char* text);
+    void label(GLenum identifier, GLuint name, const std::string& text) { label(identifier, name, text.c_str()); }
+
+    // 调试组，必须成对调用；名字超过驱动上限时截断
+    void pushGroup(const char* name);
+    void popGroup();
+
+    // 读出并记录之前的GL错误，没有调试输出的调试构建用；发布构建和有调试输出时为空操作
+    void checkErrors(const char* where);
+
+private:
+    GLDebug();
+    GLDebug(const GLDebug&) = delete;
+    GLDebug& operator=(const GLDebug&) = delete;
+
+    static void APIENTRY messageCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                         GLsizei length, const GLchar* message, const void* userParam);
+    void report(GLenum source, GLenum type, GLuint id, GLenum severity, const GLchar* message);
+
+    bool supported = false;
+    GLsizei maxLabelLength = 0;
+    uint32_t maxGroupDepth = 0;
+    uint32_t groupDepth = 0;          // 包括超过栈深度没有下发的组
+
+    // 异步输出时回调可能在驱动线程上
+    std::mutex repeatMutex;
+    // 键为来源、类型和编号，不同驱动的编号只在同一来源和类型内唯一
+    std::unordered_map<uint64_t, uint32_t> repeats;
+};
+
+// 检查到这里为止的GL错误，发布构建展开为空
+#if GL_DEBUG_CONTEXT
+#define GL_CHECK_ERRORS(where) GLDebug::get().checkErrors(where)
+#else
+#define GL_CHECK_ERRORS(where) ((void)0)
+#endif
@@ -0,0 +1,104 @@
+#include "gl_state.h"
+#include "render_stats.h"
+
+GLStateTracker& GLStateTracker::get() {
+    static GLStateTracker instance;
+    return instance;
+}
+
+GLStateTracker::GLStateTracker() {
+    invalidate();
+}
+
+void GLStateTracker::invalidate() {
+    program = kUnknown;
+    activeUnit = kUnknown;
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+        textures[i] = kUnknown;
+        textureTargets[i] = GL_NONE;
+    }
+    vertexArray = kUnknown;
+    for (GLuint& buffer : uniformBuffers) {
+        buffer = kUnknown;
+    }
+}
+
+void GLStateTracker::useProgram(GLuint newProgram) {
+    if (program == newProgram) {
+        stats.programSkips++;
+        return;
+    }
+    glUseProgram(newProgram);
+    program = newProgram;
+    stats.programChanges++;
+    RenderStats::get().add(RenderCounter::ProgramChanges);
+}
+
+void GLStateTracker::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (unit >= GL_STATE_TEXTURE_UNITS) {
+        // 超出跟踪范围的单元直接下发
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        activeUnit = unit;
+        stats.textureChanges++;
+        RenderStats::get().add(RenderCounter::TextureBinds);
+        return;
+    }
+    if (textures[unit] == texture && textureTargets[unit] == target) {
+        stats.textureSkips++;
+        return;
+    }
+    if (activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    textures[unit] = texture;
+    textureTargets[unit] = target;
+    stats.textureChanges++;
+    RenderStats::get().add(RenderCounter::TextureBinds);
+}
+
+void GLStateTracker::bindVertexArray(GLuint newVertexArray) {
+    if (vertexArray == newVertexArray) {
+        stats.vertexArraySkips++;
+        return;
+    }
+    glBindVertexArray(newVertexArray);
+    vertexArray = newVertexArray;
+    stats.vertexArrayChanges++;
+    RenderStats::get().add(RenderCounter::VertexArrayBinds);
+}
+
+void GLStateTracker::bindUniformBuffer(GLuint binding, GLuint buffer) {
+    if (binding < GL_STATE_UNIFORM_BINDINGS && uniformBuffers[binding] == buffer) {
+        stats.uniformBufferSkips++;
+        return;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    if (binding < GL_STATE_UNIFORM_BINDINGS) {
+        uniformBuffers[binding] = buffer;
+    }
+    stats.uniformBufferChanges++;
+    RenderStats::get().add(RenderCounter::UniformBufferBinds);
+}
+
+void GLStateTracker::forgetTexture(GLuint texture) {
+    for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++) {
+        if (textures[i] == texture) textures[i] = kUnknown;
+    }
+}
+
+void GLStateTracker::forgetVertexArray(GLuint oldVertexArray) {
+    if (vertexArray == oldVertexArray) vertexArray = kUnknown;
+}
+
+void GLStateTracker::forgetProgram(GLuint oldProgram) {
+    if (program == oldProgram) program = kUnknown;
+}
+
+void GLStateTracker::forgetUniformBuffer(GLuint buffer) {
+    for (GLuint& bound : uniformBuffers) {
+        if (bound == buffer) bound = kUnknown;
+    }
+}
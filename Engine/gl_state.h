@@ -0,0 +1,60 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+
+// 可跟踪的纹理单元数，覆盖材质贴图和后续的阴影、IBL等
+#define GL_STATE_TEXTURE_UNITS 16
+// 可跟踪的uniform缓冲绑定点数
+#define GL_STATE_UNIFORM_BINDINGS 16
+
+// 状态切换统计
+struct GLStateStats {
+    uint32_t programChanges = 0;
+    uint32_t programSkips = 0;
+    uint32_t textureChanges = 0;
+    uint32_t textureSkips = 0;
+    uint32_t vertexArrayChanges = 0;
+    uint32_t vertexArraySkips = 0;
+    uint32_t uniformBufferChanges = 0;
+    uint32_t uniformBufferSkips = 0;
+};
+
+// GL状态跟踪器，记录当前绑定，跳过与当前状态相同的调用
+// 绕过跟踪器直接修改这些绑定的代码（ImGui、纹理上传等）之后需要调用invalidate
+class GLStateTracker {
+public:
+    static GLStateTracker& get();
+
+    void useProgram(GLuint program);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    void bindVertexArray(GLuint vertexArray);
+    void bindUniformBuffer(GLuint binding, GLuint buffer);
+
+    // 忘记所有缓存的状态，下一次调用一定会下发
+    void invalidate();
+    // 删除对象前调用，避免名字被复用后误判为已绑定
+    void forgetTexture(GLuint texture);
+    void forgetVertexArray(GLuint vertexArray);
+    void forgetProgram(GLuint program);
+    void forgetUniformBuffer(GLuint buffer);
+
+    const GLStateStats& getStats() const { return stats; }
+    // 每帧开始时清零统计
+    void resetStats() { stats = GLStateStats(); }
+
+private:
+    GLStateTracker();
+    GLStateTracker(const GLStateTracker&) = delete;
+    GLStateTracker& operator=(const GLStateTracker&) = delete;
+
+    // 未知状态用一个不可能的名字表示
+    static const GLuint kUnknown = 0xFFFFFFFFu;
+
+    GLuint program;
+    GLuint activeUnit;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+    GLenum textureTargets[GL_STATE_TEXTURE_UNITS];
+    GLuint vertexArray;
+    GLuint uniformBuffers[GL_STATE_UNIFORM_BINDINGS];
+    GLStateStats stats;
+};
@@ -0,0 +1,311 @@
+#include "gpu_culler.h"
+#include "gl_state.h"
+#include "uniform_buffer.h"
+#include "engine_paths.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+
+// 首次复制深度前最多清掉的旧错误数，上下文丢失时glGetError可能一直返回错误
+#define GPU_CULL_MAX_STALE_ERRORS 16
+
+// 与gpu_cull.comp中的DrawCommand一致
+struct GpuDrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+bool GpuCuller::supported() {
+    return GLAD_GL_VERSION_4_3 != 0;
+}
+
+bool GpuCuller::init() {
+    if (initialized || failed) return initialized;
+    cullShader = Shader(GL_RENDER_SHADER_DIR "gpu_cull.comp");
+    pyramidShader = Shader(GL_RENDER_SHADER_DIR "depth_pyramid.comp");
+    GLint cullLinked = GL_FALSE, pyramidLinked = GL_FALSE;
+    glGetProgramiv(cullShader.ID, GL_LINK_STATUS, &cullLinked);
+    glGetProgramiv(pyramidShader.ID, GL_LINK_STATUS, &pyramidLinked);
+    if (!cullLinked || !pyramidLinked) {
+        LOG_ERROR("GpuCuller: 计算着色器链接失败，退回CPU剔除");
+        failed = true;
+        return false;
+    }
+    // 每帧都要上传的视锥平面，位置只查一次
+    frustumPlanesLocation = cullShader.getUniformLocation("frustumPlanes");
+    initialized = true;
+    return true;
+}
+
+void GpuCuller::setObjects(const std::vector<GpuCullObject>& cullObjects, const std::vector<glm::vec4>& drawRecords,
+                           uint32_t batchCount) {
+    objects = static_cast<uint32_t>(cullObjects.size());
+    batchOffsets.assign(batchCount, 0);
+    batchSizes.assign(batchCount, 0);
+    batchIndices.assign(batchCount, 0);
+    for (const GpuCullObject& object : cullObjects) {
+        batchSizes[object.batch]++;
+        batchIndices[object.batch] += object.indexCount;
+    }
+    // 每批的命令区大小等于该批的物体数，按批次顺序排列
+    for (uint32_t batch = 1; batch < batchCount; batch++) {
+        batchOffsets[batch] = batchOffsets[batch - 1] + batchSizes[batch - 1];
+    }
+    if (objects == 0) return;
+
+    bool created = objectBuffer == 0;
+    if (created) {
+        glGenBuffers(1, &objectBuffer);
+        glGenBuffers(1, &batchBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &countBuffer);
+        glGenBuffers(1, &drawDataBuffer);
+        glGenTextures(1, &drawDataTexture);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, cullObjects.size() * sizeof(GpuCullObject), cullObjects.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, batchBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, batchOffsets.size() * sizeof(uint32_t), batchOffsets.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects * sizeof(GpuDrawCommand), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, batchCount * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, drawRecords.size() * sizeof(glm::vec4), drawRecords.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    RenderStats& renderStats = RenderStats::get();
+    renderStats.trackMemory(RenderMemory::Buffers, objectBuffer, cullObjects.size() * sizeof(GpuCullObject));
+    renderStats.trackMemory(RenderMemory::Buffers, batchBuffer, batchOffsets.size() * sizeof(uint32_t));
+    renderStats.trackMemory(RenderMemory::Buffers, commandBuffer, objects * sizeof(GpuDrawCommand));
+    renderStats.trackMemory(RenderMemory::Buffers, countBuffer, batchCount * sizeof(uint32_t));
+    renderStats.trackMemory(RenderMemory::Buffers, drawDataBuffer, drawRecords.size() * sizeof(glm::vec4));
+    GLStateTracker::get().bindTexture(DRAW_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+    if (created) {
+        GLDebug& debug = GLDebug::get();
+        debug.label(GL_BUFFER, objectBuffer, "GpuCuller objects");
+        debug.label(GL_BUFFER, batchBuffer, "GpuCuller batch offsets");
+        debug.label(GL_BUFFER, commandBuffer, "GpuCuller commands");
+        debug.label(GL_BUFFER, countBuffer, "GpuCuller draw counts");
+        debug.label(GL_BUFFER, drawDataBuffer, "GpuCuller draw data");
+        debug.label(GL_TEXTURE, drawDataTexture, "GpuCuller draw data");
+    }
+}
+
+void GpuCuller::cull(const Frustum& frustum, bool occlusion) {
+    PROFILE_SCOPE("GpuCuller::cull");
+    if (objects == 0 || !init()) return;
+
+    // 计数清零；没有计数绘制时命令也要清零，未写入的命令不绘制任何东西
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    if (!GLAD_GL_VERSION_4_6) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_CULL_OBJECT_BINDING, objectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_CULL_BATCH_BINDING, batchBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_CULL_COMMAND_BINDING, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_CULL_COUNT_BINDING, countBuffer);
+
+    cullShader.use();
+    cullShader.setUint("objectCount", objects);
+    glUniform4fv(frustumPlanesLocation, 6, &frustum.planes[0][0]);
+    bool testOcclusion = occlusion && pyramidValid;
+    cullShader.setInt("occlusionCulling", testOcclusion ? 1 : 0);
+    if (testOcclusion) {
+        GLStateTracker::get().bindTexture(DEPTH_PYRAMID_TEXTURE_UNIT, GL_TEXTURE_2D, pyramidTexture);
+        cullShader.setMat4("pyramidViewProjection", pyramidViewProjection);
+        cullShader.setIVec2("pyramidSize", glm::ivec2(pyramidWidth, pyramidHeight));
+        cullShader.setInt("pyramidLevels", pyramidLevels);
+    }
+    glDispatchCompute((objects + GPU_CULL_WORKGROUP_SIZE - 1) / GPU_CULL_WORKGROUP_SIZE, 1, 1);
+    // 命令和计数接下来作为间接绘制参数读取
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCuller::drawBatch(uint32_t batch, GLenum indexType) const {
+    if (batch >= batchSizes.size() || batchSizes[batch] == 0) return;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    const void* offset = (const void*)(uintptr_t)(batchOffsets[batch] * sizeof(GpuDrawCommand));
+    if (GLAD_GL_VERSION_4_6) {
+        glBindBuffer(GL_PARAMETER_BUFFER, countBuffer);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, indexType, offset, batch * sizeof(uint32_t),
+                                         static_cast<GLsizei>(batchSizes[batch]), 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, offset, static_cast<GLsizei>(batchSizes[batch]), 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    // 可见数量在GPU上，三角形数按剔除前计算
+    RenderStats::get().addDraw(batchIndices[batch]);
+}
+
+void GpuCuller::bindDrawData(GLuint unit) const {
+    GLStateTracker::get().bindTexture(unit, GL_TEXTURE_BUFFER, drawDataTexture);
+}
+
+void GpuCuller::resizePyramid(int width, int height) {
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    if (pyramidTexture) {
+        state.forgetTexture(pyramidTexture);
+        state.forgetTexture(depthTexture);
+        renderStats.releaseMemory(RenderMemory::Textures, pyramidTexture);
+        renderStats.releaseMemory(RenderMemory::Textures, depthTexture);
+        glDeleteTextures(1, &pyramidTexture);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteFramebuffers(1, &depthFramebuffer);
+    }
+    pyramidWidth = width;
+    pyramidHeight = height;
+    pyramidLevels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(std::max(width, height)))));
+    pyramidValid = false;
+
+    // 格式与默认帧缓冲和离屏FBO的深度一致，blit要求两边格式相同
+    glGenTextures(1, &depthTexture);
+    state.bindTexture(DEPTH_PYRAMID_TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+    renderStats.trackMemory(RenderMemory::Textures, depthTexture, RenderStats::textureBytes(width, height, 4, false));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &depthFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+
+    glGenTextures(1, &pyramidTexture);
+    state.bindTexture(DEPTH_PYRAMID_TEXTURE_UNIT, GL_TEXTURE_2D, pyramidTexture);
+    glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, width, height);
+    renderStats.trackMemory(RenderMemory::Textures, pyramidTexture, RenderStats::textureBytes(width, height, 4, true));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    GLDebug& debug = GLDebug::get();
+    debug.label(GL_TEXTURE, depthTexture, "GpuCuller scene depth");
+    debug.label(GL_FRAMEBUFFER, depthFramebuffer, "GpuCuller scene depth");
+    debug.label(GL_TEXTURE, pyramidTexture, "GpuCuller depth pyramid");
+    LOG_INFO("GpuCuller: 深度金字塔 {}x{}，{} 级", width, height, pyramidLevels);
+}
+
+void GpuCuller::buildDepthPyramid(const glm::mat4& viewProjection) {
+    PROFILE_SCOPE("GpuCuller::buildDepthPyramid");
+    if (occlusionUnavailable || objects == 0 || !init()) return;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    int width = viewport[2], height = viewport[3];
+    if (width <= 0 || height <= 0) return;
+    GLint sceneFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &sceneFramebuffer);
+    bool firstBuild = pyramidTexture == 0;
+    if (width != pyramidWidth || height != pyramidHeight) {
+        resizePyramid(width, height);
+    }
+
+    if (firstBuild) {
+        for (int i = 0; i < GPU_CULL_MAX_STALE_ERRORS && glGetError() != GL_NO_ERROR; i++) {}
+    }
+    // 复制深度，多重采样的帧缓冲在这里解析
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFramebuffer);
+    glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + width, viewport[1] + height,
+                      0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    // 只在第一次检查，之后不再为此同步
+    if (firstBuild && glGetError() != GL_NO_ERROR) {
+        LOG_WARN("GpuCuller: 无法复制帧缓冲深度，关闭遮挡剔除");
+        occlusionUnavailable = true;
+        return;
+    }
+
+    GLStateTracker& state = GLStateTracker::get();
+    pyramidShader.use();
+    pyramidShader.setInt("level", 0);
+    state.bindTexture(DEPTH_PYRAMID_TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+    glBindImageTexture(1, pyramidTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+
+    for (int level = 1; level < pyramidLevels; level++) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        int levelWidth = std::max(1, width >> level);
+        int levelHeight = std::max(1, height >> level);
+        pyramidShader.setInt("level", level);
+        glBindImageTexture(0, pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+    }
+    // 下一帧的剔除着色器通过texelFetch读取
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    pyramidViewProjection = viewProjection;
+    pyramidValid = true;
+}
+
+void GpuCuller::readVisible(std::vector<uint32_t>& visible) const {
+    visible.clear();
+    if (objects == 0) return;
+    std::vector<uint32_t> counts(batchSizes.size());
+    std::vector<GpuDrawCommand> commands(objects);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counts.size() * sizeof(uint32_t), counts.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(GpuDrawCommand), commands.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    for (size_t batch = 0; batch < counts.size(); batch++) {
+        for (uint32_t i = 0; i < counts[batch]; i++) {
+            visible.push_back(commands[batchOffsets[batch] + i].baseInstance);
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+}
+
+void GpuCuller::release() {
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    if (objectBuffer) {
+        GLuint buffers[] = {objectBuffer, batchBuffer, commandBuffer, countBuffer, drawDataBuffer};
+        for (GLuint buffer : buffers) {
+            renderStats.releaseMemory(RenderMemory::Buffers, buffer);
+        }
+        glDeleteBuffers(5, buffers);
+        state.forgetTexture(drawDataTexture);
+        glDeleteTextures(1, &drawDataTexture);
+    }
+    objectBuffer = batchBuffer = commandBuffer = countBuffer = drawDataBuffer = drawDataTexture = 0;
+    if (pyramidTexture) {
+        state.forgetTexture(pyramidTexture);
+        state.forgetTexture(depthTexture);
+        renderStats.releaseMemory(RenderMemory::Textures, pyramidTexture);
+        renderStats.releaseMemory(RenderMemory::Textures, depthTexture);
+        glDeleteTextures(1, &pyramidTexture);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteFramebuffers(1, &depthFramebuffer);
+    }
+    pyramidTexture = depthTexture = depthFramebuffer = 0;
+    pyramidWidth = pyramidHeight = pyramidLevels = 0;
+    pyramidValid = false;
+    for (Shader* shader : {&cullShader, &pyramidShader}) {
+        if (shader->ID) {
+            state.forgetProgram(shader->ID);
+            glDeleteProgram(shader->ID);
+            shader->ID = 0;
+        }
+    }
+    initialized = false;
+    failed = false;
+    frustumPlanesLocation = -1;
+    objects = 0;
+    batchOffsets.clear();
+    batchSizes.clear();
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include <glm.hpp>
+#include "shader.h"
+#include "bvh.h"
+
+// 剔除着色器的线程组大小，与gpu_cull.comp一致
+#define GPU_CULL_WORKGROUP_SIZE 64
+
+// 着色器存储缓冲绑定点，与gpu_cull.comp一致
+enum GpuCullBinding : GLuint {
+    GPU_CULL_OBJECT_BINDING = 0,    // 物体包围盒和网格位置
+    GPU_CULL_BATCH_BINDING = 1,     // 每批在命令缓冲中的起点
+    GPU_CULL_COMMAND_BINDING = 2,   // 输出的间接绘制命令
+    GPU_CULL_COUNT_BINDING = 3,     // 每批的可见数量
+};
+
+// 一个参与GPU剔除的物体，与gpu_cull.comp中的CullObject逐字节对应（std430）
+struct GpuCullObject {
+    glm::vec4 boundsMin;    // 世界空间包围盒
+    glm::vec4 boundsMax;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t batch;         // 所在批次，同一批用一次间接绘制提交
+};
+static_assert(sizeof(GpuCullObject) == 48, "GpuCullObject必须符合std430布局");
+
+// GPU剔除
+// 计算着色器对每个物体做视锥测试，可选地再用上一帧的深度金字塔做遮挡测试，
+// 把可见物体的绘制命令紧凑写入所在批次的命令区并累加计数。
+// 支持GL 4.6时用glMultiDrawElementsIndirectCount按计数绘制，
+// 否则命令区预先清零，未写入的命令索引数为0，按批次容量绘制。
+class GpuCuller {
+public:
+    // 需要GL 4.3（计算着色器、SSBO和多重间接绘制）
+    static bool supported();
+    // 编译计算着色器，失败后不再重试
+    bool init();
+
+    // 上传物体、每个物体的绘制数据（DRAW_RECORD_TEXELS个texel，下标即物体下标）和批次数
+    // 物体需要按批次连续排列
+    void setObjects(const std::vector<GpuCullObject>& objects, const std::vector<glm::vec4>& drawRecords,
+                    uint32_t batchCount);
+    // 剔除，结果供drawBatch使用；occlusion为true且已有深度金字塔时同时做遮挡剔除
+    void cull(const Frustum& frustum, bool occlusion);
+    // 绘制一批，调用前需要绑定着色器、贴图和几何池块的VAO
+    void drawBatch(uint32_t batch, GLenum indexType) const;
+    // 把绘制数据的纹理缓冲绑定到纹理单元
+    void bindDrawData(GLuint unit) const;
+
+    // 从当前帧缓冲复制深度并逐级取最大值生成金字塔，下一帧的cull使用
+    // viewProjection为本帧的矩阵，遮挡测试时用它投影包围盒
+    void buildDepthPyramid(const glm::mat4& viewProjection);
+
+    // 读回上一次cull的可见物体下标（会等待GPU完成），用于和CPU剔除结果对比
+    void readVisible(std::vector<uint32_t>& visible) const;
+
+    size_t objectCount() const { return objects; }
+    void release();
+
+private:
+    void resizePyramid(int width, int height);
+
+    Shader cullShader;
+    Shader pyramidShader;
+    GLint frustumPlanesLocation = -1;   // vec4[6]，一次上传
+    bool initialized = false;
+    bool failed = false;
+
+    GLuint objectBuffer = 0;
+    GLuint batchBuffer = 0;
+    GLuint commandBuffer = 0;
+    GLuint countBuffer = 0;
+    GLuint drawDataBuffer = 0;
+    GLuint drawDataTexture = 0;
+    uint32_t objects = 0;
+    std::vector<uint32_t> batchOffsets;
+    std::vector<uint32_t> batchSizes;
+    std::vector<uint64_t> batchIndices;     // 每批剔除前的索引总数，用于统计
+
+    // 深度金字塔
+    GLuint depthTexture = 0;        // 从帧缓冲复制来的深度
+    GLuint depthFramebuffer = 0;
+    GLuint pyramidTexture = 0;      // R32F，完整mip链
+    int pyramidWidth = 0;
+    int pyramidHeight = 0;
+    int pyramidLevels = 0;
+    glm::mat4 pyramidViewProjection{1.0f};
+    bool pyramidValid = false;
+    bool occlusionUnavailable = false;  // 帧缓冲深度无法复制时关闭遮挡剔除
+};
@@ -1,7 +1,6 @@
 #include "gui_renderer.h"
 #include <glm.hpp>
 #include <gtc/type_ptr.hpp>
-#include <iostream>
 #include <stdexcept>
 #include "shader.h"
 #include <imgui.h>
@@ -9,7 +8,19 @@
 #include <imgui_impl_opengl3.h>
 #include "scene.h"
 #include "model.h"
-GUIRenderer::GUIRenderer() : axisVAO(0), axisVBO(0), gridVAO(0), gridVBO(0), GUI_shaderProgram(0) {}
+#include "engine_paths.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <cstdio>
+
+// 性能面板帧时间曲线的纵轴上限（毫秒）
+#define PERFORMANCE_GRAPH_MAX_MS 33.3f
+// 光照面板上点光源数量滑条的上限
+#define GUI_MAX_POINT_LIGHTS 4096
+GUIRenderer::GUIRenderer() : axisVAO(0), axisVBO(0), gridVAO(0), gridVBO(0), GUI_shaderProgram(0), imguiInitialized(false) {}
 
 GUIRenderer::~GUIRenderer() {
     cleanup();
@@ -17,15 +28,15 @@ GUIRenderer::~GUIRenderer() {
 
 void GUIRenderer::init() {
     // 创建并编译着色器程序
-    const char* vertPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Shader/gui.vert";
-    const char* fragPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Shader/gui.frag";
+    const char* vertPath = GL_RENDER_SHADER_DIR "gui.vert";
+    const char* fragPath = GL_RENDER_SHADER_DIR "gui.frag";
     try {
-        Shader guiShader(vertPath, fragPath);
-        GUI_shaderProgram = guiShader.ID;
+        guiShader = ResourceManager::get().acquireShader(vertPath, fragPath);
+        GUI_shaderProgram = guiShader->ID;
     } catch (const std::exception& e) {
-        std::cerr << "Error loading shader files: " << e.what() << std::endl;
-        std::cerr << "Vertex shader path: " << vertPath << std::endl;
-        std::cerr << "Fragment shader path: " << fragPath << std::endl;
+        LOG_ERROR("Error loading shader files: {}", e.what());
+        LOG_ERROR("Vertex shader path: {}", vertPath);
+        LOG_ERROR("Fragment shader path: {}", fragPath);
         throw;
     }
 
@@ -40,7 +51,7 @@ void GUIRenderer::setupAxis() {
     glGenVertexArrays(1, &axisVAO);
     glGenBuffers(1, &axisVBO);
 
-    glBindVertexArray(axisVAO);
+    GLStateTracker::get().bindVertexArray(axisVAO);
     glBindBuffer(GL_ARRAY_BUFFER, axisVBO);
     // 将坐标轴顶点数据传输到GPU
     // 定义坐标轴顶点数据
@@ -54,6 +65,9 @@ void GUIRenderer::setupAxis() {
         0.0f, 0.0f, 50.0f,   0.0f, 0.0f, 1.0f   // Z轴终点
     };
     glBufferData(GL_ARRAY_BUFFER, sizeof(axisVertices), axisVertices, GL_STATIC_DRAW);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, axisVBO, sizeof(axisVertices));
+    GLDebug::get().label(GL_VERTEX_ARRAY, axisVAO, "GUI axis VAO");
+    GLDebug::get().label(GL_BUFFER, axisVBO, "GUI axis vertices");
 
     // 设置顶点属性指针 - 位置属性
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
@@ -100,9 +114,12 @@ void GUIRenderer::setupGrid() {
     glGenVertexArrays(1, &gridVAO);
     glGenBuffers(1, &gridVBO);
 
-    glBindVertexArray(gridVAO);
+    GLStateTracker::get().bindVertexArray(gridVAO);
     glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
     glBufferData(GL_ARRAY_BUFFER, gridVertices.size() * sizeof(float), gridVertices.data(), GL_STATIC_DRAW);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, gridVBO, gridVertices.size() * sizeof(float));
+    GLDebug::get().label(GL_VERTEX_ARRAY, gridVAO, "GUI grid VAO");
+    GLDebug::get().label(GL_BUFFER, gridVBO, "GUI grid vertices");
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
@@ -110,35 +127,40 @@ void GUIRenderer::setupGrid() {
     glEnableVertexAttribArray(1);
 }
 
-void GUIRenderer::setProjectionMatrix(const glm::mat4& projection) {
-    glUseProgram(GUI_shaderProgram);
-    glUniformMatrix4fv(glGetUniformLocation(GUI_shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-}
-
-void GUIRenderer::setViewMatrix(const glm::mat4& view) {
-    glUseProgram(GUI_shaderProgram);
-    glUniformMatrix4fv(glGetUniformLocation(GUI_shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-}
-
 void GUIRenderer::renderAxis() {
-    glUseProgram(GUI_shaderProgram);
-    glBindVertexArray(axisVAO);
+    PROFILE_SCOPE("GUIRenderer::renderAxis");
+    GLStateTracker& state = GLStateTracker::get();
+    state.useProgram(GUI_shaderProgram);
+    state.bindVertexArray(axisVAO);
     glDrawArrays(GL_LINES, 0, 6);
-    glBindVertexArray(0);
+    RenderStats::get().add(RenderCounter::DrawCalls);
 }
 
 void GUIRenderer::renderGrid() {
-    glUseProgram(GUI_shaderProgram);
-    glBindVertexArray(gridVAO);
+    PROFILE_SCOPE("GUIRenderer::renderGrid");
+    GLStateTracker& state = GLStateTracker::get();
+    state.useProgram(GUI_shaderProgram);
+    state.bindVertexArray(gridVAO);
     glDrawArrays(GL_LINES, 0, 84);
-    glBindVertexArray(0);
+    RenderStats::get().add(RenderCounter::DrawCalls);
 }
 
 void GUIRenderer::cleanup() {
-    if (axisVAO) glDeleteVertexArrays(1, &axisVAO);
+    GLStateTracker& state = GLStateTracker::get();
+    if (axisVAO) {
+        state.forgetVertexArray(axisVAO);
+        glDeleteVertexArrays(1, &axisVAO);
+    }
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, axisVBO);
     if (axisVBO) glDeleteBuffers(1, &axisVBO);
-    if (gridVAO) glDeleteVertexArrays(1, &gridVAO);
+    if (gridVAO) {
+        state.forgetVertexArray(gridVAO);
+        glDeleteVertexArrays(1, &gridVAO);
+    }
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, gridVBO);
     if (gridVBO) glDeleteBuffers(1, &gridVBO);
+    guiShader.reset();
+    axisVAO = axisVBO = gridVAO = gridVBO = GUI_shaderProgram = 0;
     cleanupImGui();
 }
 
@@ -147,25 +169,30 @@ void GUIRenderer::initImGui(GLFWwindow* window) {
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
-    io.Fonts->AddFontFromFileTTF("C:/Users/dutou/Documents/CppPrograms/GL_Render/fonts/msyh.ttf", 18.0f, nullptr, io.Fonts->GetGlyphRangesChineseFull());
+    io.Fonts->AddFontFromFileTTF(GL_RENDER_FONT_DIR "msyh.ttf", 18.0f, nullptr, io.Fonts->GetGlyphRangesChineseFull());
     ImGui::StyleColorsDark();
     
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330");
+    imguiInitialized = true;
 }
 
 void GUIRenderer::cleanupImGui() {
+    if (!imguiInitialized) return;
+    imguiInitialized = false;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 }
 
 void GUIRenderer::renderImGui(Scene& scene) {
+    PROFILE_SCOPE("GUIRenderer::renderImGui");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
     renderLightingControls(scene);
+    renderPerformanceOverlay();
 
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
@@ -178,8 +205,8 @@ void GUIRenderer::renderLightingControls(Scene& scene) {
     ImGui::SetNextWindowPos(ImVec2(10, 10));
     ImGui::Begin("光照控制面板");
 
-    // 光源位置控制
-    ImGui::Text("光源位置");
+    // 主光源方向控制（从场景指向光源）
+    ImGui::Text("光源方向");
     if (ImGui::SliderFloat3("##LightPos", glm::value_ptr(scene.lightPos), -10.0f, 10.0f)) {
         std::copy(glm::value_ptr(scene.lightPos), glm::value_ptr(scene.lightPos) + 3, lightingParams.lightPos);
     }
@@ -190,20 +217,130 @@ void GUIRenderer::renderLightingControls(Scene& scene) {
         std::copy(glm::value_ptr(scene.lightColor), glm::value_ptr(scene.lightColor) + 3, lightingParams.lightColor);
     }
 
+    // 渲染路径和点光源数量，两条路径在同一场景上对比
+    ImGui::Checkbox("延迟渲染 (F8)", &scene.deferredShading);
+    // 主光源的级联阴影，PCF半径为0时只有硬件的2x2过滤
+    ImGui::Checkbox("阴影", &scene.shadows);
+    ImGui::SliderInt("PCF半径", &scene.shadowFilterRadius, 0, SHADOW_MAX_PCF_RADIUS);
+    // 加载了环境贴图时才有环境光照
+    if (scene.hasEnvironment()) {
+        ImGui::SliderFloat("环境光强度", &scene.environmentIntensity, 0.0f, 4.0f);
+    }
+    // HDR场景目标：格式在带宽和精度之间取舍，关闭时直接画到单采样的LDR帧缓冲，没有MSAA
+    ImGui::Checkbox("HDR", &scene.hdr.enabled);
+    if (scene.hdr.enabled) {
+        int hdrFormat = static_cast<int>(scene.hdr.format);
+        const char* formatNames[] = {HdrPipeline::formatName(HdrFormat::R11G11B10F),
+                                     HdrPipeline::formatName(HdrFormat::RGBA16F)};
+        if (ImGui::Combo("场景格式", &hdrFormat, formatNames, static_cast<int>(HdrFormat::Count))) {
+            scene.hdr.format = static_cast<HdrFormat>(hdrFormat);
+        }
+        ImGui::Checkbox("自动曝光", &scene.hdr.autoExposure);
+        ImGui::SliderFloat("曝光补偿(EV)", &scene.hdr.exposureCompensation, -8.0f, 8.0f);
+    }
+    int pointLightCount = static_cast<int>(scene.pointLights.size());
+    if (ImGui::SliderInt("点光源", &pointLightCount, 0, GUI_MAX_POINT_LIGHTS)) {
+        scene.scatterPointLights(static_cast<uint32_t>(pointLightCount));
+    }
+
     // PBR材质参数
     ImGui::Text("PBR材质参数");
 
-    PBR_Material& material = scene.models[0]->meshes[0].material;
+    Mesh& mesh = scene.models[0]->meshes[0];
+    PBR_Material& material = mesh.material;
+    // 修改后标记材质，下次绘制时重新上传uniform缓冲
     if (ImGui::ColorEdit3("基础颜色", glm::value_ptr(material.basecolor))) {
-        scene.models[0]->meshes[0].material.basecolor = material.basecolor;
+        mesh.materialDirty = true;
+        scene.markMaterialsDirty();
     }
     if (ImGui::SliderFloat("金属度", &material.metallic, 0.0f, 1.0f)) {
-        scene.models[0]->meshes[0].material.metallic = material.metallic;
+        mesh.materialDirty = true;
+        scene.markMaterialsDirty();
     }
     if (ImGui::SliderFloat("粗糙度", &material.roughness, 0.0f, 1.0f)) {
-        scene.models[0]->meshes[0].material.roughness = material.roughness;
+        mesh.materialDirty = true;
+        scene.markMaterialsDirty();
+    }
+
+    // 视锥剔除结果
+    const CullStats& cull = scene.getCullStats();
+    if (scene.isGpuCulling()) {
+        ImGui::Text("网格: GPU剔除");
+    } else {
+        ImGui::Text("网格: 绘制 %u / 剔除 %u", cull.drawn, cull.culled);
+    }
+    const CullStats& instances = scene.getInstanceCullStats();
+    ImGui::Text("实例: 绘制 %u / 剔除 %u", instances.drawn, instances.culled);
+
+    // 绘制调用，多重间接绘制把同一批的绘制项合成一次调用
+    const RenderQueueStats& queue = scene.getRenderStats();
+    ImGui::Text("绘制项 %u，绘制调用 %u (合批 %u)", queue.items, queue.drawCalls, queue.multiDrawItems);
+
+    // 状态切换统计，跳过的是与当前状态相同的冗余绑定
+    const GLStateStats& glState = GLStateTracker::get().getStats();
+    ImGui::Text("程序切换 %u (跳过 %u)", glState.programChanges, glState.programSkips);
+    ImGui::Text("纹理绑定 %u (跳过 %u)", glState.textureChanges, glState.textureSkips);
+    ImGui::Text("VAO绑定 %u (跳过 %u)", glState.vertexArrayChanges, glState.vertexArraySkips);
+    ImGui::Text("UBO绑定 %u (跳过 %u)", glState.uniformBufferChanges, glState.uniformBufferSkips);
+
+
+    ImGui::End();
+}
+
+void GUIRenderer::renderPerformanceOverlay() {
+    // 固定在右上角
+    const ImGuiIO& io = ImGui::GetIO();
+    ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x - 10.0f, 10.0f), ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    ImGui::Begin("性能", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings);
+
+    // 帧时间曲线，纵轴0到PERFORMANCE_GRAPH_MAX_MS
+    RenderStats& stats = RenderStats::get();
+    const float* frameTimes = stats.frameTimeHistory();
+    int offset = stats.frameTimeOffset();
+    float latest = frameTimes[(offset + RENDER_STATS_HISTORY - 1) % RENDER_STATS_HISTORY];
+    char overlay[32];
+    std::snprintf(overlay, sizeof(overlay), "%.2f ms", latest);
+    ImGui::PlotLines("##FrameTime", frameTimes, RENDER_STATS_HISTORY, offset, overlay,
+                     0.0f, PERFORMANCE_GRAPH_MAX_MS, ImVec2(300.0f, 60.0f));
+
+    // 各区间的CPU和GPU时间，GPU结果晚几帧才能读回
+    const ProfileFrame& profile = Profiler::get().getLastFrame();
+    if (ImGui::BeginTable("##Passes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("区间");
+        ImGui::TableSetupColumn("CPU ms");
+        ImGui::TableSetupColumn("GPU ms");
+        ImGui::TableHeadersRow();
+        for (const ProfileResult& scope : profile.scopes) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%*s%s", static_cast<int>(scope.depth) * 2, "", scope.name);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.3f", scope.cpuDuration / 1000.0);
+            ImGui::TableSetColumnIndex(2);
+            if (scope.gpuDuration >= 0.0) {
+                ImGui::Text("%.3f", scope.gpuDuration / 1000.0);
+            } else {
+                ImGui::TextUnformatted("-");
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    // 上一帧的计数
+    ImGui::Separator();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(RenderCounter::Count); i++) {
+        RenderCounter counter = static_cast<RenderCounter>(i);
+        ImGui::Text("%s: %llu", RenderStats::counterName(counter),
+                    static_cast<unsigned long long>(stats.lastFrame(counter)));
     }
 
+    // 按对象记录的显存
+    ImGui::Separator();
+    ImGui::Text("显存 缓冲 %.1f MB / 纹理 %.1f MB / 渲染缓冲 %.1f MB",
+                stats.memoryUsed(RenderMemory::Buffers) / 1048576.0,
+                stats.memoryUsed(RenderMemory::Textures) / 1048576.0,
+                stats.memoryUsed(RenderMemory::Renderbuffers) / 1048576.0);
 
     ImGui::End();
 }
\ No newline at end of file
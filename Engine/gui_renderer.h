@@ -31,16 +31,14 @@ public:
     void renderGrid();
     // 清理所有OpenGL资源
     void cleanup();
-    // 设置投影矩阵
-    void setProjectionMatrix(const glm::mat4& projection);
-    // 设置视图矩阵
-    void setViewMatrix(const glm::mat4& view);
 
     // ImGui相关方法
     void initImGui(GLFWwindow* window);
     void renderImGui(Scene& scene);
     void cleanupImGui();
     void renderLightingControls(Scene& scene);
+    // 性能面板：帧时间曲线、各区间的CPU/GPU时间、每帧计数和显存
+    void renderPerformanceOverlay();
     
     // 获取球体着色器参数
     const LightingParams& getLightingParams() const { return lightingParams; }
@@ -55,8 +53,11 @@ private:
     GLuint axisVAO, axisVBO;
     // OpenGL顶点数组对象和顶点缓冲区对象（网格）
     GLuint gridVAO, gridVBO;
-    // 着色器程序句柄
+    // 着色器程序句柄，程序对象由guiShader持有
     GLuint GUI_shaderProgram;
+    ShaderHandle guiShader;
+    // ImGui是否已初始化（无头模式下不初始化）
+    bool imguiInitialized;
 
     LightingParams lightingParams;
 };
\ No newline at end of file
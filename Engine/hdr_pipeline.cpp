@@ -0,0 +1,275 @@
+#include "hdr_pipeline.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "engine_paths.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <vector>
+
+// 直方图着色器的线程组大小（16x16），与luminance_histogram.comp一致
+#define HDR_HISTOGRAM_GROUP_SIZE 16
+
+const char* HdrPipeline::formatName(HdrFormat format) {
+    switch (format) {
+    case HdrFormat::R11G11B10F: return "R11G11B10F";
+    case HdrFormat::RGBA16F: return "RGBA16F";
+    default: return "?";
+    }
+}
+
+bool HdrPipeline::init(int sampleCount) {
+    release();
+    samples = sampleCount;
+    const std::string vertexPath = GL_RENDER_SHADER_DIR "fullscreen.vert";
+    const std::string fragmentPath = GL_RENDER_SHADER_DIR "tonemap.frag";
+    ResourceManager& resources = ResourceManager::get();
+    fixedTonemapShader = resources.acquireShader(vertexPath, fragmentPath);
+    if (!fixedTonemapShader->ID) {
+        LOG_ERROR("HdrPipeline: 色调映射着色器编译失败，直接渲染到LDR帧缓冲");
+        release();
+        return false;
+    }
+
+    // 自动曝光需要计算着色器和SSBO，不支持时只用固定曝光
+    computeSupported = GLAD_GL_VERSION_4_3 != 0;
+    if (computeSupported) {
+        tonemapShader = resources.acquireShader(vertexPath, fragmentPath, "#define AUTO_EXPOSURE\n");
+        histogramShader = Shader(GL_RENDER_SHADER_DIR "luminance_histogram.comp");
+        averageShader = Shader(GL_RENDER_SHADER_DIR "luminance_average.comp");
+        GLint histogramLinked = GL_FALSE, averageLinked = GL_FALSE;
+        glGetProgramiv(histogramShader.ID, GL_LINK_STATUS, &histogramLinked);
+        glGetProgramiv(averageShader.ID, GL_LINK_STATUS, &averageLinked);
+        if (!tonemapShader->ID || !histogramLinked || !averageLinked) {
+            LOG_WARN("HdrPipeline: 自动曝光着色器链接失败，使用固定曝光");
+            computeSupported = false;
+        }
+    }
+    if (computeSupported) {
+        RenderStats& renderStats = RenderStats::get();
+        GLDebug& debug = GLDebug::get();
+        std::vector<uint32_t> zeros(HDR_HISTOGRAM_BINS, 0);
+        glGenBuffers(1, &histogramBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, HDR_HISTOGRAM_BINS * sizeof(uint32_t), zeros.data(), GL_DYNAMIC_DRAW);
+        renderStats.trackMemory(RenderMemory::Buffers, histogramBuffer, HDR_HISTOGRAM_BINS * sizeof(uint32_t));
+        debug.label(GL_BUFFER, histogramBuffer, "HDR luminance histogram");
+        // 适应后的亮度和曝光，初始为中灰，曝光为1
+        const float exposure[2] = {HDR_EXPOSURE_KEY, 1.0f};
+        glGenBuffers(1, &exposureBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, exposureBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(exposure), exposure, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        renderStats.trackMemory(RenderMemory::Buffers, exposureBuffer, sizeof(exposure));
+        debug.label(GL_BUFFER, exposureBuffer, "HDR exposure");
+    }
+
+    glGenVertexArrays(1, &emptyVertexArray);
+    GLStateTracker::get().bindVertexArray(emptyVertexArray);
+    GLDebug::get().label(GL_VERTEX_ARRAY, emptyVertexArray, "Tonemap fullscreen VAO");
+    initialized = true;
+    LOG_INFO("HdrPipeline: 初始化完成，{}x MSAA，自动曝光{}", samples, computeSupported ? "可用" : "不可用");
+    return true;
+}
+
+void HdrPipeline::createTargets(int newWidth, int newHeight, HdrFormat newFormat) {
+    releaseTargets();
+    width = newWidth;
+    height = newHeight;
+    format = newFormat;
+    resetAdaptation = true;
+
+    bool halfFloat = format == HdrFormat::RGBA16F;
+    GLenum internalFormat = halfFloat ? GL_RGBA16F : GL_R11F_G11F_B10F;
+    int bytesPerPixel = halfFloat ? 8 : 4;
+    RenderStats& renderStats = RenderStats::get();
+    GLDebug& debug = GLDebug::get();
+
+    // 直方图和色调映射读取的单采样颜色，尺寸与目标视口相同，最近点采样
+    glGenTextures(1, &resolvedColor);
+    GLStateTracker::get().bindTexture(HDR_SCENE_TEXTURE_UNIT, GL_TEXTURE_2D, resolvedColor);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, halfFloat ? GL_RGBA : GL_RGB, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    renderStats.trackMemory(RenderMemory::Textures, resolvedColor,
+                            RenderStats::textureBytes(width, height, bytesPerPixel, false));
+    debug.label(GL_TEXTURE, resolvedColor, "HDR scene color");
+
+    // 深度与默认帧缓冲相同的格式，深度金字塔可以直接复制
+    int sampleCount = std::max(samples, 1);
+    glGenRenderbuffers(1, &sceneDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, sceneDepth);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+    renderStats.trackMemory(RenderMemory::Renderbuffers, sceneDepth,
+                            RenderStats::textureBytes(width, height, 4, false) * sampleCount);
+    debug.label(GL_RENDERBUFFER, sceneDepth, "HDR scene depth");
+
+    glGenFramebuffers(1, &sceneFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    if (samples > 0) {
+        glGenRenderbuffers(1, &sceneColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, sceneColor);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalFormat, width, height);
+        renderStats.trackMemory(RenderMemory::Renderbuffers, sceneColor,
+                                RenderStats::textureBytes(width, height, bytesPerPixel, false) * sampleCount);
+        debug.label(GL_RENDERBUFFER, sceneColor, "HDR scene color (MSAA)");
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColor);
+    } else {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolvedColor, 0);
+    }
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, sceneDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    debug.label(GL_FRAMEBUFFER, sceneFramebuffer, "HDR scene");
+
+    if (complete && samples > 0) {
+        glGenFramebuffers(1, &resolveFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolvedColor, 0);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        debug.label(GL_FRAMEBUFFER, resolveFramebuffer, "HDR resolve");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    if (!complete) {
+        LOG_ERROR("HdrPipeline: {} 场景目标不完整，直接渲染到LDR帧缓冲", formatName(format));
+        releaseTargets();
+        return;
+    }
+    LOG_INFO("HdrPipeline: 场景目标 {}x{}，{}", width, height, formatName(format));
+}
+
+bool HdrPipeline::begin(const HdrSettings& settings) {
+    if (!initialized || !settings.enabled) return false;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, targetViewport);
+    if (targetViewport[2] <= 0 || targetViewport[3] <= 0) return false;
+    if (targetViewport[2] != width || targetViewport[3] != height || settings.format != format) {
+        createTargets(targetViewport[2], targetViewport[3], settings.format);
+    }
+    // 创建失败时保持尺寸和格式，下次变化时再尝试
+    if (sceneFramebuffer == 0) return false;
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void HdrPipeline::updateExposure(float deltaTime) {
+    PROFILE_SCOPE("HdrPipeline::exposure");
+    float logRange = HDR_MAX_LOG_LUMINANCE - HDR_MIN_LOG_LUMINANCE;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LUMINANCE_HISTOGRAM_BINDING, histogramBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EXPOSURE_BINDING, exposureBuffer);
+
+    histogramShader.use();
+    histogramShader.setFloat("minLogLuminance", HDR_MIN_LOG_LUMINANCE);
+    histogramShader.setFloat("inverseLogRange", 1.0f / logRange);
+    GLStateTracker::get().bindTexture(HDR_SCENE_TEXTURE_UNIT, GL_TEXTURE_2D, resolvedColor);
+    glDispatchCompute((width + HDR_HISTOGRAM_GROUP_SIZE - 1) / HDR_HISTOGRAM_GROUP_SIZE,
+                      (height + HDR_HISTOGRAM_GROUP_SIZE - 1) / HDR_HISTOGRAM_GROUP_SIZE, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 指数适应，与帧率无关；重建目标后第一帧直接取当前亮度
+    glm::vec2 rate(1.0f);
+    if (!resetAdaptation) {
+        rate.x = 1.0f - std::exp(-deltaTime * HDR_ADAPTATION_SPEED_UP);
+        rate.y = 1.0f - std::exp(-deltaTime * HDR_ADAPTATION_SPEED_DOWN);
+    }
+    averageShader.use();
+    averageShader.setFloat("minLogLuminance", HDR_MIN_LOG_LUMINANCE);
+    averageShader.setFloat("logRange", logRange);
+    averageShader.setFloat("pixelCount", static_cast<float>(width) * static_cast<float>(height));
+    averageShader.setVec2("adaptationRate", rate);
+    averageShader.setFloat("exposureKey", HDR_EXPOSURE_KEY);
+    glDispatchCompute(1, 1, 1);
+    // 曝光接下来由色调映射的片段着色器读取
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    resetAdaptation = false;
+}
+
+void HdrPipeline::resolve(const HdrSettings& settings, float deltaTime) {
+    PROFILE_SCOPE("HdrPipeline::resolve");
+    if (samples > 0) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    bool autoExposure = settings.autoExposure && computeSupported;
+    if (autoExposure) {
+        updateExposure(deltaTime);
+    } else {
+        // 重新打开自动曝光时不从很久以前的亮度适应
+        resetAdaptation = true;
+    }
+
+    PROFILE_SCOPE("HdrPipeline::tonemap");
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    glViewport(targetViewport[0], targetViewport[1], targetViewport[2], targetViewport[3]);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    GLStateTracker& state = GLStateTracker::get();
+    Shader& shader = autoExposure ? *tonemapShader : *fixedTonemapShader;
+    shader.use();
+    shader.setFloat("exposureScale", std::exp2(settings.exposureCompensation));
+    state.bindTexture(HDR_SCENE_TEXTURE_UNIT, GL_TEXTURE_2D, resolvedColor);
+    state.bindVertexArray(emptyVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    RenderStats::get().addDraw(3);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+}
+
+void HdrPipeline::releaseTargets() {
+    GLStateTracker& state = GLStateTracker::get();
+    RenderStats& renderStats = RenderStats::get();
+    if (resolvedColor) {
+        renderStats.releaseMemory(RenderMemory::Textures, resolvedColor);
+        state.forgetTexture(resolvedColor);
+        glDeleteTextures(1, &resolvedColor);
+        resolvedColor = 0;
+    }
+    for (GLuint* renderbuffer : {&sceneColor, &sceneDepth}) {
+        if (*renderbuffer == 0) continue;
+        renderStats.releaseMemory(RenderMemory::Renderbuffers, *renderbuffer);
+        glDeleteRenderbuffers(1, renderbuffer);
+        *renderbuffer = 0;
+    }
+    for (GLuint* framebuffer : {&sceneFramebuffer, &resolveFramebuffer}) {
+        if (*framebuffer == 0) continue;
+        glDeleteFramebuffers(1, framebuffer);
+        *framebuffer = 0;
+    }
+}
+
+void HdrPipeline::release() {
+    releaseTargets();
+    width = 0;
+    height = 0;
+    RenderStats& renderStats = RenderStats::get();
+    for (GLuint* buffer : {&histogramBuffer, &exposureBuffer}) {
+        if (*buffer == 0) continue;
+        renderStats.releaseMemory(RenderMemory::Buffers, *buffer);
+        glDeleteBuffers(1, buffer);
+        *buffer = 0;
+    }
+    GLStateTracker& state = GLStateTracker::get();
+    for (Shader* shader : {&histogramShader, &averageShader}) {
+        if (shader->ID == 0) continue;
+        state.forgetProgram(shader->ID);
+        glDeleteProgram(shader->ID);
+        shader->ID = 0;
+    }
+    tonemapShader.reset();
+    fixedTonemapShader.reset();
+    if (emptyVertexArray) {
+        state.forgetVertexArray(emptyVertexArray);
+        glDeleteVertexArrays(1, &emptyVertexArray);
+        emptyVertexArray = 0;
+    }
+    computeSupported = false;
+    resetAdaptation = true;
+    initialized = false;
+}
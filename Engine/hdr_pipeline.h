@@ -0,0 +1,86 @@
+#pragma once
+#include <glad/glad.h>
+#include "shader.h"
+#include "resource_manager.h"
+
+// 场景颜色目标的格式：R11G11B10F每像素4字节，没有符号位和alpha；RGBA16F每像素8字节，精度更高
+enum class HdrFormat {
+    R11G11B10F,
+    RGBA16F,
+    Count
+};
+
+// 默认的场景颜色格式
+#define HDR_DEFAULT_FORMAT HdrFormat::R11G11B10F
+// 亮度直方图的区间数，与luminance_histogram.comp和luminance_average.comp一致
+#define HDR_HISTOGRAM_BINS 256
+// 直方图覆盖的log2亮度范围，更暗的像素落在第0个区间，不参与平均
+#define HDR_MIN_LOG_LUMINANCE -10.0f
+#define HDR_MAX_LOG_LUMINANCE 12.0f
+// 自动曝光把平均亮度映射到这个值（18%中灰）
+#define HDR_EXPOSURE_KEY 0.18f
+// 人眼适应速度（1/秒），变亮和变暗分别计算
+#define HDR_ADAPTATION_SPEED_UP 3.0f
+#define HDR_ADAPTATION_SPEED_DOWN 1.0f
+
+// HDR管线的设置，由Renderer每帧读取，可以运行时切换
+struct HdrSettings {
+    bool enabled = true;
+    HdrFormat format = HDR_DEFAULT_FORMAT;
+    // 关闭或不支持计算着色器时使用固定曝光
+    bool autoExposure = true;
+    // 曝光补偿（EV），自动曝光的结果或固定曝光再乘2^EV
+    float exposureCompensation = 0.0f;
+};
+
+// HDR渲染目标和色调映射
+// 场景（包括延迟渲染的合成）画到浮点颜色目标，多重采样时先解析到单采样纹理。
+// 支持GL 4.3时用计算着色器统计log亮度直方图，再由一个线程组求加权平均并按帧时间
+// 向目标亮度指数适应，结果留在GPU缓冲中，色调映射直接读取，CPU不等待GPU。
+// 最后用Hable的电影曲线色调映射并做gamma校正，写入begin之前绑定的帧缓冲。
+class HdrPipeline {
+public:
+    // 编译着色器，samples为0时场景目标不做多重采样
+    bool init(int samples);
+    bool isInitialized() const { return initialized; }
+    static const char* formatName(HdrFormat format);
+
+    // 开始一帧：按当前视口和格式准备场景目标并绑定，返回false时调用方直接画到原来的帧缓冲
+    bool begin(const HdrSettings& settings);
+    // 解析场景目标，更新曝光，色调映射到begin时绑定的帧缓冲并恢复它
+    void resolve(const HdrSettings& settings, float deltaTime);
+
+    void release();
+
+private:
+    // 视口大小、格式或采样数变化时重建场景目标
+    void createTargets(int width, int height, HdrFormat format);
+    void releaseTargets();
+    // 统计直方图并更新适应后的亮度
+    void updateExposure(float deltaTime);
+
+    bool initialized = false;
+    bool computeSupported = false;
+    int samples = 0;
+    ShaderHandle tonemapShader;         // 读取曝光缓冲（自动曝光）
+    ShaderHandle fixedTonemapShader;    // 只用曝光补偿
+    Shader histogramShader;
+    Shader averageShader;
+
+    GLuint sceneFramebuffer = 0;        // 场景颜色和深度，多重采样时是渲染缓冲
+    GLuint sceneColor = 0;
+    GLuint sceneDepth = 0;
+    GLuint resolveFramebuffer = 0;      // 多重采样时的解析目标
+    GLuint resolvedColor = 0;           // 单采样的场景颜色纹理，直方图和色调映射读取
+    GLuint histogramBuffer = 0;         // HDR_HISTOGRAM_BINS个uint，求平均后清零
+    GLuint exposureBuffer = 0;          // 适应后的平均亮度
+    GLuint emptyVertexArray = 0;
+    int width = 0;
+    int height = 0;
+    HdrFormat format = HDR_DEFAULT_FORMAT;
+    bool resetAdaptation = true;        // 第一帧或目标重建后直接取当前亮度，不从旧值适应
+
+    // begin之前绑定的帧缓冲和视口，resolve时恢复
+    GLint targetFramebuffer = 0;
+    GLint targetViewport[4] = {};
+};
@@ -0,0 +1,169 @@
+#include "headless_context.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_CONTEXT_OPENGL_DEBUG
+#define EGL_CONTEXT_OPENGL_DEBUG 0x31B0
+#endif
+
+HeadlessContext::HeadlessContext() : display(nullptr), context(nullptr),
+    fbo(0), colorRbo(0), depthRbo(0), width(0), height(0) {}
+
+HeadlessContext::~HeadlessContext() {
+    cleanup();
+}
+
+void* HeadlessContext::getProcAddress(const char* name) {
+    return reinterpret_cast<void*>(eglGetProcAddress(name));
+}
+
+bool HeadlessContext::init(int w, int h) {
+    width = w;
+    height = h;
+
+    if (!createContext()) {
+        cleanup();
+        return false;
+    }
+
+    // 初始化GLAD
+    if (!gladLoadGLLoader((GLADloadproc)getProcAddress)) {
+        LOG_ERROR("HeadlessContext: GLAD初始化失败");
+        cleanup();
+        return false;
+    }
+    LOG_INFO("HeadlessContext: {} / {}",
+        reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+        reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    GLDebug::get().init((GLADloadproc)getProcAddress);
+
+    if (!createFramebuffer()) {
+        cleanup();
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::createContext() {
+    // 优先使用Mesa的surfaceless平台，不依赖X11/Wayland
+    EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        LOG_ERROR("HeadlessContext: 无法获取EGL显示");
+        return false;
+    }
+
+    EGLint major = 0, minor = 0;
+    if (!eglInitialize(eglDisplay, &major, &minor)) {
+        LOG_ERROR("HeadlessContext: eglInitialize失败: {:#x}", eglGetError());
+        return false;
+    }
+    display = eglDisplay;
+    LOG_INFO("HeadlessContext: EGL {}.{}", major, minor);
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        LOG_ERROR("HeadlessContext: 不支持桌面OpenGL API");
+        return false;
+    }
+
+    // eglChooseConfig默认只匹配窗口surface，这里改为pbuffer，surfaceless平台只提供这类配置
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+        LOG_ERROR("HeadlessContext: 没有可用的EGL配置");
+        return false;
+    }
+
+    // 与窗口模式保持一致：OpenGL 3.3 核心模式，调试构建请求调试上下文（EGL 1.5）
+    bool debugContext = GL_DEBUG_CONTEXT && (major > 1 || minor >= 5);
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        debugContext ? EGL_CONTEXT_OPENGL_DEBUG : EGL_NONE, EGL_TRUE,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT) {
+        LOG_ERROR("HeadlessContext: eglCreateContext失败: {:#x}", eglGetError());
+        return false;
+    }
+    context = eglContext;
+
+    // 不创建任何surface，所有渲染都进FBO
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        LOG_ERROR("HeadlessContext: eglMakeCurrent失败: {:#x}", eglGetError());
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::createFramebuffer() {
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    glGenRenderbuffers(1, &colorRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    RenderStats::get().trackMemory(RenderMemory::Renderbuffers, colorRbo, RenderStats::textureBytes(width, height, 4, false));
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRbo);
+
+    glGenRenderbuffers(1, &depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    RenderStats::get().trackMemory(RenderMemory::Renderbuffers, depthRbo, RenderStats::textureBytes(width, height, 4, false));
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+    GLDebug& debug = GLDebug::get();
+    debug.label(GL_FRAMEBUFFER, fbo, "Headless framebuffer");
+    debug.label(GL_RENDERBUFFER, colorRbo, "Headless color");
+    debug.label(GL_RENDERBUFFER, depthRbo, "Headless depth");
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_ERROR("HeadlessContext: 离屏帧缓冲不完整: {:#x}", status);
+        return false;
+    }
+    bindFramebuffer();
+    return true;
+}
+
+void HeadlessContext::bindFramebuffer() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+}
+
+void HeadlessContext::cleanup() {
+    if (context) {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        RenderStats::get().releaseMemory(RenderMemory::Renderbuffers, colorRbo);
+        RenderStats::get().releaseMemory(RenderMemory::Renderbuffers, depthRbo);
+        if (colorRbo) glDeleteRenderbuffers(1, &colorRbo);
+        if (depthRbo) glDeleteRenderbuffers(1, &depthRbo);
+        fbo = colorRbo = depthRbo = 0;
+        eglMakeCurrent(static_cast<EGLDisplay>(display), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(static_cast<EGLDisplay>(display), static_cast<EGLContext>(context));
+        context = nullptr;
+    }
+    if (display) {
+        eglTerminate(static_cast<EGLDisplay>(display));
+        display = nullptr;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+
+// 无头渲染上下文
+// 使用EGL surfaceless创建OpenGL核心上下文，渲染到离屏FBO，不需要窗口和GPU（可以跑在Mesa llvmpipe上）
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    // 创建EGL上下文并初始化GLAD和离屏帧缓冲
+    bool init(int width, int height);
+    // 绑定离屏帧缓冲并设置视口
+    void bindFramebuffer() const;
+    // 释放帧缓冲和EGL上下文
+    void cleanup();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // 给GLAD使用的函数加载器
+    static void* getProcAddress(const char* name);
+
+private:
+    bool createContext();
+    bool createFramebuffer();
+
+    // EGLDisplay / EGLContext，头文件里不暴露EGL类型
+    void* display;
+    void* context;
+
+    // 离屏帧缓冲：颜色和深度模板渲染缓冲
+    GLuint fbo;
+    GLuint colorRbo;
+    GLuint depthRbo;
+
+    int width;
+    int height;
+};
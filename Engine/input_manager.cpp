@@ -11,9 +11,12 @@
 
 InputManager::InputManager()
     : yaw(-90.0f), pitch(0.0f), lastX(400.0f), lastY(300.0f),
-      firstMouse(true), cameraSpeed(2.5f * 0.016f),
+      firstMouse(true), cameraSpeed(2.5f),
       currentCameraFront(0.0f, 0.0f, -1.0f), cursorEnabled(false),
-      graveKeyPressed(false) {}
+      graveKeyPressed(false), f5KeyPressed(false), shaderReloadRequested(false),
+      f6KeyPressed(false), framePacingCycleRequested(false),
+      f7KeyPressed(false), traceDumpRequested(false),
+      f8KeyPressed(false), renderPathToggleRequested(false) {}
 
 void InputManager::init(GLFWwindow* window) {
     glfwSetWindowUserPointer(window, this);
@@ -22,7 +25,7 @@ void InputManager::init(GLFWwindow* window) {
 }
 
 void InputManager::processInput(GLFWwindow* window, glm::vec3& cameraPos,
-                               const glm::vec3& cameraFront, const glm::vec3& cameraUp) {
+                               const glm::vec3& cameraFront, const glm::vec3& cameraUp, float deltaTime) {
     // ESC键退出程序
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
@@ -42,29 +45,70 @@ void InputManager::processInput(GLFWwindow* window, glm::vec3& cameraPos,
 
     // 只在鼠标隐藏状态下处理移动输入
     if (!cursorEnabled) {
+        float cameraStep = cameraSpeed * deltaTime;
         // W键 - 向前移动
         if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            cameraPos += cameraSpeed * cameraFront;
+            cameraPos += cameraStep * cameraFront;
         
         // S键 - 向后移动
         if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            cameraPos -= cameraSpeed * cameraFront;
+            cameraPos -= cameraStep * cameraFront;
         
         // A键 - 向左移动
         if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+            cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraStep;
         
         // D键 - 向右移动
         if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+            cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraStep;
         
         // E键 - 向上移动
         if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-            cameraPos += cameraSpeed * cameraUp;
+            cameraPos += cameraStep * cameraUp;
         
         // Q键 - 向下移动
         if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-            cameraPos -= cameraSpeed * cameraUp;
+            cameraPos -= cameraStep * cameraUp;
+    }
+
+    // F5键 - 重新编译着色器
+    if (glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS) {
+        if (!f5KeyPressed) {
+            f5KeyPressed = true;
+            shaderReloadRequested = true;
+        }
+    } else {
+        f5KeyPressed = false;
+    }
+
+    // F6键 - 切换帧节奏模式
+    if (glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS) {
+        if (!f6KeyPressed) {
+            f6KeyPressed = true;
+            framePacingCycleRequested = true;
+        }
+    } else {
+        f6KeyPressed = false;
+    }
+
+    // F7键 - 写出性能trace
+    if (glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS) {
+        if (!f7KeyPressed) {
+            f7KeyPressed = true;
+            traceDumpRequested = true;
+        }
+    } else {
+        f7KeyPressed = false;
+    }
+
+    // F8键 - 切换前向/延迟渲染
+    if (glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS) {
+        if (!f8KeyPressed) {
+            f8KeyPressed = true;
+            renderPathToggleRequested = true;
+        }
+    } else {
+        f8KeyPressed = false;
     }
 
     // P键 - 截图
@@ -80,6 +124,30 @@ void InputManager::processInput(GLFWwindow* window, glm::vec3& cameraPos,
     }
 }
 
+bool InputManager::consumeShaderReload() {
+    bool requested = shaderReloadRequested;
+    shaderReloadRequested = false;
+    return requested;
+}
+
+bool InputManager::consumeFramePacingCycle() {
+    bool requested = framePacingCycleRequested;
+    framePacingCycleRequested = false;
+    return requested;
+}
+
+bool InputManager::consumeTraceDump() {
+    bool requested = traceDumpRequested;
+    traceDumpRequested = false;
+    return requested;
+}
+
+bool InputManager::consumeRenderPathToggle() {
+    bool requested = renderPathToggleRequested;
+    renderPathToggleRequested = false;
+    return requested;
+}
+
 void InputManager::mouseCallback(double xpos, double ypos) {
     // 只在鼠标隐藏状态下处理视角更新
     if (cursorEnabled) return;
@@ -123,7 +191,7 @@ void InputManager::captureScreenshot(GLFWwindow* window) {
     // 获取窗口大小
     int width, height;
     glfwGetWindowSize(window, &width, &height);
-    spdlog::info("the window:: width: {}, height: {}", width, height);
+    LOG_INFO("the window:: width: {}, height: {}", width, height);
 
     // 分配内存存储像素数据
     unsigned char* pixels = new unsigned char[width * height * 3];
@@ -170,7 +238,7 @@ void InputManager::captureScreenshot(GLFWwindow* window) {
 
     // 保存图像
     stbi_write_png(filename.c_str(), width, height, 3, flipped, width * 3);
-    spdlog::info("Screenshot saved as: {}", filename);
+    LOG_INFO("Screenshot saved as: {}", filename);
 
     // 恢复之前的帧缓冲区状态
     glBindFramebuffer(GL_FRAMEBUFFER, prevFbo);
@@ -2,20 +2,29 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm.hpp>
-#include <spdlog/spdlog.h>
+#include "log.h"
 class InputManager {
 public:
     InputManager();
     
     void init(GLFWwindow* window);
+    // deltaTime为上一帧的呈现间隔（秒），移动速度与帧率无关
     void processInput(GLFWwindow* window, glm::vec3& cameraPos, 
-                     const glm::vec3& cameraFront, const glm::vec3& cameraUp);
+                     const glm::vec3& cameraFront, const glm::vec3& cameraUp, float deltaTime);
     void mouseCallback(double xpos, double ypos);
     void captureScreenshot(GLFWwindow* window);
     
     static void staticMouseCallback(GLFWwindow* window, double xpos, double ypos);
     
     const glm::vec3& getCameraFront() const { return currentCameraFront; }
+    // F5按下后返回一次true，用于重新编译着色器
+    bool consumeShaderReload();
+    // F6按下后返回一次true，用于切换帧节奏模式
+    bool consumeFramePacingCycle();
+    // F7按下后返回一次true，用于写出性能trace
+    bool consumeTraceDump();
+    // F8按下后返回一次true，用于切换前向/延迟渲染
+    bool consumeRenderPathToggle();
     
 private:
     float yaw;
@@ -23,8 +32,16 @@ private:
     float lastX;
     float lastY;
     bool firstMouse;
-    float cameraSpeed;
+    float cameraSpeed;      // 每秒移动的距离
     glm::vec3 currentCameraFront;
     bool cursorEnabled;
     bool graveKeyPressed;
+    bool f5KeyPressed;
+    bool shaderReloadRequested;
+    bool f6KeyPressed;
+    bool framePacingCycleRequested;
+    bool f7KeyPressed;
+    bool traceDumpRequested;
+    bool f8KeyPressed;
+    bool renderPathToggleRequested;
 };
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "instance_group.h"
+#include "model.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+
+InstanceGroup::InstanceGroup(ModelHandle model)
+    : model(std::move(model)), bvhDirty(true), uploadDirty(true), instanceBuffer(0), instanceCount(0) {
+    bool first = true;
+    for (const Mesh& mesh : this->model->meshes) {
+        if (mesh.indexCount == 0) continue;
+        AABB meshBounds;
+        meshBounds.min = mesh.boundsMin;
+        meshBounds.max = mesh.boundsMax;
+        if (first) {
+            modelBounds = meshBounds;
+            first = false;
+        } else {
+            modelBounds.expand(meshBounds);
+        }
+    }
+}
+
+uint32_t InstanceGroup::add(const glm::mat4& transform) {
+    transforms.push_back(transform);
+    bvhDirty = true;
+    version++;
+    return static_cast<uint32_t>(transforms.size() - 1);
+}
+
+void InstanceGroup::setTransform(uint32_t index, const glm::mat4& transform) {
+    transforms[index] = transform;
+    bvhDirty = true;
+    uploadDirty = true;
+    version++;
+}
+
+void InstanceGroup::rebuildBVH() {
+    std::vector<AABB> bounds(transforms.size());
+    for (size_t i = 0; i < transforms.size(); i++) {
+        bounds[i] = modelBounds.transformed(transforms[i]);
+    }
+    bvh.build(bounds);
+    bvhDirty = false;
+}
+
+void InstanceGroup::update(const Frustum* frustum) {
+    if (bvhDirty) {
+        rebuildBVH();
+    }
+
+    if (frustum) {
+        bvh.cull(*frustum, visible, cullStats);
+    } else {
+        visible.resize(transforms.size());
+        for (uint32_t i = 0; i < transforms.size(); i++) visible[i] = i;
+        cullStats = CullStats();
+        cullStats.drawn = static_cast<uint32_t>(transforms.size());
+    }
+
+    // 可见集合没变时实例缓冲里的数据仍然有效
+    if (!uploadDirty && visible == uploadedVisible) {
+        return;
+    }
+
+    visibleTransforms.resize(visible.size());
+    for (size_t i = 0; i < visible.size(); i++) {
+        visibleTransforms[i] = transforms[visible[i]];
+    }
+    bool created = instanceBuffer == 0;
+    if (created) {
+        glGenBuffers(1, &instanceBuffer);
+        createVertexArrays();
+    }
+    // 整块重新指定存储，驱动不用等上一帧的绘制读完
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    if (created) {
+        GLDebug::get().label(GL_BUFFER, instanceBuffer, "InstanceGroup transforms");
+    }
+    glBufferData(GL_ARRAY_BUFFER, visibleTransforms.size() * sizeof(glm::mat4), visibleTransforms.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, instanceBuffer, visibleTransforms.size() * sizeof(glm::mat4));
+
+    instanceCount = static_cast<GLsizei>(visibleTransforms.size());
+    uploadedVisible = visible;
+    uploadDirty = false;
+}
+
+void InstanceGroup::createVertexArrays() {
+    vertexArrays.assign(model->meshes.size(), 0);
+    for (size_t i = 0; i < model->meshes.size(); i++) {
+        const Mesh& mesh = model->meshes[i];
+        if (mesh.indexCount == 0) continue;
+
+        vertexArrays[i] = mesh.createVertexArray();
+        // mat4按列占用4个属性位置，每个实例前进一次
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int column = 0; column < 4; column++) {
+            GLuint location = INSTANCE_MATRIX_LOCATION + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (void*)(sizeof(glm::vec4) * column));
+            glVertexAttribDivisor(location, 1);
+        }
+        GLStateTracker::get().bindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceGroup::submit(RenderQueue& queue, const ShaderVariants& shaders) {
+    if (instanceCount == 0) return;
+    // 实例分散在场景各处，没有统一的深度，只按状态排序
+    for (size_t i = 0; i < vertexArrays.size(); i++) {
+        Mesh& mesh = model->meshes[i];
+        Shader* shader = shaders.active(mesh.shaderFor(shaders.pass()));
+        if (vertexArrays[i] == 0 || !shader) continue;
+        queue.submitInstanced(*shader, mesh, vertexArrays[i], instanceCount, 0.0f);
+    }
+}
+
+uint32_t InstanceGroup::drawDepth(const Frustum& frustum, Shader& shader) {
+    if (transforms.empty()) return 0;
+    if (bvhDirty) {
+        rebuildBVH();
+    }
+    CullStats stats;
+    bvh.cull(frustum, depthVisible, stats);
+    if (depthVisible.empty()) return 0;
+
+    if (depthInstanceBuffer == 0) {
+        glGenBuffers(1, &depthInstanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, depthInstanceBuffer);
+        GLDebug::get().label(GL_BUFFER, depthInstanceBuffer, "InstanceGroup depth transforms");
+        depthVertexArrays.assign(model->meshes.size(), 0);
+        for (size_t i = 0; i < model->meshes.size(); i++) {
+            const Mesh& mesh = model->meshes[i];
+            if (mesh.indexCount == 0) continue;
+            depthVertexArrays[i] = mesh.createDepthVertexArray();
+            glBindBuffer(GL_ARRAY_BUFFER, depthInstanceBuffer);
+            for (int column = 0; column < 4; column++) {
+                GLuint location = INSTANCE_MATRIX_LOCATION + column;
+                glEnableVertexAttribArray(location);
+                glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                      (void*)(sizeof(glm::vec4) * column));
+                glVertexAttribDivisor(location, 1);
+            }
+            GLStateTracker::get().bindVertexArray(0);
+        }
+    }
+
+    depthTransforms.resize(depthVisible.size());
+    for (size_t i = 0; i < depthVisible.size(); i++) {
+        depthTransforms[i] = transforms[depthVisible[i]];
+    }
+    // 同一帧内每个级联都重写一次，整块重新指定存储避免等待前一个级联的绘制
+    glBindBuffer(GL_ARRAY_BUFFER, depthInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, depthTransforms.size() * sizeof(glm::mat4), depthTransforms.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, depthInstanceBuffer, depthTransforms.size() * sizeof(glm::mat4));
+
+    uint32_t draws = 0;
+    for (size_t i = 0; i < depthVertexArrays.size(); i++) {
+        if (depthVertexArrays[i] == 0) continue;
+        model->meshes[i].drawDepthInstanced(shader, depthVertexArrays[i], static_cast<GLsizei>(depthTransforms.size()));
+        draws++;
+    }
+    return draws;
+}
+
+void InstanceGroup::release() {
+    for (GLuint& vertexArray : vertexArrays) {
+        if (vertexArray) {
+            GLStateTracker::get().forgetVertexArray(vertexArray);
+            glDeleteVertexArrays(1, &vertexArray);
+        }
+    }
+    for (GLuint& vertexArray : depthVertexArrays) {
+        if (vertexArray) {
+            GLStateTracker::get().forgetVertexArray(vertexArray);
+            glDeleteVertexArrays(1, &vertexArray);
+        }
+    }
+    vertexArrays.clear();
+    depthVertexArrays.clear();
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, instanceBuffer);
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, depthInstanceBuffer);
+    if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+    if (depthInstanceBuffer) glDeleteBuffers(1, &depthInstanceBuffer);
+    instanceBuffer = 0;
+    depthInstanceBuffer = 0;
+    instanceCount = 0;
+    uploadedVisible.clear();
+    uploadDirty = true;
+}
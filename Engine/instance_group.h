@@ -0,0 +1,75 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include <glm.hpp>
+#include "bvh.h"
+#include "resource_manager.h"
+
+class RenderQueue;
+class ShaderVariants;
+class Shader;
+
+// 实例矩阵在顶点着色器中的属性位置，mat4占用连续4个位置
+#define INSTANCE_MATRIX_LOCATION 3
+
+// 实例组：同一个模型的多个摆放
+// 每帧剔除后把可见实例的矩阵紧凑写入实例缓冲，每个网格只发一次glDrawElementsInstanced
+class InstanceGroup {
+public:
+    explicit InstanceGroup(ModelHandle model);
+    InstanceGroup(const InstanceGroup&) = delete;
+    InstanceGroup& operator=(const InstanceGroup&) = delete;
+
+    // 添加一个实例，返回实例下标
+    uint32_t add(const glm::mat4& transform);
+    // 修改实例变换，下一帧重建BVH
+    void setTransform(uint32_t index, const glm::mat4& transform);
+    size_t size() const { return transforms.size(); }
+    const glm::mat4& getTransform(uint32_t index) const { return transforms[index]; }
+    const ModelHandle& getModel() const { return model; }
+    const AABB& getModelBounds() const { return modelBounds; }
+    // 实例增加或变换修改时递增，阴影等缓存据此判断是否失效
+    uint32_t getVersion() const { return version; }
+
+    // 剔除并上传可见实例，frustum为空时不剔除
+    void update(const Frustum* frustum);
+    // 把update选出的实例按网格提交到渲染队列，每个网格一项
+    // 使用网格选好的着色器变体，变体还没编译完时用基础变体
+    void submit(RenderQueue& queue, const ShaderVariants& shaders);
+    // 深度通道：剔除到frustum内的实例，每个网格一次只有位置流的实例化绘制
+    // shader需要已启用，返回绘制调用数
+    uint32_t drawDepth(const Frustum& frustum, Shader& shader);
+    // 释放实例缓冲和VAO，需要在GL上下文销毁前调用
+    void release();
+
+    // 上一次update的统计（以实例为单位）
+    const CullStats& getCullStats() const { return cullStats; }
+
+private:
+    void rebuildBVH();
+    void createVertexArrays();
+
+    ModelHandle model;
+    AABB modelBounds;                       // 所有网格包围盒的并集（模型空间）
+    std::vector<glm::mat4> transforms;
+    BVH bvh;
+    bool bvhDirty;
+    uint32_t version = 0;
+
+    std::vector<uint32_t> visible;          // 本帧可见的实例下标
+    std::vector<uint32_t> uploadedVisible;  // 上次上传到实例缓冲的实例下标，没变化时跳过上传
+    std::vector<glm::mat4> visibleTransforms;
+    bool uploadDirty;
+
+    GLuint instanceBuffer;
+    std::vector<GLuint> vertexArrays;       // 每个网格一个，共享网格的VBO/EBO
+    GLsizei instanceCount;
+    CullStats cullStats;
+
+    // 深度通道另用一个实例缓冲，每次drawDepth重新写入，不影响主通道的上传缓存
+    GLuint depthInstanceBuffer = 0;
+    std::vector<GLuint> depthVertexArrays;  // 每个网格一个，只有位置流
+    std::vector<uint32_t> depthVisible;
+    std::vector<glm::mat4> depthTransforms;
+};
@@ -0,0 +1,155 @@
+#include "light_clusterer.h"
+#include "bvh.h"
+#include "gl_state.h"
+#include "engine_paths.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+
+// 是否使用分簇光照，关闭时前向渲染退回LightBlock中的固定数量光源（用于对比）
+#define ENABLE_CLUSTERED_LIGHTING 1
+// 光源缓冲按这个数量起步，不够时翻倍
+#define CLUSTER_LIGHT_INITIAL_CAPACITY 256
+// 索引列表的容量，开头一个uint是已写入的数量
+#define CLUSTER_INDEX_CAPACITY (CLUSTER_COUNT * CLUSTER_AVERAGE_LIGHTS)
+
+bool LightClusterer::supported() {
+    return ENABLE_CLUSTERED_LIGHTING && GLAD_GL_VERSION_4_3 != 0;
+}
+
+bool LightClusterer::init() {
+    if (initialized || failed) return initialized;
+    clusterShader = Shader(GL_RENDER_SHADER_DIR "light_cluster.comp");
+    GLint linked = GL_FALSE;
+    glGetProgramiv(clusterShader.ID, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        LOG_ERROR("LightClusterer: 计算着色器链接失败，前向渲染只使用LightBlock中的光源");
+        failed = true;
+        return false;
+    }
+
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(glm::uvec2), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (CLUSTER_INDEX_CAPACITY + 1) * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    RenderStats& renderStats = RenderStats::get();
+    renderStats.trackMemory(RenderMemory::Buffers, gridBuffer, CLUSTER_COUNT * sizeof(glm::uvec2));
+    renderStats.trackMemory(RenderMemory::Buffers, indexBuffer, (CLUSTER_INDEX_CAPACITY + 1) * sizeof(uint32_t));
+    GLDebug& debug = GLDebug::get();
+    debug.label(GL_BUFFER, gridBuffer, "LightClusterer grid");
+    debug.label(GL_BUFFER, indexBuffer, "LightClusterer light indices");
+    reserveLights(CLUSTER_LIGHT_INITIAL_CAPACITY);
+
+    initialized = true;
+    LOG_INFO("LightClusterer: {}x{}x{} 个簇", CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+    return true;
+}
+
+void LightClusterer::reserveLights(size_t count) {
+    if (lightBuffer != 0 && count <= lightCapacity) return;
+    if (lightBuffer == 0) {
+        glGenBuffers(1, &lightBuffer);
+        GLDebug::get().label(GL_BUFFER, lightBuffer, "LightClusterer lights");
+        lightCapacity = CLUSTER_LIGHT_INITIAL_CAPACITY;
+    }
+    while (lightCapacity < count) {
+        lightCapacity *= 2;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, lightCapacity * sizeof(GpuPointLight), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, lightBuffer, lightCapacity * sizeof(GpuPointLight));
+}
+
+bool LightClusterer::update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection) {
+    PROFILE_SCOPE("LightClusterer::update");
+    ClusterBlock block{};
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (!supported() || !init() || viewport[2] <= 0 || viewport[3] <= 0) {
+        // 分簇关闭，片段着色器只遍历LightBlock
+        clusterUBO.update(&block, sizeof(block));
+        clusterUBO.bindBase(CLUSTER_BLOCK_BINDING);
+        visibleLights.clear();
+        return false;
+    }
+
+    // 光源的包围盒与视锥不相交时不会落在任何簇里，在CPU上先剔除
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    visibleLights.clear();
+    for (const PointLight& light : lights) {
+        AABB bounds;
+        bounds.min = light.position - glm::vec3(light.radius);
+        bounds.max = light.position + glm::vec3(light.radius);
+        if (light.radius <= 0.0f || frustum.test(bounds) == Frustum::Outside) continue;
+        visibleLights.push_back({glm::vec4(light.position, light.radius), glm::vec4(light.color, 1.0f)});
+    }
+    // 每帧重新指定存储，驱动不用等上一帧的绘制读完
+    reserveLights(visibleLights.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, lightCapacity * sizeof(GpuPointLight), nullptr, GL_STREAM_DRAW);
+    if (!visibleLights.empty()) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, visibleLights.size() * sizeof(GpuPointLight), visibleLights.data());
+    }
+    // 索引列表的写入计数清零
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(uint32_t), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHT_BINDING, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_GRID_BINDING, gridBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BINDING, indexBuffer);
+
+    // glm::perspective的投影矩阵中取出近远平面
+    float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+    float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+    glm::vec2 viewportSize(static_cast<float>(viewport[2]), static_cast<float>(viewport[3]));
+    glm::vec2 tileSize(std::ceil(viewportSize.x / CLUSTER_GRID_X), std::ceil(viewportSize.y / CLUSTER_GRID_Y));
+
+    clusterShader.use();
+    clusterShader.setUint("lightCount", static_cast<unsigned int>(visibleLights.size()));
+    clusterShader.setUint("indexCapacity", CLUSTER_INDEX_CAPACITY);
+    clusterShader.setMat4("view", view);
+    clusterShader.setMat4("inverseProjection", glm::inverse(projection));
+    clusterShader.setVec2("viewportSize", viewportSize);
+    clusterShader.setVec2("tileSize", tileSize);
+    clusterShader.setVec2("clipRange", glm::vec2(zNear, zFar));
+    glDispatchCompute((CLUSTER_COUNT + CLUSTER_WORKGROUP_SIZE - 1) / CLUSTER_WORKGROUP_SIZE, 1, 1);
+    // 簇列表接下来由片段着色器读取
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 切片 = Z * log(z / near) / log(far / near)，展开成log(z)的一次式
+    float logRange = std::log(zFar / zNear);
+    block.gridSize = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, 1);
+    block.screenToTile = glm::vec4(viewport[0], viewport[1], 1.0f / tileSize.x, 1.0f / tileSize.y);
+    block.depthSlicing = glm::vec4(CLUSTER_GRID_Z / logRange, -CLUSTER_GRID_Z * std::log(zNear) / logRange, 0.0f, 0.0f);
+    clusterUBO.update(&block, sizeof(block));
+    clusterUBO.bindBase(CLUSTER_BLOCK_BINDING);
+    return true;
+}
+
+void LightClusterer::release() {
+    RenderStats& renderStats = RenderStats::get();
+    for (GLuint* buffer : {&lightBuffer, &gridBuffer, &indexBuffer}) {
+        if (*buffer == 0) continue;
+        renderStats.releaseMemory(RenderMemory::Buffers, *buffer);
+        glDeleteBuffers(1, buffer);
+        *buffer = 0;
+    }
+    lightCapacity = 0;
+    visibleLights.clear();
+    clusterUBO.release();
+    if (clusterShader.ID) {
+        GLStateTracker::get().forgetProgram(clusterShader.ID);
+        glDeleteProgram(clusterShader.ID);
+        clusterShader.ID = 0;
+    }
+    initialized = false;
+    failed = false;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include <glm.hpp>
+#include "shader.h"
+#include "uniform_buffer.h"
+
+// 簇网格：屏幕分成CLUSTER_GRID_X x CLUSTER_GRID_Y块，深度按对数分成CLUSTER_GRID_Z片，与light_cluster.comp一致
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+// 分簇着色器的线程组大小，与light_cluster.comp一致
+#define CLUSTER_WORKGROUP_SIZE 128
+// 单个簇最多记录的光源数，与light_cluster.comp一致
+#define CLUSTER_MAX_LIGHTS 128
+// 索引列表按每簇平均这么多个光源分配，超出的簇会丢掉多余的光源
+#define CLUSTER_AVERAGE_LIGHTS 64
+
+// 点光源，光照在radius处平滑衰减为0
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;    // 已乘强度
+};
+
+// 上传给分簇着色器和片段着色器的点光源，与ClusterLight逐字节对应（std430）
+struct GpuPointLight {
+    glm::vec4 positionRadius;   // xyz: 世界空间位置，w: 半径
+    glm::vec4 color;            // rgb: 颜色（已乘强度）
+};
+static_assert(sizeof(GpuPointLight) == 32, "GpuPointLight必须符合std430布局");
+
+// 分簇光照
+// 每帧在CPU上把视锥外的点光源剔掉后上传，计算着色器每个线程负责一个簇：
+// 由逆投影算出簇在视空间的包围盒，与所有光源的包围球求交，把相交的光源下标
+// 紧凑写入全局索引列表并记录起点和数量。前向渲染的片段着色器按屏幕位置和
+// 视空间深度找到所在的簇，只遍历簇里的光源，光照开销取决于局部的光源密度。
+class LightClusterer {
+public:
+    // 需要GL 4.3（计算着色器和SSBO）
+    static bool supported();
+    // 编译计算着色器，失败后不再重试
+    bool init();
+
+    // 为当前视口和相机重建簇列表并绑定缓冲，片段着色器随后可以使用
+    // 不可用时上传关闭分簇的ClusterBlock并返回false，调用方需要把点光源放进LightBlock
+    bool update(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection);
+
+    // 上一次update中参与分簇的光源数（视锥剔除之后）
+    uint32_t visibleLightCount() const { return static_cast<uint32_t>(visibleLights.size()); }
+    void release();
+
+private:
+    // 光源缓冲容量不够时翻倍
+    void reserveLights(size_t count);
+
+    Shader clusterShader;
+    bool initialized = false;
+    bool failed = false;
+
+    GLuint lightBuffer = 0;
+    GLuint gridBuffer = 0;
+    GLuint indexBuffer = 0;
+    size_t lightCapacity = 0;
+    std::vector<GpuPointLight> visibleLights;   // 每帧复用
+    UniformBuffer clusterUBO;
+};
@@ -0,0 +1,50 @@
+#include "log.h"
+#include <spdlog/async.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+// 异步队列能容纳的消息数，加载大模型时的突发日志在这个范围内不会丢
+#define LOG_QUEUE_SIZE 8192
+// 日志文件，每次启动覆盖；为空时只输出到控制台
+#define LOG_FILE_PATH "GL_Render.log"
+// 定期刷新文件的间隔（秒）
+#define LOG_FLUSH_INTERVAL 3
+
+namespace Log {
+
+void init() {
+    if (spdlog::get("engine")) return;
+
+    spdlog::init_thread_pool(LOG_QUEUE_SIZE, 1);
+
+    std::vector<spdlog::sink_ptr> sinks;
+    sinks.push_back(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+    if (LOG_FILE_PATH[0] != '\0') {
+        sinks.push_back(std::make_shared<spdlog::sinks::basic_file_sink_mt>(LOG_FILE_PATH, true));
+    }
+
+    auto logger = std::make_shared<spdlog::async_logger>("engine", sinks.begin(), sinks.end(),
+                                                         spdlog::thread_pool(),
+                                                         spdlog::async_overflow_policy::overrun_oldest);
+    // 与spdlog默认格式相同，不显示logger名
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
+    // 运行期级别与编译期一致，编译进来的日志都输出
+    logger->set_level(static_cast<spdlog::level::level_enum>(SPDLOG_ACTIVE_LEVEL));
+    // 错误立即排队刷新，崩溃前的最后几条更可能写到文件里；其他消息定期刷新
+    logger->flush_on(spdlog::level::err);
+    spdlog::set_default_logger(logger);
+    spdlog::flush_every(std::chrono::seconds(LOG_FLUSH_INTERVAL));
+}
+
+void shutdown() {
+    // 后台线程处理完队列中的消息后才退出
+    spdlog::shutdown();
+    // 之后的日志（静态对象析构等）同步输出到控制台
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>(
+        "", std::make_shared<spdlog::sinks::stdout_color_sink_mt>()));
+}
+
+}
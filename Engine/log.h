@@ -0,0 +1,39 @@
+#pragma once
+
+// 编译期日志级别，低于它的LOG_*宏展开为空，参数不会求值
+// CMake按配置设置：Debug保留调试日志，其他配置只保留info及以上
+// 必须在包含spdlog之前定义，否则spdlog默认为info
+#ifndef SPDLOG_ACTIVE_LEVEL
+#ifdef NDEBUG
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#else
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_DEBUG
+#endif
+#endif
+#include <spdlog/spdlog.h>
+
+// 每帧、每次绘制的日志用LOG_TRACE，加载时每个网格、纹理的日志用LOG_DEBUG
+#define LOG_TRACE(...) SPDLOG_TRACE(__VA_ARGS__)
+#define LOG_DEBUG(...) SPDLOG_DEBUG(__VA_ARGS__)
+#define LOG_INFO(...) SPDLOG_INFO(__VA_ARGS__)
+#define LOG_WARN(...) SPDLOG_WARN(__VA_ARGS__)
+#define LOG_ERROR(...) SPDLOG_ERROR(__VA_ARGS__)
+
+// 日志输出
+// 默认logger换成异步logger：调用线程只格式化消息并放入有界队列，
+// 控制台和文件的写入在spdlog的后台线程完成。队列满时丢弃最旧的消息，不阻塞渲染线程。
+namespace Log {
+    // 程序开始时调用一次，之前的日志走spdlog默认的同步控制台输出
+    void init();
+    // 退出前调用，写完队列中剩余的消息并停止后台线程
+    void shutdown();
+
+    // 在main开头创建：其他局部对象（Renderer等）析构时的日志也能写出，所有返回路径都会shutdown
+    class Session {
+    public:
+        Session() { init(); }
+        ~Session() { shutdown(); }
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+    };
+}
@@ -0,0 +1,403 @@
+#include "mesh_cache.h"
+#include "log.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 文件格式（小端，所有段4字节对齐）：
+//   CacheHeader
+//   每个网格：CacheMeshRecord，7个纹理路径（uint32长度 + 字节），
+//            对齐填充，顶点数组（Vertex或PackedVertex），位置流，索引数组（uint16或uint32），对齐填充
+
+static const char kMeshCacheMagic[4] = {'G', 'L', 'R', 'M'};
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint32_t vertexSize;        // sizeof(Vertex)，防止结构体变化后读到错位数据
+    uint32_t packedVertexSize;  // sizeof(PackedVertex)
+};
+
+struct CacheMeshRecord {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t vertexFormat;      // VertexFormat
+    uint32_t indexSize;         // 2或4字节
+    float boundsMin[3];
+    float boundsMax[3];
+    float basecolor[3];
+    float metallic;
+    float roughness;
+    float ao;
+    float emissionColor[3];
+};
+
+static_assert(sizeof(CacheHeader) == 32, "CacheHeader布局不能改变");
+static_assert(sizeof(CacheMeshRecord) == 76, "CacheMeshRecord布局不能改变");
+
+// 材质纹理槽位，顺序即文件中的存储顺序
+static const struct {
+    Texture PBR_Material::* slot;
+    const char* type;
+} kTextureSlots[] = {
+    {&PBR_Material::albedoMap, "albedo"},
+    {&PBR_Material::normalMap, "normal"},
+    {&PBR_Material::heightMap, "height"},
+    {&PBR_Material::roughnessMap, "roughness"},
+    {&PBR_Material::metallicMap, "metallic"},
+    {&PBR_Material::aoMap, "ao"},
+    {&PBR_Material::emissionMap, "emission"},
+};
+
+static size_t alignTo4(size_t offset) {
+    return (offset + 3) & ~static_cast<size_t>(3);
+}
+
+// ---------------- MappedFile ----------------
+
+MappedFile::MappedFile() : mapped(nullptr), length(0)
+#ifdef _WIN32
+    , fileHandle(nullptr), mappingHandle(nullptr)
+#endif
+{}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    // 路径是UTF-8，转成宽字符再打开
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring widePath(wideLength, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &widePath[0], wideLength);
+
+    HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mapped = static_cast<const uint8_t*>(view);
+    length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后文件描述符可以直接关闭
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+
+    mapped = static_cast<const uint8_t*>(view);
+    length = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!mapped) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(mapped), length);
+#endif
+    mapped = nullptr;
+    length = 0;
+}
+
+// ---------------- MeshCacheReader ----------------
+
+bool MeshCacheReader::open(const std::string& cachePath, uint64_t sourceHash, uint32_t importFlags) {
+    close();
+    if (!file.open(cachePath)) {
+        return false;
+    }
+
+    const uint8_t* base = file.data();
+    size_t size = file.size();
+    size_t offset = 0;
+
+    // 越界检查，文件被截断时直接判定为无效缓存
+    auto fits = [&](size_t bytes) { return bytes <= size && offset <= size - bytes; };
+
+    if (!fits(sizeof(CacheHeader))) {
+        close();
+        return false;
+    }
+    CacheHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    offset += sizeof(header);
+
+    if (std::memcmp(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 ||
+        header.version != MESH_CACHE_VERSION ||
+        header.sourceHash != sourceHash ||
+        header.importFlags != importFlags ||
+        header.vertexSize != sizeof(Vertex) ||
+        header.packedVertexSize != sizeof(PackedVertex)) {
+        LOG_INFO("网格缓存已过期: {}", cachePath);
+        close();
+        return false;
+    }
+
+    meshes.reserve(header.meshCount);
+    for (uint32_t m = 0; m < header.meshCount; m++) {
+        if (!fits(sizeof(CacheMeshRecord))) {
+            close();
+            return false;
+        }
+        CacheMeshRecord record;
+        std::memcpy(&record, base + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if (record.vertexFormat > static_cast<uint32_t>(VertexFormat::Packed) ||
+            (record.indexSize != sizeof(uint16_t) && record.indexSize != sizeof(uint32_t))) {
+            close();
+            return false;
+        }
+        CachedMesh cached;
+        MeshGpuData& gpu = cached.gpu;
+        gpu.vertexFormat = static_cast<VertexFormat>(record.vertexFormat);
+        gpu.indexType = record.indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        gpu.vertexCount = record.vertexCount;
+        gpu.indexCount = record.indexCount;
+        gpu.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+        gpu.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+        cached.material = PBR_Material();
+        cached.material.basecolor = glm::vec3(record.basecolor[0], record.basecolor[1], record.basecolor[2]);
+        cached.material.metallic = record.metallic;
+        cached.material.roughness = record.roughness;
+        cached.material.ao = record.ao;
+        cached.material.emissionColor = glm::vec3(record.emissionColor[0], record.emissionColor[1], record.emissionColor[2]);
+
+        // 纹理路径
+        for (const auto& slot : kTextureSlots) {
+            if (!fits(sizeof(uint32_t))) {
+                close();
+                return false;
+            }
+            uint32_t pathLength;
+            std::memcpy(&pathLength, base + offset, sizeof(pathLength));
+            offset += sizeof(pathLength);
+            if (!fits(pathLength)) {
+                close();
+                return false;
+            }
+            Texture& texture = cached.material.*(slot.slot);
+            texture.type = slot.type;
+            texture.path.assign(reinterpret_cast<const char*>(base + offset), pathLength);
+            offset += pathLength;
+        }
+        offset = alignTo4(offset);
+
+        // 顶点、位置流和索引不拷贝，直接引用映射内存
+        const void** streams[] = {&gpu.vertices, &gpu.positions, &gpu.indices};
+        size_t streamBytes[] = {
+            static_cast<size_t>(record.vertexCount) * Mesh::vertexStride(gpu.vertexFormat),
+            static_cast<size_t>(record.vertexCount) * Mesh::positionStride(gpu.vertexFormat),
+            static_cast<size_t>(record.indexCount) * record.indexSize,
+        };
+        for (int stream = 0; stream < 3; stream++) {
+            if (!fits(streamBytes[stream])) {
+                close();
+                return false;
+            }
+            *streams[stream] = base + offset;
+            offset += streamBytes[stream];
+        }
+        offset = alignTo4(offset);
+
+        meshes.push_back(std::move(cached));
+    }
+    return true;
+}
+
+void MeshCacheReader::close() {
+    meshes.clear();
+    file.close();
+}
+
+// ---------------- MeshCache ----------------
+
+// FNV-1a 64，在hash上继续累加
+static void fnv1aUpdate(uint64_t& hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+}
+
+bool MeshCache::hashFile(const std::string& path, uint64_t& hash) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    hash = 1469598103934665603ull;
+    char buffer[64 * 1024];
+    while (in) {
+        in.read(buffer, sizeof(buffer));
+        fnv1aUpdate(hash, buffer, static_cast<size_t>(in.gcount()));
+    }
+    return true;
+}
+
+void MeshCache::hashBytes(const void* data, size_t size, uint64_t& hash) {
+    hash = 1469598103934665603ull;
+    fnv1aUpdate(hash, static_cast<const char*>(data), size);
+}
+
+bool MeshCache::hashSource(const std::string& path, uint64_t& hash) {
+    if (!hashFile(path, hash)) return false;
+    size_t extension = path.find_last_of('.');
+    if (extension == std::string::npos || path.compare(extension, std::string::npos, ".obj") != 0) {
+        return true;
+    }
+
+    // 与Assimp一样，mtllib之后到行尾是一个相对于.obj目录的文件名
+    size_t slash = path.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 7, "mtllib ") != 0) continue;
+        size_t begin = line.find_first_not_of(" \t", 7);
+        size_t end = line.find_last_not_of(" \t\r");
+        if (begin == std::string::npos) continue;
+        std::string materialPath = directory + line.substr(begin, end - begin + 1);
+        // 材质文件缺失时也记入名字，之后补上文件同样会让缓存失效
+        uint64_t materialHash = 0;
+        if (!hashFile(materialPath, materialHash)) {
+            LOG_WARN("MeshCache: 找不到材质文件 {}", materialPath);
+        }
+        fnv1aUpdate(hash, materialPath.data(), materialPath.size());
+        fnv1aUpdate(hash, reinterpret_cast<const char*>(&materialHash), sizeof(materialHash));
+    }
+    return true;
+}
+
+std::string MeshCache::cachePathFor(const std::string& sourcePath) {
+    return sourcePath + ".meshcache";
+}
+
+bool MeshCache::write(const std::string& cachePath, uint64_t sourceHash, uint32_t importFlags,
+                      const std::vector<Mesh>& meshes) {
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            LOG_WARN("无法写入网格缓存: {}", tempPath);
+            return false;
+        }
+
+        size_t offset = 0;
+        auto writeBytes = [&](const void* data, size_t bytes) {
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+            offset += bytes;
+        };
+        auto pad = [&]() {
+            static const char zeros[4] = {0, 0, 0, 0};
+            writeBytes(zeros, alignTo4(offset) - offset);
+        };
+
+        CacheHeader header;
+        std::memcpy(header.magic, kMeshCacheMagic, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.importFlags = importFlags;
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.vertexSize = sizeof(Vertex);
+        header.packedVertexSize = sizeof(PackedVertex);
+        writeBytes(&header, sizeof(header));
+
+        for (const Mesh& mesh : meshes) {
+            // 与setupMesh做同样的转换，加载时不再重复
+            MeshGpuStorage storage;
+            MeshGpuData gpu = Mesh::prepareGpuData(mesh.vertices.data(), mesh.vertices.size(),
+                                                   mesh.indices.data(), mesh.indices.size(), storage);
+            uint32_t indexSize = gpu.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            CacheMeshRecord record;
+            record.vertexCount = gpu.vertexCount;
+            record.indexCount = gpu.indexCount;
+            record.vertexFormat = static_cast<uint32_t>(gpu.vertexFormat);
+            record.indexSize = indexSize;
+            for (int i = 0; i < 3; i++) {
+                record.boundsMin[i] = gpu.boundsMin[i];
+                record.boundsMax[i] = gpu.boundsMax[i];
+                record.basecolor[i] = mesh.material.basecolor[i];
+                record.emissionColor[i] = mesh.material.emissionColor[i];
+            }
+            record.metallic = mesh.material.metallic;
+            record.roughness = mesh.material.roughness;
+            record.ao = mesh.material.ao;
+            writeBytes(&record, sizeof(record));
+
+            for (const auto& slot : kTextureSlots) {
+                const std::string& path = (mesh.material.*(slot.slot)).path;
+                uint32_t pathLength = static_cast<uint32_t>(path.size());
+                writeBytes(&pathLength, sizeof(pathLength));
+                writeBytes(path.data(), pathLength);
+            }
+            pad();
+
+            writeBytes(gpu.vertices, static_cast<size_t>(gpu.vertexCount) * Mesh::vertexStride(gpu.vertexFormat));
+            writeBytes(gpu.positions, static_cast<size_t>(gpu.vertexCount) * Mesh::positionStride(gpu.vertexFormat));
+            writeBytes(gpu.indices, static_cast<size_t>(gpu.indexCount) * indexSize);
+            pad();
+        }
+
+        if (!out) {
+            LOG_WARN("写入网格缓存失败: {}", tempPath);
+            out.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    std::remove(cachePath.c_str());
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        LOG_WARN("无法替换网格缓存: {}", cachePath);
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "model.h"
+
+// 网格缓存文件格式版本，格式变化时递增
+#define MESH_CACHE_VERSION 3
+
+// 只读内存映射文件
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const uint8_t* data() const { return mapped; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* mapped;
+    size_t length;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+// 缓存中的一个网格，保存的已经是显存格式（压缩顶点、位置流、最终的索引类型），
+// gpu中的指针直接指向映射内存，加载时原样上传
+struct CachedMesh {
+    MeshGpuData gpu;
+    PBR_Material material;      // 纹理只填了类型和路径，纹理对象由加载方创建
+};
+
+// 网格缓存读取器，打开后映射保持有效直到close或析构
+class MeshCacheReader {
+public:
+    // 打开缓存并校验魔数、版本、源文件哈希和导入标志，任意一项不符都返回false
+    bool open(const std::string& cachePath, uint64_t sourceHash, uint32_t importFlags);
+    void close();
+    const std::vector<CachedMesh>& getMeshes() const { return meshes; }
+
+private:
+    MappedFile file;
+    std::vector<CachedMesh> meshes;
+};
+
+// 网格缓存工具函数
+class MeshCache {
+public:
+    // 计算文件内容的FNV-1a 64位哈希
+    static bool hashFile(const std::string& path, uint64_t& hash);
+    // 对已经读入内存的数据计算同样的哈希，与hashFile的结果一致
+    static void hashBytes(const void* data, size_t size, uint64_t& hash);
+    // 计算模型源文件的哈希，.obj还合并mtllib引用的材质文件，改材质后缓存同样失效
+    static bool hashSource(const std::string& path, uint64_t& hash);
+    // 源文件对应的缓存文件路径
+    static std::string cachePathFor(const std::string& sourcePath);
+    // 写入缓存，先写临时文件再替换，避免留下半个文件；网格在这里转换成显存格式
+    static bool write(const std::string& cachePath, uint64_t sourceHash, uint32_t importFlags,
+                      const std::vector<Mesh>& meshes);
+};
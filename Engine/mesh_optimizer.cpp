@@ -0,0 +1,308 @@
+#include "mesh_optimizer.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+// Forsyth算法假设的LRU缓存大小
+#define FORSYTH_CACHE_SIZE 32
+// 统计ACMR/ATVR时模拟的FIFO缓存大小，接近常见GPU的变换后缓存
+#define ANALYZE_CACHE_SIZE 16
+// 过度绘制重排允许ACMR变差的比例
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+// 顶点按字节比较，只合并完全相同的顶点
+struct VertexBytesHash {
+    size_t operator()(const Vertex& v) const {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
+        uint64_t hash = 1469598103934665603ull;
+        for (size_t i = 0; i < sizeof(Vertex); i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
+
+struct VertexBytesEqual {
+    bool operator()(const Vertex& a, const Vertex& b) const {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex不能有填充字节，焊接按字节比较");
+
+void MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    if (vertices.empty() || indices.size() < 3) return;
+
+    size_t vertexCountBefore = vertices.size();
+    VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+
+    VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+    // 发布构建也要能核对优化效果；只在导入时执行，命中网格缓存时不输出
+    LOG_INFO("网格优化: 顶点 {} -> {}，ACMR {:.3f} -> {:.3f}，ATVR {:.3f} -> {:.3f}",
+             vertexCountBefore, vertices.size(), before.acmr, after.acmr, before.atvr, after.atvr);
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount) {
+    VertexCacheStats stats = {0.0f, 0.0f};
+    if (indices.empty() || vertexCount == 0) return stats;
+
+    // FIFO缓存：记录每个顶点进入缓存时的时间戳，时间差超过缓存大小即已被挤出
+    std::vector<unsigned int> timestamp(vertexCount, 0);
+    unsigned int time = ANALYZE_CACHE_SIZE + 1;
+    size_t misses = 0;
+    for (unsigned int index : indices) {
+        if (time - timestamp[index] > ANALYZE_CACHE_SIZE) {
+            timestamp[index] = time++;
+            misses++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(vertexCount);
+    return stats;
+}
+
+void MeshOptimizer::weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    std::unordered_map<Vertex, unsigned int, VertexBytesHash, VertexBytesEqual> unique;
+    unique.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        auto result = unique.emplace(vertices[i], static_cast<unsigned int>(welded.size()));
+        if (result.second) {
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = result.first->second;
+    }
+    for (unsigned int& index : indices) {
+        index = remap[index];
+    }
+    vertices.swap(welded);
+}
+
+// Forsyth顶点评分：缓存中越靠前、剩余三角形越少的顶点分数越高
+static float forsythVertexScore(int cachePosition, unsigned int liveTriangles) {
+    if (liveTriangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // 上一个三角形的三个顶点给固定分数，避免总是选相邻三角形形成长条
+            score = 0.75f;
+        } else {
+            float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+        }
+    }
+    // 剩余三角形少的顶点优先处理完，避免孤立三角形留到最后
+    score += 2.0f / std::sqrt(static_cast<float>(liveTriangles));
+    return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // 顶点到三角形的邻接表，紧凑存储；每个顶点的前liveTriangles项是还未输出的三角形
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (unsigned int index : indices) {
+        liveTriangles[index]++;
+    }
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    {
+        std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+            }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScore[v] = forsythVertexScore(-1, liveTriangles[v]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    std::vector<unsigned int> cache, newCache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+    size_t scanCursor = 0;
+    long long bestTriangle = -1;
+
+    while (result.size() < indices.size()) {
+        if (bestTriangle < 0) {
+            // 缓存里没有候选，顺序取下一个未输出的三角形
+            while (emitted[scanCursor]) scanCursor++;
+            bestTriangle = static_cast<long long>(scanCursor);
+        }
+
+        const unsigned int* triangle = &indices[static_cast<size_t>(bestTriangle) * 3];
+        emitted[bestTriangle] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        // 新三角形的顶点移到缓存最前面，其余顶点依次后移
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache.push_back(v);
+            }
+        }
+
+        // 从三个顶点的邻接表中移除这个三角形
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = triangle[k];
+            unsigned int* begin = &adjacency[adjacencyOffset[v]];
+            unsigned int* end = begin + liveTriangles[v];
+            unsigned int* found = std::find(begin, end, static_cast<unsigned int>(bestTriangle));
+            if (found != end) {
+                std::swap(*found, *(end - 1));
+                liveTriangles[v]--;
+            }
+        }
+
+        // 更新缓存位置和分数，被挤出缓存的顶点位置变为-1
+        for (size_t i = 0; i < newCache.size(); i++) {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+            float score = forsythVertexScore(cachePosition[v], liveTriangles[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            for (unsigned int j = 0; j < liveTriangles[v]; j++) {
+                triangleScore[adjacency[adjacencyOffset[v] + j]] += delta;
+            }
+        }
+        if (newCache.size() > FORSYTH_CACHE_SIZE) {
+            newCache.resize(FORSYTH_CACHE_SIZE);
+        }
+        cache.swap(newCache);
+
+        // 下一个三角形从缓存中顶点的相邻三角形里选分数最高的
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (unsigned int j = 0; j < liveTriangles[v]; j++) {
+                unsigned int t = adjacency[adjacencyOffset[v] + j];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2) return;
+
+    // 按缓存重启的位置分簇：三个顶点都未命中的三角形是簇的开始，簇内顺序保持不变，ACMR基本不受影响
+    std::vector<size_t> clusterStart;
+    {
+        std::vector<unsigned int> timestamp(vertices.size(), 0);
+        unsigned int time = ANALYZE_CACHE_SIZE + 1;
+        for (size_t t = 0; t < triangleCount; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                unsigned int index = indices[t * 3 + k];
+                if (time - timestamp[index] > ANALYZE_CACHE_SIZE) {
+                    timestamp[index] = time++;
+                    misses++;
+                }
+            }
+            if (t == 0 || misses == 3) {
+                clusterStart.push_back(t);
+            }
+        }
+    }
+    if (clusterStart.size() < 2) return;
+    clusterStart.push_back(triangleCount);
+    size_t clusterCount = clusterStart.size() - 1;
+
+    // 网格中心（按面积加权）
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+    std::vector<glm::vec3> clusterCenter(clusterCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+    std::vector<float> clusterArea(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; c++) {
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            const glm::vec3& p0 = vertices[indices[t * 3]].position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);   // 长度是面积的两倍
+            float area = glm::length(normal);
+            glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+            clusterCenter[c] += center * area;
+            clusterNormal[c] += normal;
+            clusterArea[c] += area;
+        }
+        meshCenter += clusterCenter[c];
+        meshArea += clusterArea[c];
+    }
+    if (meshArea > 0.0f) meshCenter /= meshArea;
+
+    // 排序键：簇中心相对网格中心的方向与簇法线的点积，越朝外越先画，可以遮住后面的簇
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        glm::vec3 center = clusterArea[c] > 0.0f ? clusterCenter[c] / clusterArea[c] : meshCenter;
+        float normalLength = glm::length(clusterNormal[c]);
+        glm::vec3 normal = normalLength > 0.0f ? clusterNormal[c] / normalLength : glm::vec3(0.0f);
+        sortKey[c] = glm::dot(center - meshCenter, normal);
+    }
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        result.insert(result.end(), indices.begin() + clusterStart[c] * 3, indices.begin() + clusterStart[c + 1] * 3);
+    }
+
+    // 簇边界处缓存状态不同，ACMR可能略微变差，超过阈值就保留原顺序
+    float acmrBefore = analyzeVertexCache(indices, vertices.size()).acmr;
+    float acmrAfter = analyzeVertexCache(result, vertices.size()).acmr;
+    if (acmrAfter <= acmrBefore * OVERDRAW_ACMR_THRESHOLD) {
+        indices.swap(result);
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    // 按索引中首次出现的顺序重新编号，没有被引用的顶点直接丢弃
+    const unsigned int unassigned = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unassigned);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int& index : indices) {
+        if (remap[index] == unassigned) {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
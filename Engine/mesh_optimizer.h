@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "model.h"
+
+// 顶点缓存命中统计
+struct VertexCacheStats {
+    float acmr;     // 每个三角形平均变换的顶点数（理想值约0.5，最差3）
+    float atvr;     // 变换次数与顶点数之比（理想值1）
+};
+
+// 导入后的网格优化，只重排数据，不改变渲染结果
+class MeshOptimizer {
+public:
+    // 依次执行焊接、顶点缓存重排、过度绘制重排和取数重排，并输出前后的ACMR/ATVR
+    static void optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+    // 用FIFO缓存模拟统计ACMR/ATVR
+    static VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount);
+
+    // 合并完全相同的顶点，重写索引
+    static void weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+    // 按Forsyth算法重排三角形，提高变换后缓存命中率
+    static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+    // 把缓存重排后的三角形分簇，朝外的簇先画以减少过度绘制，ACMR变差超过阈值时放弃
+    static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices);
+    // 按首次使用顺序重排顶点，提高顶点读取的内存局部性
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+};
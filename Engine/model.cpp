@@ -1,36 +1,120 @@
 #include "model.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "gl_state.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
 #include <iostream>
 #include <gtc/matrix_transform.hpp>
-#include <spdlog/spdlog.h>
-#include <stb_image.h>
+#include <gtc/packing.hpp>
 #include <fstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+
+// 是否允许网格使用压缩顶点格式（PackedVertex）
+#define ENABLE_PACKED_VERTICES 1
+// 位置量化允许的最大误差（模型空间单位），包围盒太大导致误差超出时该网格保留浮点格式
+#define MAX_POSITION_QUANTIZATION_ERROR 0.0005f
+// 压缩格式允许的UV范围，半精度在[-8, 8]内的精度约为1/256
+#define MAX_PACKED_TEXCOORD 8.0f
+
+// 导入后是否运行网格优化（焊接、缓存/过度绘制/取数重排），结果写入网格缓存
+#define ENABLE_MESH_OPTIMIZER 1
+
+// 网格是否放进共享的几何池（需要glDrawElementsBaseVertex，GL 3.2）
+#define ENABLE_GEOMETRY_POOL 1
+
+// Assimp导入标志，也是网格缓存键的一部分
+static const unsigned int kImportFlags =
+    aiProcess_Triangulate |
+    aiProcess_GenNormals |
+    aiProcess_FlipUVs;
+
 // 模型构造函数
 Model::Model(const char* path) {
     loadModel(path);
 }
 
+Model::~Model() {
+    for (auto& mesh : meshes) {
+        mesh.release();
+    }
+}
+
 // 绘制模型
-void Model::draw(Shader& shader, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection) {
+void Model::draw(Shader& shader, const glm::mat4& modelMatrix) {
     for (auto& mesh : meshes) {
-        mesh.draw(shader, modelMatrix, view, projection);
+        mesh.draw(shader, modelMatrix);
     }
 }
 
 // 加载模型
 void Model::loadModel(const std::string& path) {
+    directory = path.substr(0, path.find_last_of('/'));
+
+    // 源文件（含材质文件）哈希和导入标志都匹配时直接使用缓存
+    bool hashed = MeshCache::hashSource(path, sourceHash);
+    std::string cachePath = MeshCache::cachePathFor(path);
+    if (hashed && loadFromCache(cachePath, sourceHash)) {
+        LOG_INFO("从网格缓存加载模型: {}，共 {} 个网格", cachePath, meshes.size());
+        return;
+    }
+
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, 
-        aiProcess_Triangulate | 
-        aiProcess_GenNormals | 
-        aiProcess_FlipUVs);
+    const aiScene* scene = importer.ReadFile(path, kImportFlags);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-        spdlog::error("Assimp加载模型失败: {}", importer.GetErrorString());
+        LOG_ERROR("Assimp加载模型失败: {}", importer.GetErrorString());
         return;
     }
     
-    directory = path.substr(0, path.find_last_of('/'));
     processNode(scene->mRootNode, scene);
+
+    // 写入缓存，下次启动跳过Assimp
+    if (hashed && MeshCache::write(cachePath, sourceHash, kImportFlags, meshes)) {
+        LOG_INFO("网格缓存已写入: {}", cachePath);
+    }
+}
+
+// 从网格缓存加载，顶点和索引直接从映射内存上传
+bool Model::loadFromCache(const std::string& cachePath, uint64_t expectedHash) {
+    MeshCacheReader reader;
+    if (!reader.open(cachePath, expectedHash, kImportFlags)) {
+        return false;
+    }
+
+    const std::vector<CachedMesh>& cachedMeshes = reader.getMeshes();
+    // 缓存保存的是写入时选好的顶点格式，关闭压缩格式后需要重新导入
+    for (const CachedMesh& cached : cachedMeshes) {
+        if (!ENABLE_PACKED_VERTICES && cached.gpu.vertexFormat == VertexFormat::Packed) {
+            LOG_INFO("网格缓存使用了压缩顶点格式，重新导入: {}", cachePath);
+            return false;
+        }
+    }
+    meshes.reserve(cachedMeshes.size());
+    for (const CachedMesh& cached : cachedMeshes) {
+        meshes.emplace_back();
+        Mesh& mesh = meshes.back();
+        mesh.material = cached.material;
+
+        // 重新创建纹理对象
+        Texture* textures[] = {
+            &mesh.material.albedoMap, &mesh.material.normalMap, &mesh.material.heightMap,
+            &mesh.material.roughnessMap, &mesh.material.metallicMap, &mesh.material.aoMap,
+            &mesh.material.emissionMap,
+        };
+        for (Texture* texture : textures) {
+            if (!texture->path.empty()) {
+                *texture = loadTexture(texture->path, texture->type);
+            }
+        }
+
+        mesh.setupMesh(cached.gpu);
+    }
+    return true;
 }
 
 // 处理节点
@@ -51,9 +135,11 @@ void Model::processNode(aiNode* node, const aiScene* scene) {
 Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
     Mesh result;
 
-    // 处理顶点数据
+    // 处理顶点数据，一次分配好再逐个填充
+    result.vertices.resize(mesh->mNumVertices);
+    bool hasTexCoords = mesh->mTextureCoords[0] != nullptr;
     for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-        Vertex vertex;
+        Vertex& vertex = result.vertices[i];
         vertex.position.x = mesh->mVertices[i].x;
         vertex.position.y = mesh->mVertices[i].y;
         vertex.position.z = mesh->mVertices[i].z;
@@ -64,37 +150,42 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
             vertex.normal.z = mesh->mNormals[i].z;
         }
 
-        if (mesh->mTextureCoords[0]) {
+        if (hasTexCoords) {
             vertex.texCoords.x = mesh->mTextureCoords[0][i].x;
             vertex.texCoords.y = mesh->mTextureCoords[0][i].y;
         } else {
             vertex.texCoords = glm::vec2(0.0f, 0.0f);
         }
-        result.vertices.push_back(vertex);
     }
-    spdlog::info("处理顶点数据完成，共 {} 个顶点", mesh->mNumVertices);
+    LOG_DEBUG("处理顶点数据完成，共 {} 个顶点", mesh->mNumVertices);
     if (!result.vertices.empty()) {
-        spdlog::debug("第一个顶点位置: ({}, {}, {})", 
+        LOG_DEBUG("第一个顶点位置: ({}, {}, {})", 
             result.vertices[0].position.x,
             result.vertices[0].position.y,
             result.vertices[0].position.z);
     }
 
-    // 处理索引数据
+    // 处理索引数据，三角化后每个面3个索引
+    result.indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
     for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++) {
             result.indices.push_back(face.mIndices[j]);
         }
     }
-    spdlog::info("处理索引数据完成，共 {} 个三角形", mesh->mNumFaces);
+    LOG_DEBUG("处理索引数据完成，共 {} 个三角形", mesh->mNumFaces);
     if (!result.indices.empty()) {
-        spdlog::debug("第一个三角形索引: {}, {}, {}",
+        LOG_DEBUG("第一个三角形索引: {}, {}, {}",
             result.indices[0],
             result.indices[1],
             result.indices[2]);
     }
 
+    // 优化顶点和三角形顺序，OBJ导入的顶点大量重复
+    if (ENABLE_MESH_OPTIMIZER) {
+        MeshOptimizer::optimize(result.vertices, result.indices);
+    }
+
     // 处理材质
     if (mesh->mMaterialIndex >= 0) {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
@@ -105,34 +196,14 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
     return result;
 }
 
-// 从文件加载纹理
-unsigned int Model::TextureFromFile(const char* path, const std::string& directory) {
-    std::string filename = directory + '/' + std::string(path);
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format = (nrComponents == 1) ? GL_RED : 
-                       (nrComponents == 3) ? GL_RGB : GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    } else {
-        spdlog::error("Texture failed to load at path: {}", path);
-        stbi_image_free(data);
-    }
-    spdlog::info("Texture loaded at path: {}", path);
-    return textureID;
+// 加载单个纹理
+// 去重由ResourceManager在所有模型之间完成，解码和上传由TextureLoader异步进行，这里立即返回占位纹理
+Texture Model::loadTexture(const std::string& path, const std::string& typeName) {
+    Texture texture;
+    texture.handle = ResourceManager::get().acquireTexture(directory + '/' + path, typeName == "normal");
+    texture.type = typeName;
+    texture.path = path;
+    return texture;
 }
 
 // 加载材质纹理
@@ -141,23 +212,7 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
         aiString str;
         mat->GetTexture(type, i, &str);
-
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
-                break;
-            }
-        }
-        if (!skip) {
-            Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture);
-        }
+        textures.push_back(loadTexture(str.C_Str(), typeName));
     }
     return textures;
 }
@@ -201,87 +256,297 @@ PBR_Material Model::loadMaterial(aiMaterial* mat) {
     return material;
 }
 
-// 设置网格
-void Mesh::setupMesh() {
-    // 生成VAO和缓冲区
-    glGenVertexArrays(1, &VAO);
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        spdlog::error("setupMesh - OpenGL错误(生成VAO): {:#x}", error);
-        return;
+// 八面体编码：单位向量投影到八面体上再展开到[-1, 1]^2
+static glm::vec2 octEncode(const glm::vec3& n) {
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.0f) {
+        return glm::vec2(0.0f);   // 没有法线的顶点，解码为(0, 0, 1)
+    }
+    glm::vec2 p = glm::vec2(n.x, n.y) / sum;
+    if (n.z < 0.0f) {
+        // 下半球沿对角线折到外侧
+        glm::vec2 folded(1.0f - std::abs(p.y), 1.0f - std::abs(p.x));
+        p.x = p.x >= 0.0f ? folded.x : -folded.x;
+        p.y = p.y >= 0.0f ? folded.y : -folded.y;
+    }
+    return p;
+}
+
+// 把浮点顶点转换成压缩顶点，center/halfExtent为包围盒中心和半边长
+static void packVertices(const Vertex* vertexData, size_t vertexCount,
+                         const glm::vec3& center, const glm::vec3& halfExtent,
+                         std::vector<PackedVertex>& packed) {
+    packed.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        const Vertex& in = vertexData[i];
+        PackedVertex& out = packed[i];
+        glm::vec3 local = (in.position - center) / halfExtent;
+        for (int c = 0; c < 3; c++) {
+            out.position[c] = static_cast<int16_t>(glm::packSnorm1x16(local[c]));
+        }
+        out.position[3] = 0;
+        glm::vec2 oct = octEncode(in.normal);
+        out.normal[0] = static_cast<int16_t>(glm::packSnorm1x16(oct.x));
+        out.normal[1] = static_cast<int16_t>(glm::packSnorm1x16(oct.y));
+        out.texCoords[0] = glm::packHalf1x16(in.texCoords.x);
+        out.texCoords[1] = glm::packHalf1x16(in.texCoords.y);
+    }
+}
+
+// 从显存格式的顶点中抽出位置流，每个顶点取开头的positionStride字节
+static void extractPositions(const void* vertexBytes, VertexFormat format, size_t vertexCount,
+                             std::vector<uint8_t>& positions) {
+    GLsizei stride = Mesh::vertexStride(format);
+    GLsizei positionStride = Mesh::positionStride(format);
+    positions.resize(vertexCount * positionStride);
+    const uint8_t* source = static_cast<const uint8_t*>(vertexBytes);
+    for (size_t i = 0; i < vertexCount; i++) {
+        std::memcpy(&positions[i * positionStride], source + i * stride, positionStride);
+    }
+}
+
+// 判断网格能否使用压缩格式
+bool Mesh::canPackVertices(const Vertex* vertexData, size_t vertexCount,
+                           const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    // 16位snorm把半边长分成32767份，最大误差是半个量化步长
+    glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+    float maxHalfExtent = std::max(halfExtent.x, std::max(halfExtent.y, halfExtent.z));
+    if (maxHalfExtent / 32767.0f * 0.5f > MAX_POSITION_QUANTIZATION_ERROR) {
+        return false;
+    }
+    for (size_t i = 0; i < vertexCount; i++) {
+        const glm::vec2& uv = vertexData[i].texCoords;
+        if (std::abs(uv.x) > MAX_PACKED_TEXCOORD || std::abs(uv.y) > MAX_PACKED_TEXCOORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 设置网格
+void Mesh::setupMesh() {
+    MeshGpuStorage storage;
+    setupMesh(prepareGpuData(vertices.data(), vertices.size(), indices.data(), indices.size(), storage));
+}
+
+// 把浮点顶点和32位索引转换成显存格式，只在导入时执行，网格缓存保存的是转换后的结果
+MeshGpuData Mesh::prepareGpuData(const Vertex* vertexData, size_t vertexCount,
+                                 const unsigned int* indexData, size_t indexCount,
+                                 MeshGpuStorage& storage) {
+    MeshGpuData data;
+    if (vertexCount == 0 || indexCount == 0) return data;
+    data.vertexCount = static_cast<uint32_t>(vertexCount);
+    data.indexCount = static_cast<uint32_t>(indexCount);
+
+    // 计算包围盒，压缩格式的量化和后续的剔除都要用到
+    data.boundsMin = data.boundsMax = vertexData[0].position;
+    for (size_t i = 1; i < vertexCount; i++) {
+        data.boundsMin = glm::min(data.boundsMin, vertexData[i].position);
+        data.boundsMax = glm::max(data.boundsMax, vertexData[i].position);
+    }
+
+    data.vertexFormat = (ENABLE_PACKED_VERTICES && canPackVertices(vertexData, vertexCount, data.boundsMin, data.boundsMax))
+        ? VertexFormat::Packed : VertexFormat::Float;
+
+    // 准备显存中的顶点数据，量化参数与Mesh::positionScale/positionBias一致
+    data.vertices = vertexData;
+    if (data.vertexFormat == VertexFormat::Packed) {
+        glm::vec3 center = (data.boundsMax + data.boundsMin) * 0.5f;
+        glm::vec3 halfExtent = glm::max((data.boundsMax - data.boundsMin) * 0.5f, glm::vec3(1e-6f));
+        packVertices(vertexData, vertexCount, center, halfExtent, storage.packedVertices);
+        data.vertices = storage.packedVertices.data();
+    }
+    // 深度通道只读位置，单独一份紧凑的位置流可以少取一半以上的顶点数据
+    extractPositions(data.vertices, data.vertexFormat, vertexCount, storage.positions);
+    data.positions = storage.positions.data();
+
+    // 顶点少于65536个时使用16位索引
+    data.indices = indexData;
+    if (vertexCount < 65536) {
+        storage.shortIndices.assign(indexData, indexData + indexCount);
+        data.indices = storage.shortIndices.data();
+        data.indexType = GL_UNSIGNED_SHORT;
+    } else {
+        data.indexType = GL_UNSIGNED_INT;
+    }
+    return data;
+}
+
+// 上传显存格式的网格数据，可以来自prepareGpuData，也可以直接是网格缓存的映射
+void Mesh::setupMesh(const MeshGpuData& data) {
+    // 检查顶点数据和索引数据是否为空
+    if (data.vertexCount == 0 || data.indexCount == 0) {
+        LOG_ERROR("setupMesh - 顶点数据或索引数据为空");
+        return;
+    }
+
+    // 贴图开关和着色器特性在加载时确定一次
+    setupMaterial();
+
+    boundsMin = data.boundsMin;
+    boundsMax = data.boundsMax;
+    vertexFormat = data.vertexFormat;
+    indexType = data.indexType;
+    size_t vertexCount = data.vertexCount;
+    size_t indexCount = data.indexCount;
+    const void* vertexBytes = data.vertices;
+    const void* indexBytes = data.indices;
+    GLsizeiptr vertexSize = vertexCount * vertexStride(vertexFormat);
+    GLsizeiptr positionSize = vertexCount * positionStride(vertexFormat);
+    GLsizeiptr indexSize = indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int));
+
+    // 优先放进几何池，和其他网格共用VAO/VBO/EBO
+    if (ENABLE_GEOMETRY_POOL) {
+        geometry = GeometryPool::get().allocate(vertexFormat, indexType,
+                                                vertexBytes, data.positions, static_cast<uint32_t>(vertexCount),
+                                                indexBytes, static_cast<uint32_t>(indexCount));
+        if (geometry.block) {
+            VAO = geometry.block->vertexArray;
+            VBO = geometry.block->vertexBuffer;
+            EBO = geometry.block->indexBuffer;
+            positionVBO = geometry.block->positionBuffer;
+            depthVAO = geometry.block->depthVertexArray;
+            this->indexCount = static_cast<GLsizei>(indexCount);
+            LOG_DEBUG("setupMesh - 网格放入几何池，baseVertex {}，firstIndex {}，{}格式",
+                geometry.baseVertex, geometry.firstIndex, vertexFormat == VertexFormat::Packed ? "压缩" : "浮点");
+            return;
+        }
+        LOG_WARN("setupMesh - 几何池分配失败，使用独立缓冲");
     }
 
+    // 生成VAO和缓冲区
+    glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        spdlog::error("setupMesh - OpenGL错误(生成缓冲区): {:#x}", error);
-        return;
-    }
+    glGenBuffers(1, &positionVBO);
 
     // 检查VAO是否有效
     if (VAO == 0) {
-        spdlog::error("setupMesh - VAO生成失败");
+        LOG_ERROR("setupMesh - VAO生成失败");
         return;
     }
 
     // 检查VBO和EBO是否有效
-    if (VBO == 0 || EBO == 0) {
-        spdlog::error("setupMesh - VBO或EBO生成失败");
-        return;
-    }
-
-    // 检查顶点数据和索引数据是否为空
-    if (vertices.empty() || indices.empty()) {
-        spdlog::error("setupMesh - 顶点数据或索引数据为空");
+    if (VBO == 0 || EBO == 0 || positionVBO == 0) {
+        LOG_ERROR("setupMesh - VBO或EBO生成失败");
         return;
     }
 
     // 绑定VAO
-    glBindVertexArray(VAO);
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        spdlog::error("setupMesh - OpenGL错误(绑定VAO): {:#x}", error);
-        return;
-    }
-    
+    GLStateTracker::get().bindVertexArray(VAO);
+
     // 设置顶点缓冲区
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        spdlog::error("setupMesh - OpenGL错误(设置顶点缓冲区): {:#x}", error);
-        return;
-    }
+    glBufferData(GL_ARRAY_BUFFER, vertexSize, vertexBytes, GL_STATIC_DRAW);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, VBO, vertexSize);
 
     // 设置索引缓冲区
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        spdlog::error("setupMesh - OpenGL错误(设置索引缓冲区): {:#x}", error);
-        return;
-    }
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, indexBytes, GL_STATIC_DRAW);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, EBO, indexSize);
 
     // 设置顶点属性
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    setupVertexAttributes(vertexFormat);
+
+    // 位置流和只读它的VAO，共用同一个EBO
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positionSize, data.positions, GL_STATIC_DRAW);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, positionVBO, positionSize);
+    depthVAO = createDepthVertexArray();
+    GL_CHECK_ERRORS("Mesh::setupMesh");
+
+    // 对象绑定过之后才能命名
+    GLDebug& debug = GLDebug::get();
+    debug.label(GL_VERTEX_ARRAY, VAO, "Mesh VAO");
+    debug.label(GL_BUFFER, VBO, "Mesh vertices");
+    debug.label(GL_BUFFER, EBO, "Mesh indices");
+    debug.label(GL_VERTEX_ARRAY, depthVAO, "Mesh depth VAO");
+    debug.label(GL_BUFFER, positionVBO, "Mesh positions");
+
+    // 解绑VAO，避免后续的缓冲绑定改到这个VAO上
+    GLStateTracker::get().bindVertexArray(0);
+    this->indexCount = static_cast<GLsizei>(indexCount);
+    LOG_DEBUG("setupMesh - 成功设置网格数据，VAO ID: {}，{}格式，顶点 {} 字节",
+        VAO, vertexFormat == VertexFormat::Packed ? "压缩" : "浮点", vertexSize);
+}
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+// 删除网格的GL缓冲，池中的网格只归还空间
+void Mesh::release() {
+    if (geometry.block) {
+        GeometryPool::get().free(geometry);
+    } else {
+        for (GLuint* vertexArray : {&VAO, &depthVAO}) {
+            if (*vertexArray == 0) continue;
+            GLStateTracker::get().forgetVertexArray(*vertexArray);
+            glDeleteVertexArrays(1, vertexArray);
+        }
+        for (GLuint* buffer : {&VBO, &EBO, &positionVBO}) {
+            if (*buffer == 0) continue;
+            RenderStats::get().releaseMemory(RenderMemory::Buffers, *buffer);
+            glDeleteBuffers(1, buffer);
+        }
+    }
+    VAO = VBO = EBO = 0;
+    positionVBO = depthVAO = 0;
+    indexCount = 0;
+    materialUBO.release();
+}
+
+GLsizei Mesh::vertexStride(VertexFormat format) {
+    return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+GLsizei Mesh::positionStride(VertexFormat format) {
+    return format == VertexFormat::Packed ? sizeof(PackedVertex::position) : sizeof(glm::vec3);
+}
 
+// 为当前绑定的VAO设置顶点属性0~2，VBO需要已绑定到GL_ARRAY_BUFFER
+void Mesh::setupVertexAttributes(VertexFormat format) {
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    if (format == VertexFormat::Packed) {
+        // snorm由硬件归一化到[-1, 1]，着色器中再做缩放和八面体解码
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texCoords));
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+    }
+}
 
-    error = glGetError();
-    if (error != GL_NO_ERROR) {
-        spdlog::error("setupMesh - OpenGL错误(设置顶点属性): {:#x}", error);
-        return;
+// 为当前绑定的VAO设置位置流的属性0，格式与setupVertexAttributes中的位置一致
+void Mesh::setupPositionAttribute(VertexFormat format) {
+    glEnableVertexAttribArray(0);
+    if (format == VertexFormat::Packed) {
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, positionStride(format), (void*)0);
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, positionStride(format), (void*)0);
     }
+}
+
+// 创建一个共享本网格VBO/EBO的新VAO，返回时VAO仍处于绑定状态，调用方可以继续添加属性
+GLuint Mesh::createVertexArray() const {
+    GLuint vertexArray = 0;
+    glGenVertexArrays(1, &vertexArray);
+    GLStateTracker::get().bindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    setupVertexAttributes(vertexFormat);
+    return vertexArray;
+}
 
-    // 解绑VAO
-    glBindVertexArray(0);
-    spdlog::debug("setupMesh - 成功设置网格数据，VAO ID: {}", VAO);
+// 创建一个只读位置流的新VAO，返回时VAO仍处于绑定状态
+GLuint Mesh::createDepthVertexArray() const {
+    GLuint vertexArray = 0;
+    glGenVertexArrays(1, &vertexArray);
+    GLStateTracker::get().bindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    setupPositionAttribute(vertexFormat);
+    return vertexArray;
 }
 
 // 设置纹理
@@ -290,7 +555,7 @@ void Mesh::setupTextures(Shader& shader) {
 }
 
 
-//根据纹理是否存在设置材质
+//根据纹理是否存在设置材质，同时得到选择着色器变体的特性位
 void Mesh::setupMaterial()
 {
     material.useAlbedoMap = false;
@@ -300,111 +565,161 @@ void Mesh::setupMaterial()
     material.useAOMap = false;
     material.useEmissionMap = false;
 
-    if(material.albedoMap.id != 0){
+    if(material.albedoMap.id() != 0){
         material.useAlbedoMap = true;
     }
-    if(material.normalMap.id!= 0){
+    if(material.normalMap.id()!= 0){
         material.useNormalMap = true; 
     }
-    if(material.metallicMap.id!= 0){
+    if(material.metallicMap.id()!= 0){
         material.useMetallicMap = true; 
     }
-    if(material.roughnessMap.id!= 0){
+    if(material.roughnessMap.id()!= 0){
         material.useRoughnessMap = true; 
     }
-    if(material.aoMap.id!= 0){
+    if(material.aoMap.id()!= 0){
        material.useAOMap = true; 
     }
-    if(material.emissionMap.id!= 0){
+    if(material.emissionMap.id()!= 0){
         material.useEmissionMap = true; 
     }
+
+    shaderFeatures = (material.useAlbedoMap ? SHADER_FEATURE_ALBEDO_MAP : 0u) |
+                     (material.useNormalMap ? SHADER_FEATURE_NORMAL_MAP : 0u) |
+                     (material.useMetallicMap ? SHADER_FEATURE_METALLIC_MAP : 0u) |
+                     (material.useRoughnessMap ? SHADER_FEATURE_ROUGHNESS_MAP : 0u) |
+                     (material.useAOMap ? SHADER_FEATURE_AO_MAP : 0u) |
+                     (material.useEmissionMap ? SHADER_FEATURE_EMISSION_MAP : 0u);
+    // 特性变了需要重新选择变体
+    for (Shader*& shader : shaders) {
+        shader = nullptr;
+    }
+}
+
+// 从变体表中选出与材质匹配的着色器，已经选过时直接返回
+void Mesh::selectShader(ShaderVariants& variants) {
+    Shader*& shader = shaders[static_cast<int>(variants.pass())];
+    if (!shader) {
+        shader = variants.get(shaderFeatures);
+    }
+}
+
+// 上传材质uniform缓冲，只在材质改变时调用
+void Mesh::uploadMaterial() {
+    MaterialBlock block;
+    block.albedoColor = glm::vec4(material.basecolor, 1.0f);
+    block.emissionColor = glm::vec4(material.emissionColor, 1.0f);
+    block.metallic = material.metallic;
+    block.roughness = material.roughness;
+    block.ao = material.ao;
+    materialUBO.update(&block, sizeof(block));
+
+    materialDirty = false;
 }
 
 // 绘制网格
-void Mesh::draw(Shader& shader, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection) {
+void Mesh::draw(Shader& shader, const glm::mat4& modelMatrix) {
+    if (!beginDraw(shader, DRAW_MODE_SINGLE)) {
+        return;
+    }
+    // 设置模型矩阵，位置在链接时已经解析好
+    shader.setMat4(shader.location(ShaderUniform::Model), modelMatrix);
+
+    LOG_TRACE("Mesh::draw - VAO ID: {}, 索引数量: {}", VAO, indexCount);
+    
+    // 绘制网格，VAO保持绑定，下一个相同VAO的绘制可以跳过绑定
+    // 池中的网格共用块的VAO，用baseVertex和索引偏移定位自己的数据
+    GLStateTracker::get().bindVertexArray(VAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), geometry.baseVertex);
+    RenderStats::get().addDraw(indexCount);
+}
+
+// 实例化绘制，vertexArray是带实例矩阵属性的VAO（见createVertexArray），模型矩阵来自实例缓冲
+void Mesh::drawInstanced(Shader& shader, GLuint vertexArray, GLsizei instanceCount) {
+    if (instanceCount <= 0 || !beginDraw(shader, DRAW_MODE_INSTANCED)) {
+        return;
+    }
+
+    GLStateTracker::get().bindVertexArray(vertexArray);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), instanceCount,
+                                      geometry.baseVertex);
+    RenderStats::get().addDraw(indexCount, instanceCount);
+}
+
+// 只写深度的绘制，着色器由调用方启用，池中的网格共用块的深度VAO
+void Mesh::drawDepth(Shader& shader, const glm::mat4& modelMatrix) {
+    if (depthVAO == 0) return;
+    shader.setInt(shader.location(ShaderUniform::DrawMode), DRAW_MODE_SINGLE);
+    shader.setMat4(shader.location(ShaderUniform::Model), modelMatrix);
+    setPositionDecode(shader);
+    GLStateTracker::get().bindVertexArray(depthVAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), geometry.baseVertex);
+    RenderStats::get().addDraw(indexCount);
+}
+
+// 只写深度的实例化绘制，vertexArray来自createDepthVertexArray并带实例矩阵属性
+void Mesh::drawDepthInstanced(Shader& shader, GLuint vertexArray, GLsizei instanceCount) {
+    if (instanceCount <= 0) return;
+    shader.setInt(shader.location(ShaderUniform::DrawMode), DRAW_MODE_INSTANCED);
+    setPositionDecode(shader);
+    GLStateTracker::get().bindVertexArray(vertexArray);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, indexOffset(), instanceCount,
+                                      geometry.baseVertex);
+    RenderStats::get().addDraw(indexCount, instanceCount);
+}
+
+// 顶点解码参数，浮点格式下为恒等变换
+void Mesh::setPositionDecode(Shader& shader) const {
+    bool packed = vertexFormat == VertexFormat::Packed;
+    shader.setVec3(shader.location(ShaderUniform::PositionScale), packed ? positionScale() : glm::vec3(1.0f));
+    shader.setVec3(shader.location(ShaderUniform::PositionBias), packed ? positionBias() : glm::vec3(0.0f));
+    shader.setInt(shader.location(ShaderUniform::OctNormals), packed ? 1 : 0);
+}
+
+// 绘制前的公共设置：着色器、顶点解码参数、材质和贴图
+bool Mesh::beginDraw(Shader& shader, DrawMode mode) {
     // 检查VAO是否有效
     if (VAO == 0) {
-        spdlog::error("Mesh::draw - 无效的VAO");
-        return;
+        LOG_ERROR("Mesh::draw - 无效的VAO");
+        return false;
     }
 
     // 检查着色器程序是否有效
     if (shader.ID == 0) {
-        spdlog::error("Mesh::draw - 无效的着色器程序ID");
-        return;
-    }else{
-        spdlog::debug("Mesh::draw - 使用着色器程序 ID: {}", shader.ID);
+        LOG_ERROR("Mesh::draw - 无效的着色器程序ID");
+        return false;
     }
+    LOG_TRACE("Mesh::draw - 使用着色器程序 ID: {}", shader.ID);
 
-    // 清除之前的OpenGL错误
-    while (glGetError() != GL_NO_ERROR) {}
     //使用着色器
     shader.use();
+    shader.setInt(shader.location(ShaderUniform::DrawMode), mode);
+
+    setPositionDecode(shader);
     
-    // 设置模型矩阵 - 这是关键的缺失部分！
-    shader.setMat4("model", modelMatrix);
-    
-    // 设置视图和投影矩阵
-    shader.setMat4("view", view);
-    shader.setMat4("projection", projection);
-    
-    // 设置材质
-    setupMaterial();
-    // 设置基础PBR材质参数
-    shader.setVec3("material.basecolor", material.basecolor);
-    shader.setFloat("material.metallic", material.metallic);
-    shader.setFloat("material.roughness", material.roughness);
-
-    // 设置贴图使用状态
-    shader.setBool("material.useAlbedoMap", material.useAlbedoMap);
-    shader.setBool("material.useNormalMap", material.useNormalMap);
-    shader.setBool("material.useMetallicMap", material.useMetallicMap);
-    shader.setBool("material.useRoughnessMap", material.useRoughnessMap);
-    shader.setBool("material.useAOMap", material.useAOMap);
-    shader.setBool("material.useEmissionMap", material.useEmissionMap);
-
-    // 绑定贴图
-    if (material.useAlbedoMap) {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, material.albedoMap.id);
-        shader.setInt("material.albedoMap", 0);
-    }
-    if (material.useNormalMap) {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, material.normalMap.id);
-        shader.setInt("material.normalMap", 1);
-    }
-    if (material.useMetallicMap) {
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, material.metallicMap.id);
-        shader.setInt("material.metallicMap", 2);
-    }
-    if (material.useRoughnessMap) {
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, material.roughnessMap.id);
-        shader.setInt("material.roughnessMap", 3);
-    }
-    if (material.useAOMap) {
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, material.aoMap.id);
-        shader.setInt("material.aoMap", 4);
-    }
-    if (material.useEmissionMap) {
-        glActiveTexture(GL_TEXTURE5);
-        glBindTexture(GL_TEXTURE_2D, material.emissionMap.id);
-        shader.setInt("material.emissionMap", 5);
-    }
-    
-    spdlog::debug("Mesh::draw - VAO ID: {}, 索引数量: {}", VAO, indices.size());
-    
-    // 绘制网格
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-
-    // 解绑所有贴图
-    for (unsigned int i = 0; i < 6; i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // 材质参数在uniform缓冲中，只有修改后才重新上传
+    syncMaterial();
+    materialUBO.bindBase(MATERIAL_BLOCK_BINDING);
+
+    bindTextures();
+    return true;
+}
+
+// 绑定贴图，纹理单元在着色器链接时已经设置
+// 未启用的槽位不解绑，对应的着色器变体不会采样它
+void Mesh::bindTextures() const {
+    GLStateTracker& state = GLStateTracker::get();
+    if (material.useAlbedoMap) state.bindTexture(ALBEDO_TEXTURE_UNIT, GL_TEXTURE_2D, material.albedoMap.id());
+    if (material.useNormalMap) state.bindTexture(NORMAL_TEXTURE_UNIT, GL_TEXTURE_2D, material.normalMap.id());
+    if (material.useMetallicMap) state.bindTexture(METALLIC_TEXTURE_UNIT, GL_TEXTURE_2D, material.metallicMap.id());
+    if (material.useRoughnessMap) state.bindTexture(ROUGHNESS_TEXTURE_UNIT, GL_TEXTURE_2D, material.roughnessMap.id());
+    if (material.useAOMap) state.bindTexture(AO_TEXTURE_UNIT, GL_TEXTURE_2D, material.aoMap.id());
+    if (material.useEmissionMap) state.bindTexture(EMISSION_TEXTURE_UNIT, GL_TEXTURE_2D, material.emissionMap.id());
+}
+
+// 材质修改过时重新上传uniform缓冲
+void Mesh::syncMaterial() {
+    if (materialDirty) {
+        uploadMaterial();
     }
 }
\ No newline at end of file
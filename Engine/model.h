@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <glm.hpp>
@@ -6,6 +7,9 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "shader.h"
+#include "uniform_buffer.h"
+#include "resource_manager.h"
+#include "geometry_pool.h"
 
 // 顶点结构体，包含位置、法线和纹理坐标
 struct Vertex {
@@ -14,11 +18,52 @@ struct Vertex {
     glm::vec2 texCoords;
 };
 
+// 压缩顶点，16字节（Vertex为32字节）
+// 位置：相对网格包围盒量化为16位snorm，着色器中用positionScale/positionBias还原
+// 法线：八面体编码，2个16位snorm
+// 纹理坐标：半精度浮点
+struct PackedVertex {
+    int16_t position[4];     // xyz，w为填充保证4字节对齐
+    int16_t normal[2];
+    uint16_t texCoords[2];
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex必须是16字节");
+
+// 网格在显存中的顶点格式，由setupMesh按网格选择
+enum class VertexFormat {
+    Float,      // Vertex
+    Packed,     // PackedVertex
+};
+
+// 可以直接上传到显存的网格数据，指针指向MeshGpuStorage或网格缓存的映射内存
+struct MeshGpuData {
+    VertexFormat vertexFormat = VertexFormat::Float;
+    GLenum indexType = GL_UNSIGNED_INT;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    glm::vec3 boundsMin{0.0f};          // 模型空间包围盒，压缩格式按它量化
+    glm::vec3 boundsMax{0.0f};
+    const void* vertices = nullptr;     // vertexCount个vertexStride字节的顶点
+    const void* positions = nullptr;    // vertexCount个positionStride字节的位置
+    const void* indices = nullptr;      // indexCount个2或4字节的索引
+};
+
+// prepareGpuData转换出的数组，MeshGpuData引用期间需要保持有效
+struct MeshGpuStorage {
+    std::vector<PackedVertex> packedVertices;
+    std::vector<uint8_t> positions;
+    std::vector<uint16_t> shortIndices;
+};
+
 // 纹理结构体，包含纹理ID、类型和路径
+// handle持有GL纹理的引用，最后一个引用释放时纹理被删除；解码后与内容相同的纹理合并时
+// handle->id会改变，所以绑定时总是通过句柄读取
 struct Texture {
-    unsigned int id;
     std::string type;
     std::string path;
+    TextureHandle handle;
+
+    GLuint id() const { return handle ? handle->id : 0; }
 };
 
 // 材质结构体，包含环境光、漫反射、镜面反射等属性
@@ -50,33 +95,85 @@ struct Mesh {
     std::vector<Vertex> vertices;        // 顶点数组
     std::vector<unsigned int> indices;   // 索引数组
     PBR_Material material;                   // 材质
-    GLuint VAO, VBO, EBO;               // OpenGL缓冲对象
+    GLuint VAO = 0, VBO = 0, EBO = 0;   // OpenGL缓冲对象，池中的网格指向所在块的共享对象
+    GLuint positionVBO = 0, depthVAO = 0;  // 只有位置的顶点流和只读它的VAO，用于阴影等深度通道
+    GeometryAllocation geometry;        // 在几何池中的位置，block为空时缓冲归网格所有
+    GLsizei indexCount = 0;             // 索引数量（从缓存加载时CPU端数组为空）
+    GLenum indexType = GL_UNSIGNED_INT; // 显存中的索引类型，顶点少于65536个时为GL_UNSIGNED_SHORT
+    VertexFormat vertexFormat = VertexFormat::Float;  // 显存中的顶点格式
+    glm::vec3 boundsMin{0.0f};          // 模型空间包围盒
+    glm::vec3 boundsMax{0.0f};
+    UniformBuffer materialUBO;          // 材质uniform缓冲
+    uint32_t shaderFeatures = 0;        // 材质用到的贴图（ShaderFeature位），setupMaterial时确定
+    Shader* shaders[static_cast<int>(ShaderPass::Count)] = {};  // 每个通道按shaderFeatures选出的变体，由selectShader设置
+    bool materialDirty = true;          // 材质参数修改后置为true，下次绘制时重新上传
 
     void setupMesh();                    // 设置网格数据
-    void draw(Shader& shader, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection);           // 绘制网格
+    void setupMesh(const MeshGpuData& data);  // 上传已经是显存格式的数据（来自prepareGpuData或网格缓存）
+    // 选择顶点格式，压缩顶点、抽出位置流并按需缩小索引，结果可以直接上传或写入网格缓存
+    static MeshGpuData prepareGpuData(const Vertex* vertexData, size_t vertexCount,
+                                      const unsigned int* indexData, size_t indexCount,
+                                      MeshGpuStorage& storage);
+    void draw(Shader& shader, const glm::mat4& modelMatrix);           // 绘制网格
+    void drawInstanced(Shader& shader, GLuint vertexArray, GLsizei instanceCount);  // 实例化绘制
+    GLuint createVertexArray() const;    // 创建共享VBO/EBO的VAO（用于实例化），返回时仍处于绑定状态
+    GLuint createDepthVertexArray() const;  // 同上，但只有位置流
+    void drawDepth(Shader& shader, const glm::mat4& modelMatrix);   // 只写深度的绘制，不设置材质和贴图
+    void drawDepthInstanced(Shader& shader, GLuint vertexArray, GLsizei instanceCount);
+    void bindTextures() const;           // 绑定启用的材质贴图
     void setupMaterial();  // 设置材质
+    void selectShader(ShaderVariants& variants);  // 为变体表所属的通道选择着色器变体
+    Shader* shaderFor(ShaderPass pass) const { return shaders[static_cast<int>(pass)]; }
+    void syncMaterial();   // 材质修改过时重新上传uniform缓冲
+    void release();        // 删除GL缓冲，纹理由句柄自动释放
+    // 压缩格式的位置解码参数：position = snorm * positionScale + positionBias
+    glm::vec3 positionScale() const { return glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f)); }
+    glm::vec3 positionBias() const { return (boundsMax + boundsMin) * 0.5f; }
+    // 第一个索引在EBO中的字节偏移，作为glDrawElements*的indices参数
+    const void* indexOffset() const {
+        return (const void*)(uintptr_t)(geometry.firstIndex * (indexType == GL_UNSIGNED_SHORT ? 2u : 4u));
+    }
+    static GLsizei vertexStride(VertexFormat format);
+    // 位置流中一个顶点的字节数：压缩格式为4个int16，浮点格式为vec3
+    static GLsizei positionStride(VertexFormat format);
+    // 为当前绑定的VAO设置顶点属性0~2，VBO需要已绑定到GL_ARRAY_BUFFER
+    static void setupVertexAttributes(VertexFormat format);
+    // 为当前绑定的VAO设置位置流的属性0，位置缓冲需要已绑定到GL_ARRAY_BUFFER
+    static void setupPositionAttribute(VertexFormat format);
 private:
     void setupTextures(Shader& shader);  // 设置纹理
+    void uploadMaterial();               // 上传材质uniform缓冲
+    bool beginDraw(Shader& shader, DrawMode mode);  // 绘制前设置着色器、材质和贴图
+    void setPositionDecode(Shader& shader) const;   // 设置顶点解码参数
+    // 判断网格能否使用压缩格式（量化误差和UV范围都在允许之内）
+    static bool canPackVertices(const Vertex* vertexData, size_t vertexCount,
+                                const glm::vec3& boundsMin, const glm::vec3& boundsMax);
 };
 
 // 3D模型类
 class Model {
 public:
     Model(const char* path);             // 从文件加载模型
-    void draw(Shader& shader, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection);           // 绘制模型
+    ~Model();                            // 释放所有网格的GL资源
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    void draw(Shader& shader, const glm::mat4& modelMatrix);           // 绘制模型
     void setTexturePaths(const std::string& albedoPath, const std::string& normalPath); // 设置纹理路径
+    // 源文件（含材质文件）的内容哈希，读不到文件时为0，ResourceManager用它合并相同的模型
+    uint64_t getSourceHash() const { return sourceHash; }
     std::vector<Mesh> meshes;           // 网格数组
 private:
     
+    uint64_t sourceHash = 0;
     std::string directory;              // 模型文件目录
-    std::vector<Texture> textures_loaded; // 已加载的纹理
     std::string albedoTexturePath;      // 反照率贴图路径
     std::string normalTexturePath;      // 法线贴图路径
 
     void loadModel(const std::string& path);    // 加载模型
+    bool loadFromCache(const std::string& cachePath, uint64_t expectedHash);  // 从网格缓存加载，跳过Assimp
+    Texture loadTexture(const std::string& path, const std::string& typeName);  // 加载单个纹理（由ResourceManager去重）
     void processNode(aiNode* node, const aiScene* scene);  // 处理节点
     Mesh processMesh(aiMesh* mesh, const aiScene* scene);  // 处理网格
     PBR_Material loadMaterial(aiMaterial* mat);     // 加载材质
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);  // 加载材质纹理
-    unsigned int TextureFromFile(const char* path, const std::string& directory);  // 从文件加载纹理
 };
\ No newline at end of file
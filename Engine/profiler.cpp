@@ -0,0 +1,209 @@
+#include "profiler.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <cstdio>
+#include <fstream>
+
+// 查询对象每次扩充的数量
+#define PROFILER_QUERY_CHUNK 64
+// 没有GL线程记录时返回的区间下标
+#define PROFILER_INVALID_SCOPE 0xFFFFFFFFu
+
+Profiler& Profiler::get() {
+    static Profiler instance;
+    return instance;
+}
+
+Profiler::Profiler()
+    : epoch(std::chrono::steady_clock::now()),
+      ownerThread(std::this_thread::get_id()) {
+    // 创建之后、第一次newFrame之前的区间（初始化、加载模型）记在第0帧
+    slots[0].recorded = true;
+}
+
+int64_t Profiler::cpuNow() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+bool Profiler::gpuTimingAvailable() {
+    if (gpuTiming >= 0) return gpuTiming != 0;
+    // 上下文创建之前不检测，等GL加载之后再试
+    if (!GLAD_GL_VERSION_3_3) return false;
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    gpuTiming = bits > 0 ? 1 : 0;
+    if (!gpuTiming) {
+        LOG_INFO("Profiler: 驱动不支持时间戳查询，只记录CPU时间");
+    }
+    return gpuTiming != 0;
+}
+
+uint32_t Profiler::beginScope(const char* name) {
+    if (std::this_thread::get_id() != ownerThread) return PROFILER_INVALID_SCOPE;
+
+    // 每个区间同时是一个调试组，RenderDoc等工具里按区间分组显示
+    GLDebug::get().pushGroup(name);
+    FrameSlot& slot = slots[currentSlot];
+    ScopeRecord record{name, depth++, cpuNow(), -1, -1};
+    if (gpuTimingAvailable()) {
+        if (slot.queriesUsed + 2 > slot.queries.size()) {
+            size_t oldSize = slot.queries.size();
+            slot.queries.resize(oldSize + PROFILER_QUERY_CHUNK);
+            glGenQueries(PROFILER_QUERY_CHUNK, slot.queries.data() + oldSize);
+        }
+        record.query = static_cast<int32_t>(slot.queriesUsed);
+        slot.queriesUsed += 2;
+        // 时间戳可以嵌套，GL_TIME_ELAPSED同一时间只能有一个在进行
+        glQueryCounter(slot.queries[record.query], GL_TIMESTAMP);
+    }
+    slot.scopes.push_back(record);
+    return static_cast<uint32_t>(slot.scopes.size() - 1);
+}
+
+void Profiler::endScope(uint32_t scope) {
+    if (scope == PROFILER_INVALID_SCOPE) return;
+    GLDebug::get().popGroup();
+    if (depth > 0) depth--;
+    FrameSlot& slot = slots[currentSlot];
+    // 区间跨越了newFrame，记录已经属于上一帧
+    if (scope >= slot.scopes.size()) return;
+    ScopeRecord& record = slot.scopes[scope];
+    if (record.query >= 0) {
+        glQueryCounter(slot.queries[record.query + 1], GL_TIMESTAMP);
+    }
+    record.cpuEnd = cpuNow();
+}
+
+void Profiler::newFrame() {
+    // 第一次有GL时把GPU时间戳和CPU时钟对齐，之后的GPU区间都换算到CPU时间轴
+    if (!calibrated && gpuTimingAvailable()) {
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        gpuToCpuOffset = cpuNow() - gpuTime;
+        calibrated = true;
+    }
+
+    frameIndex++;
+    currentSlot = (currentSlot + 1) % PROFILER_FRAME_LATENCY;
+    depth = 0;
+
+    // 复用前读取这一组，PROFILER_FRAME_LATENCY帧之后GPU通常已经完成
+    FrameSlot& slot = slots[currentSlot];
+    if (slot.recorded) {
+        resolve(slot, false);
+    }
+    slot.index = frameIndex;
+    slot.recorded = true;
+}
+
+void Profiler::resolve(FrameSlot& slot, bool wait) {
+    // 时间戳按提交顺序完成，最后一个可用时前面的都可用
+    bool gpuReady = slot.queriesUsed > 0;
+    if (gpuReady && !wait) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(slot.queries[slot.queriesUsed - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        gpuReady = available != GL_FALSE;
+    }
+
+    ProfileFrame frame;
+    frame.index = slot.index;
+    frame.scopes.reserve(slot.scopes.size());
+    for (const ScopeRecord& record : slot.scopes) {
+        if (record.cpuEnd < 0) continue;
+        ProfileResult result;
+        result.name = record.name;
+        result.depth = record.depth;
+        result.cpuBegin = record.cpuBegin / 1000.0;
+        result.cpuDuration = (record.cpuEnd - record.cpuBegin) / 1000.0;
+        result.gpuBegin = 0.0;
+        result.gpuDuration = -1.0;
+        if (gpuReady && record.query >= 0) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(slot.queries[record.query], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(slot.queries[record.query + 1], GL_QUERY_RESULT, &end);
+            result.gpuBegin = (static_cast<int64_t>(begin) + gpuToCpuOffset) / 1000.0;
+            result.gpuDuration = (end - begin) / 1000.0;
+        }
+        frame.scopes.push_back(result);
+    }
+
+    slot.scopes.clear();
+    slot.queriesUsed = 0;
+    slot.recorded = false;
+
+    if (frame.scopes.empty()) return;
+    lastFrame = frame;
+    history.push_back(std::move(frame));
+    while (history.size() > PROFILER_TRACE_FRAMES) {
+        history.pop_front();
+    }
+}
+
+static void writeJsonString(std::ofstream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        out << *c;
+    }
+    out << '"';
+}
+
+bool Profiler::writeTrace(const std::string& path) {
+    // 当前帧之前还没读回的组按从旧到新的顺序等待完成；当前帧可能还有未结束的区间，不写出
+    for (uint32_t i = 1; i < PROFILER_FRAME_LATENCY; i++) {
+        FrameSlot& slot = slots[(currentSlot + i) % PROFILER_FRAME_LATENCY];
+        if (slot.recorded) {
+            resolve(slot, true);
+        }
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        LOG_ERROR("Profiler: 无法写入 {}", path);
+        return false;
+    }
+
+    // pid 1，tid 1为CPU，tid 2为GPU
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    char number[64];
+    size_t events = 0;
+    for (const ProfileFrame& frame : history) {
+        for (const ProfileResult& scope : frame.scopes) {
+            out << ",\n{\"name\":";
+            writeJsonString(out, scope.name);
+            std::snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", scope.cpuBegin, scope.cpuDuration);
+            out << ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << number
+                << ",\"args\":{\"frame\":" << frame.index << "}}";
+            events++;
+            if (scope.gpuDuration >= 0.0) {
+                out << ",\n{\"name\":";
+                writeJsonString(out, scope.name);
+                std::snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", scope.gpuBegin, scope.gpuDuration);
+                out << ",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":" << number
+                    << ",\"args\":{\"frame\":" << frame.index << "}}";
+                events++;
+            }
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!out) {
+        LOG_ERROR("Profiler: 写入 {} 失败", path);
+        return false;
+    }
+    LOG_INFO("Profiler: {} 帧，{} 个事件写入 {}", history.size(), events, path);
+    return true;
+}
+
+void Profiler::shutdown() {
+    for (FrameSlot& slot : slots) {
+        if (!slot.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+        }
+        slot = FrameSlot();
+    }
+    slots[currentSlot].recorded = true;
+    // 上下文即将销毁，之后的区间只记录CPU时间
+    gpuTiming = 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <glad/glad.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 是否记录性能区间，关闭后PROFILE_SCOPE展开为空
+#ifndef ENABLE_PROFILER
+#define ENABLE_PROFILER 1
+#endif
+
+// GPU查询结果最多延迟几帧读取，超过时丢弃该帧的GPU时间而不是等待
+#define PROFILER_FRAME_LATENCY 3
+// 导出trace时保留的帧数
+#define PROFILER_TRACE_FRAMES 600
+
+// 一个已完成的区间，时间单位为微秒，以Profiler创建时刻为零点
+struct ProfileResult {
+    const char* name;
+    uint32_t depth;         // 嵌套层数，0为最外层
+    double cpuBegin;
+    double cpuDuration;
+    double gpuBegin;        // 已换算到CPU时间轴
+    double gpuDuration;     // 没有GPU时间时小于0
+};
+
+// 一帧的全部区间
+struct ProfileFrame {
+    uint64_t index = 0;
+    std::vector<ProfileResult> scopes;
+};
+
+// 性能分析器
+// 在GL线程上记录命名区间的CPU时间，有GL上下文时同时在区间两端插入GL_TIMESTAMP查询。
+// 查询按帧环形使用PROFILER_FRAME_LATENCY组，newFrame时只读取已经可用的结果，从不等待GPU。
+// 结果可以导出为Chrome trace_event格式（chrome://tracing或Perfetto打开），CPU和GPU各占一行。
+// 区间名必须是字符串常量，只保存指针。
+class Profiler {
+public:
+    static Profiler& get();
+
+    // 每帧开始时调用：结束上一帧，读取已完成帧的GPU时间
+    void newFrame();
+    // 开始和结束一个区间，只在GL线程调用，其他线程的调用被忽略
+    uint32_t beginScope(const char* name);
+    void endScope(uint32_t scope);
+
+    // 最近一个完整读回的帧，用于界面显示
+    const ProfileFrame& getLastFrame() const { return lastFrame; }
+
+    // 把保留的帧写成Chrome trace JSON，会等待之前各帧的查询完成，当前帧不写出
+    bool writeTrace(const std::string& path);
+    // 释放查询对象，需要在GL上下文销毁前调用
+    void shutdown();
+
+private:
+    Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    struct ScopeRecord {
+        const char* name;
+        uint32_t depth;
+        int64_t cpuBegin;       // 纳秒
+        int64_t cpuEnd;         // 未结束时为-1
+        int32_t query;          // 开始时间戳查询在组内的下标，结束为query+1；没有GPU时间时为-1
+    };
+
+    // 一帧的记录和它使用的查询
+    struct FrameSlot {
+        uint64_t index = 0;
+        std::vector<ScopeRecord> scopes;
+        std::vector<GLuint> queries;
+        uint32_t queriesUsed = 0;
+        bool recorded = false;
+    };
+
+    bool gpuTimingAvailable();
+    int64_t cpuNow() const;
+    // 读取一组的结果并放入历史，wait为false时结果不可用就丢弃GPU时间
+    void resolve(FrameSlot& slot, bool wait);
+
+    std::chrono::steady_clock::time_point epoch;
+    FrameSlot slots[PROFILER_FRAME_LATENCY];
+    uint32_t currentSlot = 0;
+    uint64_t frameIndex = 0;
+    uint32_t depth = 0;
+
+    int gpuTiming = -1;             // -1为未检测
+    bool calibrated = false;
+    int64_t gpuToCpuOffset = 0;     // GPU时间戳加上它得到CPU时间（纳秒）
+
+    std::deque<ProfileFrame> history;
+    ProfileFrame lastFrame;
+    std::thread::id ownerThread;
+};
+
+// RAII区间
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : scope(Profiler::get().beginScope(name)) {}
+    ~ProfileScope() { Profiler::get().endScope(scope); }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    uint32_t scope;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#if ENABLE_PROFILER
+// 记录从这里到所在作用域结束的时间
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
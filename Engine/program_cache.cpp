@@ -0,0 +1,196 @@
+#include "program_cache.h"
+#include "engine_paths.h"
+#include "log.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// 是否缓存链接好的程序二进制
+#define ENABLE_PROGRAM_CACHE 1
+
+// 文件格式：ProgramCacheHeader，之后是binaryLength字节的程序二进制
+static const char kProgramCacheMagic[4] = {'G', 'L', 'R', 'P'};
+
+struct ProgramCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;        // 防止文件名碰撞
+    uint64_t driverHash;        // 厂商、渲染器和版本字符串的哈希
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+static_assert(sizeof(ProgramCacheHeader) == 32, "ProgramCacheHeader布局不能改变");
+
+// FNV-1a 64
+static uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+ProgramCache& ProgramCache::get() {
+    static ProgramCache instance;
+    return instance;
+}
+
+uint64_t ProgramCache::hashSource(const std::string& source, uint64_t seed) {
+    uint64_t hash = hashBytes(source.data(), source.size(), seed);
+    // 长度也参与，串联的两段源码换一种切分方式时哈希不同
+    uint64_t length = source.size();
+    return hashBytes(&length, sizeof(length), hash);
+}
+
+bool ProgramCache::supported() {
+    if (initialized) return available;
+    initialized = true;
+    if (!ENABLE_PROGRAM_CACHE || !GLAD_GL_VERSION_4_1) return false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) {
+        LOG_INFO("ProgramCache: 驱动不支持程序二进制，每次启动都编译着色器");
+        return false;
+    }
+
+    uint64_t hash = 1469598103934665603ull;
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        if (value) hash = hashBytes(value, std::strlen(value), hash);
+        hash = hashBytes("\n", 1, hash);
+    }
+    driverHash = hash;
+
+    std::error_code error;
+    std::filesystem::create_directories(GL_RENDER_SHADER_CACHE_DIR, error);
+    if (error) {
+        LOG_WARN("ProgramCache: 无法创建缓存目录 {}: {}", GL_RENDER_SHADER_CACHE_DIR, error.message());
+        return false;
+    }
+    available = true;
+    return true;
+}
+
+std::string ProgramCache::cachePathFor(uint64_t sourceHash) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.glprog", static_cast<unsigned long long>(sourceHash));
+    return std::string(GL_RENDER_SHADER_CACHE_DIR) + name;
+}
+
+GLuint ProgramCache::load(uint64_t sourceHash) {
+    if (!supported()) return 0;
+
+    std::string path = cachePathFor(sourceHash);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        stats.misses++;
+        return 0;
+    }
+
+    ProgramCacheHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, kProgramCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != PROGRAM_CACHE_VERSION || header.sourceHash != sourceHash) {
+        LOG_WARN("ProgramCache: 缓存文件无效，重新编译: {}", path);
+        stats.rejected++;
+        return 0;
+    }
+    if (header.driverHash != driverHash) {
+        LOG_INFO("ProgramCache: 驱动已变化，重新编译: {}", path);
+        stats.rejected++;
+        return 0;
+    }
+    // 长度必须与文件剩余部分一致，损坏的文件头不能导致超大分配；不一致时删除文件
+    std::streamoff binaryStart = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff remaining = in.tellg() - binaryStart;
+    in.seekg(binaryStart);
+    if (binaryStart < 0 || remaining != static_cast<std::streamoff>(header.binaryLength)) {
+        LOG_WARN("ProgramCache: 缓存文件长度不符，删除后重新编译: {}", path);
+        in.close();
+        std::remove(path.c_str());
+        stats.rejected++;
+        return 0;
+    }
+    std::vector<char> binary(header.binaryLength);
+    in.read(binary.data(), static_cast<std::streamsize>(binary.size()));
+    if (!in) {
+        LOG_WARN("ProgramCache: 缓存文件不完整，重新编译: {}", path);
+        stats.rejected++;
+        return 0;
+    }
+
+    // 驱动可以拒绝任何二进制（例如内部编译器更新但版本字符串未变），以链接状态为准
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        LOG_INFO("ProgramCache: 驱动拒绝了缓存的二进制，重新编译: {}", path);
+        glDeleteProgram(program);
+        stats.rejected++;
+        return 0;
+    }
+    stats.hits++;
+    LOG_DEBUG("ProgramCache: 从缓存加载程序 {:016x}", sourceHash);
+    return program;
+}
+
+void ProgramCache::prepareLink(GLuint program) {
+    if (!supported()) return;
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(GLuint program, uint64_t sourceHash) {
+    if (!supported()) return;
+
+    GLint linked = GL_FALSE, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (!linked || length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) return;
+
+    ProgramCacheHeader header;
+    std::memcpy(header.magic, kProgramCacheMagic, sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.driverHash = driverHash;
+    header.binaryFormat = format;
+    header.binaryLength = static_cast<uint32_t>(written);
+
+    // 先写临时文件再替换，避免留下半个文件
+    std::string path = cachePathFor(sourceHash);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            LOG_WARN("ProgramCache: 无法写入缓存: {}", tempPath);
+            return;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), written);
+        if (!out) {
+            LOG_WARN("ProgramCache: 写入缓存失败: {}", tempPath);
+            out.close();
+            std::remove(tempPath.c_str());
+            return;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        LOG_WARN("ProgramCache: 无法替换缓存: {}", path);
+        std::remove(tempPath.c_str());
+        return;
+    }
+    stats.stores++;
+}
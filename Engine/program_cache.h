@@ -0,0 +1,47 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// 程序二进制缓存文件格式版本，格式变化时递增
+#define PROGRAM_CACHE_VERSION 1
+
+// 着色器程序二进制缓存
+// 以插入宏之后的源码哈希为文件名，文件头记录驱动（厂商/渲染器/版本）的哈希，
+// 驱动不同、文件损坏或驱动拒绝二进制时都回退到编译，编译成功后重新写入
+// 需要GL 4.1（glGetProgramBinary/glProgramBinary）且驱动至少支持一种二进制格式
+class ProgramCache {
+public:
+    static ProgramCache& get();
+
+    // 源码哈希，seed用于串联多个阶段：hashSource(fragment, hashSource(vertex))
+    static uint64_t hashSource(const std::string& source, uint64_t seed = 1469598103934665603ull);
+
+    // 按源码哈希加载程序，未命中时返回0
+    GLuint load(uint64_t sourceHash);
+    // 链接前调用，提示驱动保留可取回的二进制
+    void prepareLink(GLuint program);
+    // 链接成功后写入缓存
+    void store(GLuint program, uint64_t sourceHash);
+
+    struct Stats {
+        uint32_t hits = 0;          // 直接从二进制创建
+        uint32_t misses = 0;        // 没有缓存文件
+        uint32_t rejected = 0;      // 驱动变化、文件损坏或驱动拒绝二进制
+        uint32_t stores = 0;        // 写入的程序
+    };
+    const Stats& getStats() const { return stats; }
+
+private:
+    ProgramCache() = default;
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    bool supported();
+    std::string cachePathFor(uint64_t sourceHash) const;
+
+    bool initialized = false;
+    bool available = false;
+    uint64_t driverHash = 0;
+    Stats stats;
+};
@@ -4,17 +4,41 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
-#include <iostream>
 #include <chrono>
 #include <thread>
+#include <ctime>
+#include <iomanip>
 #include "shader.h"
-#include <spdlog/spdlog.h>
+#include "engine_paths.h"
+#include "texture_loader.h"
+#include "resource_manager.h"
+#include "gl_state.h"
+#include "geometry_pool.h"
+#include "program_cache.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#ifdef GL_RENDER_HEADLESS
+#include "headless_context.h"
+#endif
 // �����λ��
 #define CAMERA_POS glm::vec3(0.0f, 2.0f, 8.0f)
 // ����MSAA
 #define ENABLE_MSAA 1
 // ����MSAA������
 #define MSAA_SAMPLES 4
+// 每帧最多上传的纹理数量，避免加载时单帧卡顿
+#define MAX_TEXTURE_UPLOADS_PER_FRAME 4
+// 启动时的帧节奏模式和固定帧率模式的帧率
+#define DEFAULT_FRAME_PACING_MODE FramePacingMode::VSync
+#define FIXED_FRAME_RATE 60.0
+// 退出时是否写出性能trace（运行中按F7随时写出）
+#define WRITE_TRACE_ON_EXIT 0
+// 启动时是否使用延迟渲染（运行中按F8切换）
+#define DEFAULT_DEFERRED_SHADING 0
+// 无头模式每帧按固定间隔推进自动曝光，结果不受实际帧时间影响
+#define HEADLESS_FRAME_TIME (1.0f / 60.0f)
 
 Renderer* Renderer::currentInstance = nullptr;
 // ���캯��
@@ -22,11 +46,9 @@ Renderer::Renderer() : window(nullptr), shaderProgram(0), VAO(0), VBO(0), EBO(0)
     cameraPos(CAMERA_POS),
     cameraFront(glm::vec3(0.0f, 0.0f, -1.0f)),
     cameraUp(glm::vec3(0.0f, 1.0f, 0.0f)),
-    lastFrameTime(0.0),
-    targetFrameTime(1.0 / 60.0),
+    lastStatsReportTime(0.0),
     windowWidth(1920),
-    windowHeight(1080),
-    PBR_shader(){
+    windowHeight(1080) {
     currentInstance = this;
 }
 // ��������
@@ -37,28 +59,32 @@ Renderer::~Renderer() {
 bool Renderer::init(int width, int height, const char* title) {
     // ��ʼ��GLFW
     if (!glfwInit()) {
-        std::cerr << "Failed to initialize GLFW" << std::endl;
+        LOG_ERROR("Failed to initialize GLFW");
         return false;
     }
     // ����GLFW����ص�
     glfwSetErrorCallback([](int error, const char* description) {
-        std::cerr << "GLFW Error " << error << ": " << description << std::endl;
+        LOG_ERROR("GLFW Error {}: {}", error, description);
     });
     
     // ����OpenGL�汾Ϊ3.3��ʹ�ú���ģʽ
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // 调试构建创建调试上下文，发布构建的驱动不做额外检查
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_DEBUG_CONTEXT ? GLFW_TRUE : GLFW_FALSE);
 
 #if ENABLE_MSAA
     // ����MSAA������
-    glfwWindowHint(GLFW_SAMPLES, MSAA_SAMPLES);
+    // 场景画到多重采样的HDR目标，色调映射只写一个全屏三角形，窗口用单采样，
+    // 省去交换链的多重采样存储和每帧的解析；关闭HDR或HDR管线不可用时没有多重采样
+    glfwWindowHint(GLFW_SAMPLES, 0);
 #endif
 
     // ��������
     window = glfwCreateWindow(width, height, title, NULL, NULL);
     if (!window) {
-        std::cerr << "Failed to create GLFW window" << std::endl;
+        LOG_ERROR("Failed to create GLFW window");
         glfwTerminate();
         return false;
     }
@@ -66,17 +92,23 @@ bool Renderer::init(int width, int height, const char* title) {
     // ���õ�ǰ������
     glfwMakeContextCurrent(window);
 
-    // ���ô�ֱͬ��
-    glfwSwapInterval(1);
+    // 帧节奏：垂直同步和低延迟模式以显示器刷新率为目标间隔
+    if (const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor())) {
+        framePacer.setRefreshRate(videoMode->refreshRate);
+    }
+    framePacer.setFixedRate(FIXED_FRAME_RATE);
+    framePacer.setMode(DEFAULT_FRAME_PACING_MODE);
+    glfwSwapInterval(framePacer.swapInterval());
 
     // ��ʼ�����������
     inputManager.init(window);
 
     // ��ʼ��GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cerr << "Failed to initialize GLAD" << std::endl;
+        LOG_ERROR("Failed to initialize GLAD");
         return false;
     }
+    GLDebug::get().init((GLADloadproc)glfwGetProcAddress);
 
 #if ENABLE_MSAA
     // ���ö��ز���
@@ -104,6 +136,8 @@ bool Renderer::init(int width, int height, const char* title) {
     guiRenderer.init();
 
     setupPBRShader();
+    // 窗口是单采样的，多重采样由HDR场景目标完成
+    hdrPipeline.init(ENABLE_MSAA ? MSAA_SAMPLES : 0);
 
     // ���ز��Է���ģ��
     loadTestRoom();
@@ -112,120 +146,289 @@ bool Renderer::init(int width, int height, const char* title) {
 }
 // ��ɫ������
 void Renderer::setupPBRShader() {
-    const char* vertexPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Shader/pbrshader.vert";
-    const char* fragmentPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Shader/pbrshader.frag";
+    const char* vertexPath = GL_RENDER_SHADER_DIR "pbrshader.vert";
+    const char* fragmentPath = GL_RENDER_SHADER_DIR "pbrshader.frag";
     // ���Լ��غͱ�����ɫ���ļ�
     try {
-        PBR_shader = Shader(vertexPath, fragmentPath);
-        shaderProgram = PBR_shader.ID;
+        PBR_shaders.init(vertexPath, fragmentPath);
+        // init同步编译不带贴图的基础变体，源文件有错误时在这里发现
+        Shader* baseShader = PBR_shaders.active(nullptr);
+        shaderProgram = baseShader ? baseShader->ID : 0;
         // ����ɹ���Ϣ����־
-        spdlog::info("Shader loaded successfully at ID {}", shaderProgram);
+        LOG_INFO("Shader loaded successfully at ID {}", shaderProgram);
+        // 延迟渲染的G-buffer变体使用同一对源文件
+        if (deferredRenderer.init(vertexPath, fragmentPath)) {
+            setDeferredShading(DEFAULT_DEFERRED_SHADING);
+        }
     } 
     // ������ɫ�����ع����е��쳣
     catch(const std::exception& e) {
         // ���������Ϣ����׼������
-        spdlog::error("Shader loading failed: {}", e.what());
+        LOG_ERROR("Shader loading failed: {}", e.what());
         return;
     }
 }
 // ֡�ʿ���
-void Renderer::controlFrameRate() {
-    static double frameTimeSum = 0.0;
-    static int frameCount = 0;
-    static double lastFPSUpdateTime = glfwGetTime();
-    
-    // ��ȡ��ǰ֡��ʼʱ��
-    double frameStartTime = glfwGetTime();
-    double deltaTime = frameStartTime - lastFrameTime;
-    
-    // ���㲢��ʾFPS
-    frameTimeSum += deltaTime;
-    frameCount++;
-    if (frameStartTime - lastFPSUpdateTime >= 1.0) {
-        double averageFPS = frameCount / (frameStartTime - lastFPSUpdateTime);
-        // ���FPS����־
-        //����һ��
-        std::cout << "\033[1A";
-        spdlog::info("FPS: {:.2f}", averageFPS);
-        frameTimeSum = 0.0;
-        frameCount = 0;
-        lastFPSUpdateTime = frameStartTime;
+void Renderer::reportFrameStats() {
+    double now = glfwGetTime();
+    if (now - lastStatsReportTime < 1.0) return;
+    lastStatsReportTime = now;
+
+    FrameTiming average = framePacer.getAverage();
+    if (average.frameTime <= 0.0) return;
+    LOG_INFO("FPS: {:.2f}，{}，节奏误差 {:.2f}ms，CPU空闲 {:.0f}%",
+                 1.0 / average.frameTime, FramePacer::modeName(framePacer.getMode()),
+                 average.pacingError * 1000.0, average.cpuIdle * 100.0);
+}
+
+bool Renderer::setDeferredShading(bool enabled) {
+    if (enabled && !deferredRenderer.isInitialized()) {
+        LOG_WARN("延迟渲染不可用，继续使用前向渲染");
+        enabled = false;
+    }
+    scene.deferredShading = enabled;
+    LOG_INFO("渲染路径: {}", enabled ? "延迟" : "前向");
+    return enabled;
+}
+
+void Renderer::cycleFramePacingMode() {
+    int next = (static_cast<int>(framePacer.getMode()) + 1) % static_cast<int>(FramePacingMode::Count);
+    framePacer.setMode(static_cast<FramePacingMode>(next));
+    glfwSwapInterval(framePacer.swapInterval());
+    LOG_INFO("帧节奏模式: {}", FramePacer::modeName(framePacer.getMode()));
+}
+
+// 带时间戳的trace文件名，与截图一样写到工作目录
+static std::string traceFileName() {
+    std::time_t now = std::time(nullptr);
+    std::stringstream ss;
+    ss << "trace_" << std::put_time(std::localtime(&now), "%Y%m%d_%H%M%S") << ".json";
+    return ss.str();
+}
+
+void Renderer::render(float time) {
+    Profiler::get().newFrame();
+    {
+        // 按模式等待，低延迟模式会等到预计呈现之前才开始采样输入
+        PROFILE_SCOPE("FramePacer::wait");
+        framePacer.beginFrame();
+    }
+    PROFILE_SCOPE("Renderer::render");
+    glfwPollEvents();
+
+    // 上传已解码完成的纹理
+    TextureLoader::get().pump(MAX_TEXTURE_UPLOADS_PER_FRAME);
+
+    // 处理输入并更新相机方向，移动按上一帧的呈现间隔计算
+    inputManager.processInput(window, cameraPos, cameraFront, cameraUp,
+                              static_cast<float>(framePacer.getDeltaTime()));
+    cameraFront = inputManager.getCameraFront();
+
+    // F5重新编译着色器，新程序链接完成前继续用旧的
+    if (inputManager.consumeShaderReload()) {
+        PBR_shaders.reload();
+        deferredRenderer.reload();
+    }
+    // F8切换前向/延迟渲染
+    if (inputManager.consumeRenderPathToggle()) {
+        setDeferredShading(!scene.deferredShading);
     }
+    if (inputManager.consumeFramePacingCycle()) {
+        cycleFramePacingMode();
+    }
+    
+    // 设置变换矩阵
+    glm::mat4 view = glm::lookAt(
+        cameraPos,
+        cameraPos + cameraFront,
+        cameraUp
+    );
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, 100.0f);
+
+    renderScene(view, projection, static_cast<float>(framePacer.getDeltaTime()));
     
-    // ���������һ֡ʱ��С��Ŀ��֡ʱ�䣬���о�ȷ�ȴ�
-    if (deltaTime < targetFrameTime) {
-        double waitTime = targetFrameTime - deltaTime;
-        double waitStartTime = glfwGetTime();
-        while (glfwGetTime() - waitStartTime < waitTime) {
-            std::this_thread::yield(); // �ó�CPUʱ��Ƭ������CPUռ��
+    // 渲染ImGui界面
+    guiRenderer.renderImGui(scene);
+
+    {
+        PROFILE_SCOPE("SwapBuffers");
+        if (framePacer.getMode() == FramePacingMode::LowLatency) {
+            // 驱动会缓冲几帧，等GPU完成后交换缓冲才能按垂直同步返回，工作时间也包含GPU部分
+            glFinish();
         }
+        framePacer.beforePresent();
+        glfwSwapBuffers(window);
     }
-    
-    // ������һ֡ʱ��
-    lastFrameTime = frameStartTime;
-}
+    framePacer.endFrame();
+    RenderStats::get().endFrame(framePacer.getLastFrame().frameTime);
+    reportFrameStats();
 
-void Renderer::render(float time) {
-    // ֡�ʿ���
-    controlFrameRate();
+    // F7写出最近几百帧的CPU/GPU区间
+    if (inputManager.consumeTraceDump()) {
+        Profiler::get().writeTrace(traceFileName());
+    }
+}
 
-    // �����ɫ����Ȼ���
+void Renderer::renderScene(const glm::mat4& view, const glm::mat4& projection, float deltaTime) {
+    PROFILE_SCOPE("Renderer::renderScene");
+    // HDR管线可用时场景画到浮点目标，最后色调映射回当前帧缓冲
+    bool hdr = hdrPipeline.begin(scene.hdr);
+    // 清除颜色和深度缓冲
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
-    // ȷ����Ȳ��Ժ�����ƽ��������
+    // 确保深度测试和线条平滑已启用
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_LINE_SMOOTH);
     glLineWidth(2.0f);
     
-    // �����ɫ�������Ƿ���Ч
+    // 检查着色器程序是否有效
     if (!shaderProgram) {
-        spdlog::error("Error: Shader program is not valid");
+        LOG_ERROR("Error: Shader program is not valid");
+        if (hdr) hdrPipeline.resolve(scene.hdr, deltaTime);
         return;
     }
     
-    // �������벢�����������
-    inputManager.processInput(window, cameraPos, cameraFront, cameraUp);
-    cameraFront = inputManager.getCameraFront();
-    
-    // ���ñ任����
-    glm::mat4 view = glm::lookAt(
-        cameraPos,
-        cameraPos + cameraFront,
-        cameraUp
-    );
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, 100.0f);
-    
-    // ����GUI��Ⱦ���ı任����
-    guiRenderer.setViewMatrix(view);
-    guiRenderer.setProjectionMatrix(projection);
+    // ImGui等外部代码会直接改GL状态，每帧开始时丢弃缓存的绑定
+    GLStateTracker& state = GLStateTracker::get();
+    state.invalidate();
+    state.resetStats();
+
+    // 上传相机数据，本帧所有着色器共用
+    CameraBlock camera;
+    camera.view = view;
+    camera.projection = projection;
+    camera.camPos = glm::vec4(cameraPos, 1.0f);
+    cameraUBO.update(&camera, sizeof(camera));
+    cameraUBO.bindBase(CAMERA_BLOCK_BINDING);
     
-    // ���Ʋο�ϵͳ
+    // 绘制参考系统
     guiRenderer.renderGrid();
     guiRenderer.renderAxis();
 
-    // ��Ⱦ����
-    scene.render(PBR_shader, view, projection);
-    
-    // ��ȾImGui����
-    guiRenderer.renderImGui(scene);
-    
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    // 渲染场景；界面上的开关可能在延迟渲染不可用时被打开，此时仍用前向渲染
+    if (scene.deferredShading && deferredRenderer.isInitialized()) {
+        deferredRenderer.render(scene, view, projection);
+    } else {
+        scene.render(PBR_shaders, view, projection);
+    }
+
+    if (hdr) {
+        hdrPipeline.resolve(scene.hdr, deltaTime);
+    }
+}
+
+bool Renderer::initHeadless(int width, int height, const std::string& modelPath, int instanceCount) {
+#ifdef GL_RENDER_HEADLESS
+    headlessContext = std::make_unique<HeadlessContext>();
+    if (!headlessContext->init(width, height)) {
+        LOG_ERROR("无头上下文初始化失败");
+        headlessContext.reset();
+        return false;
+    }
+
+    windowWidth = width;
+    windowHeight = height;
+    headlessContext->bindFramebuffer();
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    // 无头模式不初始化ImGui，只创建网格和坐标轴
+    guiRenderer.init();
+
+    setupPBRShader();
+    if (!shaderProgram) {
+        return false;
+    }
+    // 无头帧缓冲没有多重采样，HDR目标也不用
+    hdrPipeline.init(0);
+
+    if (instanceCount > 0) {
+        InstanceGroup* group = scene.getInstanceGroup(modelPath);
+        if (!group) {
+            LOG_ERROR("无法加载模型: {}", modelPath);
+            return false;
+        }
+        // 方形网格排列，间距取模型最大边长
+        glm::vec3 extent = group->getModelBounds().extent();
+        float spacing = std::max(extent.x, std::max(extent.z, 0.01f)) * 1.2f;
+        int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+        for (int i = 0; i < instanceCount; i++) {
+            glm::vec3 offset((i % side - side / 2) * spacing, 0.0f, -(i / side) * spacing);
+            group->add(glm::translate(glm::mat4(1.0f), offset));
+        }
+    } else if (!scene.loadModel(modelPath)) {
+        LOG_ERROR("无法加载模型: {}", modelPath);
+        return false;
+    }
+    // 基准测试需要稳定的帧，等所有纹理上传完成
+    TextureLoader::get().finishAll();
+    return true;
+#else
+    LOG_ERROR("当前构建未启用无头模式(GL_RENDER_HEADLESS)");
+    return false;
+#endif
+}
+
+void Renderer::renderHeadlessFrame() {
+#ifdef GL_RENDER_HEADLESS
+    Profiler::get().newFrame();
+    PROFILE_SCOPE("Renderer::renderHeadlessFrame");
+    auto frameStart = std::chrono::steady_clock::now();
+    headlessContext->bindFramebuffer();
+
+    // 固定相机，保证每次运行结果可比
+    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, 100.0f);
+
+    renderScene(view, projection, HEADLESS_FRAME_TIME);
+
+    // 没有交换链，等待GPU完成作为一帧的结束
+    glFinish();
+    RenderStats::get().endFrame(std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+#endif
+}
+
+bool Renderer::validateGpuCulling() {
+    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), static_cast<float>(windowWidth) / static_cast<float>(windowHeight), 0.1f, 100.0f);
+    return scene.validateGpuCulling(view, projection);
 }
 
 void Renderer::cleanup() {
-    if (shaderProgram) glDeleteProgram(shaderProgram);
+    if (WRITE_TRACE_ON_EXIT && window) {
+        Profiler::get().writeTrace(traceFileName());
+    }
+    // GL资源要在上下文销毁之前释放
+    guiRenderer.cleanup();
+    TextureLoader::get().shutdown();
+    scene.cleanup();
+    cameraUBO.release();
+    deferredRenderer.release();
+    hdrPipeline.release();
+    PBR_shaders.release();
+    shaderProgram = 0;
+    const ProgramCache::Stats& programStats = ProgramCache::get().getStats();
+    LOG_INFO("ProgramCache: 命中 {}，未命中 {}，失效 {}，写入 {}",
+                 programStats.hits, programStats.misses, programStats.rejected, programStats.stores);
+    ResourceManager::get().shutdown();
+    // 模型释放后池中应该已经没有网格
+    GeometryPool::get().shutdown();
+    Profiler::get().shutdown();
     if (window) {
         glfwDestroyWindow(window);
         window = nullptr;
     }
+#ifdef GL_RENDER_HEADLESS
+    headlessContext.reset();
+#endif
     glfwTerminate();
 }
 
 void Renderer::loadTestRoom() {
     if (!scene.loadModel("test_room.obj")) {
-        spdlog::error("�޷�����TestRoomģ��");
+        LOG_ERROR("�޷�����TestRoomģ��");
     }
 }
 
@@ -9,9 +9,15 @@
 #include <gtc/type_ptr.hpp>
 #include <string>
 #include <vector>
+#include <memory>
 #include "input_manager.h"
 #include "gui_renderer.h"
 #include "scene.h"
+#include "frame_pacer.h"
+#include "deferred_renderer.h"
+#include "hdr_pipeline.h"
+
+class HeadlessContext;
 
 class Renderer {
 public:
@@ -23,8 +29,37 @@ public:
     void cleanup();
     bool shouldClose() const;
 
+    // 无头模式：不创建窗口，使用EGL上下文渲染到离屏FBO
+    // instanceCount大于0时把模型作为实例组在XZ平面上摆放instanceCount份
+    bool initHeadless(int width, int height, const std::string& modelPath, int instanceCount = 0);
+    // 无头模式下用固定相机渲染一帧，并等待GPU完成
+    void renderHeadlessFrame();
+    // 用无头模式的相机对比GPU和CPU的剔除结果，一致时返回true
+    bool validateGpuCulling();
+
+    // 切换前向/延迟渲染，延迟渲染不可用时保持前向，返回实际使用的是否为延迟渲染
+    bool setDeferredShading(bool enabled);
+    // 在场景中随机摆放count个点光源，用于对比两条渲染路径
+    void scatterPointLights(int count) { scene.scatterPointLights(static_cast<uint32_t>(count)); }
+    // 主光源阴影的开关和PCF半径，用于对比阴影的开销
+    void setShadows(bool enabled, int pcfRadius) {
+        scene.shadows = enabled;
+        scene.shadowFilterRadius = pcfRadius;
+    }
+    // 加载HDR环境贴图作为环境光照，首次加载时预计算并写入缓存
+    bool loadEnvironment(const std::string& path) { return scene.loadEnvironment(path); }
+    // HDR场景目标的开关、格式和自动曝光，用于对比带宽和精度
+    void setHdr(bool enabled, HdrFormat format, bool autoExposure) {
+        scene.hdr.enabled = enabled;
+        scene.hdr.format = format;
+        scene.hdr.autoExposure = autoExposure;
+    }
+
 private:
     GLFWwindow* window;
+#ifdef GL_RENDER_HEADLESS
+    std::unique_ptr<HeadlessContext> headlessContext;
+#endif
     GLuint shaderProgram;
     // VAO: 顶点数组对象，用于存储顶点属性的配置
     // VBO: 顶点缓冲对象，用于存储顶点数据
@@ -34,10 +69,20 @@ private:
     InputManager inputManager;
     GUIRenderer guiRenderer;
     Scene scene;
-    Shader PBR_shader;
+    // PBR着色器按材质特性编译的变体，程序由ResourceManager共享
+    ShaderVariants PBR_shaders;
+    // 延迟渲染路径，场景的deferredShading为true时代替scene.render
+    DeferredRenderer deferredRenderer;
+    // 相机uniform缓冲，每帧更新一次，PBR和GUI着色器共用
+    UniformBuffer cameraUBO;
+    // 场景先画到浮点目标，自动曝光后色调映射到窗口或无头帧缓冲
+    HdrPipeline hdrPipeline;
 
     void setupPBRShader();
     void loadTestRoom();
+    // 渲染网格、坐标轴和场景，窗口模式和无头模式共用
+    // deltaTime用于自动曝光的适应
+    void renderScene(const glm::mat4& view, const glm::mat4& projection, float deltaTime);
 
     
     std::vector<float> vertices;
@@ -48,13 +93,13 @@ private:
     glm::vec3 cameraFront;
     glm::vec3 cameraUp;
 
-    // 帧率控制变量
-    double lastFrameTime;
-    double targetFrameTime;
-    const int targetFPS = 60;
-    
-    // 帧率控制方法
-    void controlFrameRate();
+    // 帧节奏控制，F6切换模式
+    FramePacer framePacer;
+    double lastStatsReportTime;
+
+    // 每秒输出一次帧率、节奏误差和CPU空闲比例
+    void reportFrameStats();
+    void cycleFramePacingMode();
 
     // 窗口尺寸
     int windowWidth;
@@ -0,0 +1,232 @@
+#include "render_queue.h"
+#include "model.h"
+#include "shader.h"
+#include "geometry_pool.h"
+#include "gl_state.h"
+#include "uniform_buffer.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include <algorithm>
+#include <cstring>
+
+// 是否把可以合并的绘制用glMultiDrawElementsIndirect提交（还需要GL 4.3）
+#define ENABLE_MULTI_DRAW_INDIRECT 1
+
+// 正浮点数的位模式与数值同序，取高16位即可得到单调的深度量化值，不需要知道远平面
+static uint16_t quantizeDepth(float depth) {
+    depth = std::max(depth, 0.0f);
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+void appendDrawRecord(const Mesh& mesh, const glm::mat4& transform, std::vector<glm::vec4>& records) {
+    const PBR_Material& material = mesh.material;
+    bool packed = mesh.vertexFormat == VertexFormat::Packed;
+    records.push_back(transform[0]);
+    records.push_back(transform[1]);
+    records.push_back(transform[2]);
+    records.push_back(transform[3]);
+    records.push_back(glm::vec4(packed ? mesh.positionScale() : glm::vec3(1.0f), packed ? 1.0f : 0.0f));
+    records.push_back(glm::vec4(packed ? mesh.positionBias() : glm::vec3(0.0f), 0.0f));
+    records.push_back(glm::vec4(material.basecolor, 1.0f));
+    records.push_back(glm::vec4(material.emissionColor, 1.0f));
+    records.push_back(glm::vec4(material.metallic, material.roughness, material.ao, 0.0f));
+}
+
+uint16_t RenderQueue::textureSetId(const PBR_Material& material) {
+    // 只有启用的贴图参与组合
+    const GLuint ids[] = {
+        material.useAlbedoMap ? material.albedoMap.id() : 0u,
+        material.useNormalMap ? material.normalMap.id() : 0u,
+        material.useMetallicMap ? material.metallicMap.id() : 0u,
+        material.useRoughnessMap ? material.roughnessMap.id() : 0u,
+        material.useAOMap ? material.aoMap.id() : 0u,
+        material.useEmissionMap ? material.emissionMap.id() : 0u,
+    };
+    uint64_t hash = 1469598103934665603ull;
+    for (GLuint id : ids) {
+        hash ^= id;
+        hash *= 1099511628211ull;
+    }
+    auto it = textureSets.find(hash);
+    if (it != textureSets.end()) {
+        return it->second;
+    }
+    // 编号超过16位时回绕，只影响排序效果不影响正确性
+    uint16_t id = static_cast<uint16_t>(textureSets.size());
+    textureSets.emplace(hash, id);
+    return id;
+}
+
+uint64_t RenderQueue::makeKey(RenderPass pass, const Shader& shader, Mesh& mesh, float viewDepth) {
+    // 材质缓冲在第一次绘制前才创建，这里先同步，保证键里的编号有效
+    mesh.syncMaterial();
+
+    uint16_t depth = quantizeDepth(viewDepth);
+    if (pass == RENDER_PASS_TRANSPARENT) {
+        depth = static_cast<uint16_t>(0xFFFF - depth);
+    }
+    uint64_t key = 0;
+    key |= static_cast<uint64_t>(pass & 0xF) << 60;
+    key |= static_cast<uint64_t>(shader.ID & 0xFFF) << 48;
+    key |= static_cast<uint64_t>(textureSetId(mesh.material)) << 32;
+    key |= static_cast<uint64_t>(mesh.materialUBO.id & 0xFFFF) << 16;
+    key |= depth;
+    return key;
+}
+
+void RenderQueue::submit(Shader& shader, Mesh& mesh, const glm::mat4& transform, float viewDepth, RenderPass pass) {
+    items.push_back({makeKey(pass, shader, mesh, viewDepth), &shader, &mesh, &transform, 0, 0});
+}
+
+void RenderQueue::submitInstanced(Shader& shader, Mesh& mesh, GLuint vertexArray, GLsizei instanceCount,
+                                  float viewDepth, RenderPass pass) {
+    if (instanceCount <= 0) return;
+    items.push_back({makeKey(pass, shader, mesh, viewDepth), &shader, &mesh, nullptr, vertexArray, instanceCount});
+}
+
+bool RenderQueue::canMultiDraw(const DrawItem& item) const {
+    return item.instanceCount == 0 && item.mesh->geometry.block != nullptr && item.mesh->indexCount > 0;
+}
+
+bool RenderQueue::sameBatch(const DrawItem& a, const DrawItem& b) const {
+    // 通道、程序和纹理组合都在排序键的高32位里
+    return (a.key >> 32) == (b.key >> 32) && a.shader == b.shader &&
+           a.mesh->geometry.block == b.mesh->geometry.block;
+}
+
+void RenderQueue::buildBatches() {
+    batches.clear();
+    commands.clear();
+    drawData.clear();
+
+    for (size_t i = 0; i < items.size();) {
+        if (!canMultiDraw(items[i])) {
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < items.size() && canMultiDraw(items[end]) && sameBatch(items[i], items[end])) {
+            end++;
+        }
+        // 绘制序号不能超过序号缓冲的长度，超出的部分退回单独绘制
+        end = std::min(end, i + (MULTI_DRAW_MAX_DRAWS - commands.size()));
+        if (end == i) break;
+
+        batches.push_back({i, end - i, commands.size()});
+        for (size_t j = i; j < end; j++) {
+            const Mesh& mesh = *items[j].mesh;
+
+            DrawCommand command;
+            command.count = static_cast<GLuint>(mesh.indexCount);
+            command.instanceCount = 1;
+            command.firstIndex = mesh.geometry.firstIndex;
+            command.baseVertex = mesh.geometry.baseVertex;
+            command.baseInstance = static_cast<GLuint>(commands.size());
+            commands.push_back(command);
+            appendDrawRecord(mesh, *items[j].transform, drawData);
+        }
+        i = end;
+    }
+    if (commands.empty()) return;
+
+    if (commandBuffer == 0) {
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &drawDataBuffer);
+        glGenTextures(1, &drawDataTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+        GLStateTracker::get().bindTexture(DRAW_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, drawDataBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        GLDebug& debug = GLDebug::get();
+        debug.label(GL_BUFFER, commandBuffer, "RenderQueue commands");
+        debug.label(GL_BUFFER, drawDataBuffer, "RenderQueue draw data");
+        debug.label(GL_TEXTURE, drawDataTexture, "RenderQueue draw data");
+    }
+    // 整块重新指定存储，不用等上一帧的绘制读完
+    glBindBuffer(GL_TEXTURE_BUFFER, drawDataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, drawData.size() * sizeof(glm::vec4), drawData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawCommand), commands.data(), GL_STREAM_DRAW);
+    RenderStats& renderStats = RenderStats::get();
+    renderStats.trackMemory(RenderMemory::Buffers, drawDataBuffer, drawData.size() * sizeof(glm::vec4));
+    renderStats.trackMemory(RenderMemory::Buffers, commandBuffer, commands.size() * sizeof(DrawCommand));
+}
+
+void RenderQueue::drawBatch(const Batch& batch) {
+    const DrawItem& first = items[batch.first];
+    Shader& shader = *first.shader;
+    const GeometryBlock& block = *first.mesh->geometry.block;
+
+    // 同一批的贴图相同，只按第一项绑定；材质参数和模型矩阵来自drawData
+    GLStateTracker& state = GLStateTracker::get();
+    shader.use();
+    shader.setInt(shader.location(ShaderUniform::DrawMode), DRAW_MODE_MULTI);
+    first.mesh->bindTextures();
+    state.bindTexture(DRAW_DATA_TEXTURE_UNIT, GL_TEXTURE_BUFFER, drawDataTexture);
+    state.bindVertexArray(block.vertexArray);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, block.indexType,
+                                (const void*)(batch.firstCommand * sizeof(DrawCommand)),
+                                static_cast<GLsizei>(batch.count), 0);
+
+    uint64_t indices = 0;
+    for (size_t i = batch.first; i < batch.first + batch.count; i++) {
+        indices += items[i].mesh->indexCount;
+    }
+    RenderStats::get().addDraw(indices);
+}
+
+void RenderQueue::flush() {
+    PROFILE_SCOPE("RenderQueue::flush");
+    std::sort(items.begin(), items.end(),
+              [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+    stats = RenderQueueStats();
+    stats.items = static_cast<uint32_t>(items.size());
+    batches.clear();
+    if (ENABLE_MULTI_DRAW_INDIRECT && GeometryPool::get().multiDrawSupported()) {
+        buildBatches();
+    }
+
+    // 相邻项的程序、贴图和VAO相同时，状态跟踪器会跳过重复的绑定
+    size_t nextBatch = 0;
+    for (size_t i = 0; i < items.size();) {
+        if (nextBatch < batches.size() && batches[nextBatch].first == i) {
+            drawBatch(batches[nextBatch]);
+            stats.drawCalls++;
+            stats.multiDrawItems += static_cast<uint32_t>(batches[nextBatch].count);
+            i += batches[nextBatch].count;
+            nextBatch++;
+            continue;
+        }
+        const DrawItem& item = items[i];
+        if (item.instanceCount > 0) {
+            item.mesh->drawInstanced(*item.shader, item.vertexArray, item.instanceCount);
+        } else {
+            item.mesh->draw(*item.shader, *item.transform);
+        }
+        stats.drawCalls++;
+        i++;
+    }
+    if (!batches.empty()) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    items.clear();
+}
+
+void RenderQueue::release() {
+    if (drawDataTexture) {
+        GLStateTracker::get().forgetTexture(drawDataTexture);
+        glDeleteTextures(1, &drawDataTexture);
+    }
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, drawDataBuffer);
+    RenderStats::get().releaseMemory(RenderMemory::Buffers, commandBuffer);
+    if (drawDataBuffer) glDeleteBuffers(1, &drawDataBuffer);
+    if (commandBuffer) glDeleteBuffers(1, &commandBuffer);
+    drawDataTexture = drawDataBuffer = commandBuffer = 0;
+    items.clear();
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <glm.hpp>
+
+class Shader;
+struct Mesh;
+struct PBR_Material;
+
+// 每个多重间接绘制的数据在纹理缓冲中占的texel数，与pbrshader中的DRAW_RECORD_TEXELS一致
+// 0~3: 模型矩阵 | 4: 位置缩放, w为八面体法线开关 | 5: 位置偏移
+// 6: 基础颜色 | 7: 自发光颜色 | 8: 金属度, 粗糙度, AO（贴图开关由着色器变体决定）
+#define DRAW_RECORD_TEXELS 9
+
+// 按上面的布局追加一个网格的绘制数据，材质需要已同步（见Mesh::syncMaterial）
+void appendDrawRecord(const Mesh& mesh, const glm::mat4& transform, std::vector<glm::vec4>& records);
+
+// 渲染通道，排序键的最高位，小的先画
+enum RenderPass : uint8_t {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_TRANSPARENT = 1,
+};
+
+// 一次绘制
+struct DrawItem {
+    uint64_t key;
+    Shader* shader;
+    Mesh* mesh;
+    const glm::mat4* transform;  // 非实例化绘制的模型矩阵
+    GLuint vertexArray;          // 实例化绘制使用的VAO
+    GLsizei instanceCount;       // 0表示非实例化绘制
+};
+
+// 一帧的提交统计
+struct RenderQueueStats {
+    uint32_t items = 0;             // 提交的绘制项
+    uint32_t drawCalls = 0;         // 实际发出的绘制调用（一次多重间接绘制算一次）
+    uint32_t multiDrawItems = 0;    // 通过多重间接绘制提交的绘制项
+};
+
+// 渲染队列：先收集绘制项，按64位排序键排序后统一提交
+// 排序键从高到低：通道(4) | 着色器程序(12) | 纹理组合(16) | 材质(16) | 深度(16)
+// 纹理组合放在材质之前，因为每个网格都有自己的材质缓冲，而贴图往往在网格之间共享
+// 支持GL 4.3时，排序后相邻的、着色器和贴图相同且位于同一几何池块的绘制合并为一次
+// glMultiDrawElementsIndirect，模型矩阵和材质参数放在纹理缓冲中按绘制序号读取
+class RenderQueue {
+public:
+    // viewDepth为相机空间的正向距离，不透明物体从前往后，透明物体从后往前
+    void submit(Shader& shader, Mesh& mesh, const glm::mat4& transform, float viewDepth,
+                RenderPass pass = RENDER_PASS_OPAQUE);
+    void submitInstanced(Shader& shader, Mesh& mesh, GLuint vertexArray, GLsizei instanceCount,
+                         float viewDepth, RenderPass pass = RENDER_PASS_OPAQUE);
+
+    // 排序并执行所有绘制，然后清空队列
+    void flush();
+    void clear() { items.clear(); }
+    size_t size() const { return items.size(); }
+    // 释放间接绘制缓冲，需要在GL上下文销毁前调用
+    void release();
+
+    // 上一次flush的统计
+    const RenderQueueStats& getStats() const { return stats; }
+
+    // 把材质使用的贴图组合映射为16位编号，编号在整个运行期间稳定
+    uint16_t textureSetId(const PBR_Material& material);
+
+private:
+    // glMultiDrawElementsIndirect的命令格式
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+    // 连续的一段可以合并提交的绘制项
+    struct Batch {
+        size_t first;           // items中的起始位置
+        size_t count;
+        size_t firstCommand;    // commands中的起始位置
+    };
+
+    bool canMultiDraw(const DrawItem& item) const;
+    bool sameBatch(const DrawItem& a, const DrawItem& b) const;
+    // 为可以合并的绘制项生成命令和每绘制数据，并上传到GPU
+    void buildBatches();
+    void drawBatch(const Batch& batch);
+
+    uint64_t makeKey(RenderPass pass, const Shader& shader, Mesh& mesh, float viewDepth);
+
+    std::vector<DrawItem> items;
+    std::unordered_map<uint64_t, uint16_t> textureSets;
+    RenderQueueStats stats;
+
+    // 多重间接绘制，每帧重新生成
+    std::vector<Batch> batches;
+    std::vector<DrawCommand> commands;
+    std::vector<glm::vec4> drawData;    // 每个绘制DRAW_RECORD_TEXELS个texel
+    GLuint commandBuffer = 0;
+    GLuint drawDataBuffer = 0;
+    GLuint drawDataTexture = 0;         // drawDataBuffer上的RGBA32F纹理缓冲
+};
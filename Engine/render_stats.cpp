@@ -0,0 +1,79 @@
+#include "render_stats.h"
+#include "log.h"
+#include <algorithm>
+
+RenderStats& RenderStats::get() {
+    static RenderStats instance;
+    return instance;
+}
+
+RenderStats::RenderStats() = default;
+
+void RenderStats::addDraw(uint64_t indexCount, uint64_t instances) {
+    add(RenderCounter::DrawCalls);
+    add(RenderCounter::Triangles, indexCount / 3 * instances);
+    if (instances > 1) {
+        add(RenderCounter::Instances, instances);
+    }
+}
+
+void RenderStats::endFrame(double frameTime) {
+    std::copy(std::begin(current), std::end(current), std::begin(last));
+    std::fill(std::begin(current), std::end(current), 0);
+    frameTimes[frameTimeNext] = static_cast<float>(frameTime * 1000.0);
+    frameTimeNext = (frameTimeNext + 1) % RENDER_STATS_HISTORY;
+}
+
+void RenderStats::trackMemory(RenderMemory kind, GLuint object, size_t bytes) {
+    if (object == 0) return;
+    size_t index = static_cast<size_t>(kind);
+    size_t& size = memoryObjects[index][object];
+    memoryTotals[index] = memoryTotals[index] - size + bytes;
+    size = bytes;
+}
+
+void RenderStats::releaseMemory(RenderMemory kind, GLuint object) {
+    size_t index = static_cast<size_t>(kind);
+    auto it = memoryObjects[index].find(object);
+    if (it == memoryObjects[index].end()) return;
+    memoryTotals[index] -= it->second;
+    memoryObjects[index].erase(it);
+}
+
+size_t RenderStats::textureBytes(int width, int height, int bytesPerPixel, bool mipmapped) {
+    size_t bytes = static_cast<size_t>(width) * height * bytesPerPixel;
+    while (mipmapped && (width > 1 || height > 1)) {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        bytes += static_cast<size_t>(width) * height * bytesPerPixel;
+    }
+    return bytes;
+}
+
+const char* RenderStats::counterName(RenderCounter counter) {
+    switch (counter) {
+    case RenderCounter::DrawCalls: return "绘制调用";
+    case RenderCounter::Triangles: return "三角形";
+    case RenderCounter::Instances: return "实例";
+    case RenderCounter::PointLights: return "点光源";
+    case RenderCounter::ShadowCascade0: return "阴影级联0绘制";
+    case RenderCounter::ShadowCascade1: return "阴影级联1绘制";
+    case RenderCounter::ShadowCascade2: return "阴影级联2绘制";
+    case RenderCounter::ShadowCascade3: return "阴影级联3绘制";
+    case RenderCounter::ProgramChanges: return "程序切换";
+    case RenderCounter::TextureBinds: return "纹理绑定";
+    case RenderCounter::VertexArrayBinds: return "VAO绑定";
+    case RenderCounter::UniformBufferBinds: return "UBO绑定";
+    default: return "未知";
+    }
+}
+
+void RenderStats::logLastFrame() const {
+    for (size_t i = 0; i < static_cast<size_t>(RenderCounter::Count); i++) {
+        LOG_INFO("RenderStats: {} {}", counterName(static_cast<RenderCounter>(i)), last[i]);
+    }
+    LOG_INFO("RenderStats: 显存 缓冲 {:.1f} MB，纹理 {:.1f} MB，渲染缓冲 {:.1f} MB",
+                 memoryUsed(RenderMemory::Buffers) / 1048576.0,
+                 memoryUsed(RenderMemory::Textures) / 1048576.0,
+                 memoryUsed(RenderMemory::Renderbuffers) / 1048576.0);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// 保留多少帧的帧时间，用于界面上的曲线
+#define RENDER_STATS_HISTORY 240
+
+// 每帧清零的计数
+enum class RenderCounter : uint32_t {
+    DrawCalls,          // 绘制调用，一次多重间接绘制算一次
+    Triangles,          // GPU剔除的间接绘制按剔除前的数量计算，是上限
+    Instances,          // 实例化绘制的实例数
+    PointLights,        // 参与光照的点光源：分簇或延迟渲染时为视锥剔除之后的数量
+    ShadowCascade0,     // 各级联阴影的绘制调用，沿用缓存的级联为0
+    ShadowCascade1,
+    ShadowCascade2,
+    ShadowCascade3,
+    ProgramChanges,     // 以下为状态跟踪器实际下发的切换
+    TextureBinds,
+    VertexArrayBinds,
+    UniformBufferBinds,
+    Count,
+};
+
+// 按对象记录的显存占用
+enum class RenderMemory : uint32_t {
+    Buffers,
+    Textures,
+    Renderbuffers,
+    Count,
+};
+
+// 渲染统计
+// 绘制和绑定的地方直接累加计数，Renderer每帧结束时调用endFrame保存一帧的结果并清零，
+// 界面显示和无头模式的日志读的是同一份数据。
+// 显存按对象名记录分配时的大小（重新分配时覆盖），删除对象前需要调用release，
+// 纹理大小是按格式估算的，不包括驱动的对齐和压缩。
+class RenderStats {
+public:
+    static RenderStats& get();
+
+    void add(RenderCounter counter, uint64_t amount = 1) {
+        current[static_cast<size_t>(counter)] += amount;
+    }
+    // 记录一次绘制：调用数、三角形数和实例数
+    void addDraw(uint64_t indexCount, uint64_t instances = 1);
+
+    // 结束一帧，frameTime为这一帧的时间（秒）
+    void endFrame(double frameTime);
+    // 上一帧的计数
+    uint64_t lastFrame(RenderCounter counter) const { return last[static_cast<size_t>(counter)]; }
+
+    void trackMemory(RenderMemory kind, GLuint object, size_t bytes);
+    void releaseMemory(RenderMemory kind, GLuint object);
+    size_t memoryUsed(RenderMemory kind) const { return memoryTotals[static_cast<size_t>(kind)]; }
+    // 2D纹理的估算大小，mipmapped时包括完整的mip链
+    static size_t textureBytes(int width, int height, int bytesPerPixel, bool mipmapped);
+
+    // 帧时间曲线（毫秒），从frameTimeOffset开始是最旧的一帧
+    const float* frameTimeHistory() const { return frameTimes; }
+    int frameTimeOffset() const { return static_cast<int>(frameTimeNext); }
+
+    // 把上一帧的计数和显存占用写入日志
+    void logLastFrame() const;
+    static const char* counterName(RenderCounter counter);
+
+private:
+    RenderStats();
+    RenderStats(const RenderStats&) = delete;
+    RenderStats& operator=(const RenderStats&) = delete;
+
+    uint64_t current[static_cast<size_t>(RenderCounter::Count)] = {};
+    uint64_t last[static_cast<size_t>(RenderCounter::Count)] = {};
+
+    std::unordered_map<GLuint, size_t> memoryObjects[static_cast<size_t>(RenderMemory::Count)];
+    size_t memoryTotals[static_cast<size_t>(RenderMemory::Count)] = {};
+
+    float frameTimes[RENDER_STATS_HISTORY] = {};
+    size_t frameTimeNext = 0;
+};
@@ -0,0 +1,182 @@
+#include "resource_manager.h"
+#include "model.h"
+#include "shader.h"
+#include "texture_loader.h"
+#include "gl_state.h"
+#include "log.h"
+#include <filesystem>
+#include <unordered_set>
+
+// 统一成规范化的绝对路径，"a/../b.png"和"b.png"落到同一个键上
+static std::string canonicalPath(const std::string& path) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    if (error) {
+        return std::filesystem::path(path).lexically_normal().generic_string();
+    }
+    return canonical.generic_string();
+}
+
+// 文件大小和修改时间，路径命中时用来判断文件是否变化，只查询元数据不读内容
+static uint64_t fileStamp(const std::string& path) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    if (error) return 0;
+    auto modified = std::filesystem::last_write_time(path, error);
+    if (error) return 0;
+    return (static_cast<uint64_t>(size) * 1099511628211ull) ^
+           static_cast<uint64_t>(modified.time_since_epoch().count());
+}
+
+TextureResource::~TextureResource() {
+    // 合并后的纹理归alias所有；上传还没完成时由加载器负责延后删除
+    if (id && !alias) TextureLoader::get().release(id);
+}
+
+ResourceManager& ResourceManager::get() {
+    static ResourceManager instance;
+    return instance;
+}
+
+template <typename T>
+size_t ResourceManager::Cache<T>::live() const {
+    // 多个路径可能指向同一个资源，按对象去重
+    std::unordered_set<const T*> alive;
+    for (const auto& entry : byPath) {
+        if (std::shared_ptr<T> resource = entry.second.resource.lock()) {
+            alive.insert(resource.get());
+        }
+    }
+    return alive.size();
+}
+
+template <typename T>
+void ResourceManager::Cache<T>::purge() {
+    for (auto it = byPath.begin(); it != byPath.end();) {
+        it = it->second.resource.expired() ? byPath.erase(it) : std::next(it);
+    }
+    for (auto it = byContent.begin(); it != byContent.end();) {
+        it = it->second.expired() ? byContent.erase(it) : std::next(it);
+    }
+}
+
+template <typename T, typename Create>
+std::shared_ptr<T> ResourceManager::acquire(Cache<T>& cache, const std::string& key, uint64_t stamp, Create create) {
+    auto pathIt = cache.byPath.find(key);
+    if (pathIt != cache.byPath.end() && pathIt->second.stamp == stamp) {
+        if (std::shared_ptr<T> resource = pathIt->second.resource.lock()) {
+            stats.pathHits++;
+            return resource;
+        }
+    }
+
+    // 路径未命中、文件已变化或资源已释放
+    std::shared_ptr<T> resource = create();
+    stats.loads++;
+    cache.byPath[key] = {stamp, resource};
+    return resource;
+}
+
+TextureHandle ResourceManager::acquireTexture(const std::string& path, bool normalMap) {
+    std::string key = canonicalPath(path);
+    return acquire(textures, key, fileStamp(key), [&]() {
+        TextureLoader& loader = TextureLoader::get();
+        // 解码线程读文件时顺带算内容哈希，上传前回到这里合并
+        loader.setDecodedCallback([this](GLuint texture, uint64_t contentHash) {
+            return mergeTexture(texture, contentHash);
+        });
+        auto texture = std::make_shared<TextureResource>();
+        // 法线贴图的占位是平坦法线(0.5, 0.5, 1.0)，其余为白色
+        texture->id = loader.request(key, normalMap ? 0xFFFF8080u : 0xFFFFFFFFu);
+        texturesById[texture->id] = texture;
+        return texture;
+    });
+}
+
+bool ResourceManager::mergeTexture(GLuint texture, uint64_t contentHash) {
+    auto idIt = texturesById.find(texture);
+    if (idIt == texturesById.end()) return false;
+    std::shared_ptr<TextureResource> resource = idIt->second.lock();
+    texturesById.erase(idIt);
+    if (!resource || contentHash == 0) return false;
+
+    auto contentIt = textures.byContent.find(contentHash);
+    if (contentIt != textures.byContent.end()) {
+        std::shared_ptr<TextureResource> existing = contentIt->second.lock();
+        if (existing && existing != resource) {
+            // 材质通过句柄读取id，下一次绑定就换成已有的纹理；这张纹理由加载器删除
+            resource->alias = existing;
+            resource->id = existing->id;
+            stats.contentHits++;
+            return true;
+        }
+    }
+    textures.byContent[contentHash] = resource;
+    return false;
+}
+
+ModelHandle ResourceManager::acquireModel(const std::string& path) {
+    std::string key = canonicalPath(path);
+    bool created = false;
+    ModelHandle model = acquire(models, key, fileStamp(key), [&]() {
+        created = true;
+        return std::make_shared<Model>(key.c_str());
+    });
+    // 模型加载时已经为网格缓存算过源文件哈希，内容相同的模型合并到先加载的那个
+    uint64_t contentHash = model->getSourceHash();
+    if (created && contentHash != 0) {
+        auto contentIt = models.byContent.find(contentHash);
+        if (contentIt != models.byContent.end()) {
+            if (ModelHandle existing = contentIt->second.lock()) {
+                stats.contentHits++;
+                models.byPath[key].resource = existing;
+                return existing;
+            }
+        }
+        models.byContent[contentHash] = model;
+    }
+    return model;
+}
+
+ShaderHandle ResourceManager::acquireShader(const std::string& vertexPath, const std::string& fragmentPath,
+                                            const std::string& defines, bool async) {
+    std::string vertexKey = canonicalPath(vertexPath);
+    std::string fragmentKey = canonicalPath(fragmentPath);
+    // 键里已经有宏，不同变体是不同的程序；顶点和片段的戳不能交换，组合时不用对称的运算
+    uint64_t stamp = fileStamp(vertexKey) ^ (fileStamp(fragmentKey) * 1099511628211ull + 0x9E3779B97F4A7C15ull);
+    return acquire(shaders, vertexKey + '|' + fragmentKey + '|' + defines, stamp,
+        [&]() {
+            Shader* created;
+            if (async) {
+                created = new Shader();
+                created->compileAsync(vertexKey.c_str(), fragmentKey.c_str(), defines);
+            } else {
+                created = new Shader(vertexKey.c_str(), fragmentKey.c_str(), defines);
+            }
+            // 程序对象随最后一个句柄删除
+            return ShaderHandle(created, [](Shader* shader) {
+                shader->discardPending();
+                if (shader->ID) {
+                    GLStateTracker::get().forgetProgram(shader->ID);
+                    glDeleteProgram(shader->ID);
+                }
+                delete shader;
+            });
+        });
+}
+
+void ResourceManager::shutdown() {
+    size_t leakedTextures = textures.live();
+    size_t leakedModels = models.live();
+    size_t leakedShaders = shaders.live();
+    if (leakedTextures || leakedModels || leakedShaders) {
+        LOG_WARN("ResourceManager: 仍有资源未释放，纹理 {}，模型 {}，着色器 {}",
+                     leakedTextures, leakedModels, leakedShaders);
+    }
+    LOG_INFO("ResourceManager: 路径命中 {}，内容命中 {}，实际加载 {}",
+                 stats.pathHits, stats.contentHits, stats.loads);
+    textures.purge();
+    models.purge();
+    shaders.purge();
+    texturesById.clear();
+}
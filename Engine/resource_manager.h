@@ -0,0 +1,89 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class Model;
+class Shader;
+
+// 纹理资源，最后一个持有者释放时删除GL纹理
+struct TextureResource {
+    GLuint id = 0;
+    // 解码后发现与已有纹理内容相同时引用那张纹理，id随之改为它的纹理，自己的纹理已删除
+    std::shared_ptr<TextureResource> alias;
+
+    TextureResource() = default;
+    TextureResource(const TextureResource&) = delete;
+    TextureResource& operator=(const TextureResource&) = delete;
+    ~TextureResource();
+};
+
+// 引用计数句柄，复制即增加引用，全部释放后GL对象随之删除
+using TextureHandle = std::shared_ptr<TextureResource>;
+using ModelHandle = std::shared_ptr<Model>;
+using ShaderHandle = std::shared_ptr<Shader>;
+
+// 全局资源管理器
+// 以规范化路径为键做O(1)查找，文件大小和修改时间不变才算命中，查找时不读文件内容。
+// 内容去重在内容哈希本来就要计算的地方完成：纹理由解码线程顺带计算，上传前与已有
+// 纹理合并；模型使用加载时为网格缓存算出的源文件哈希。着色器只按路径和宏区分。
+// 管理器只持有弱引用，资源的生命周期完全由句柄决定。
+class ResourceManager {
+public:
+    static ResourceManager& get();
+
+    // 获取纹理，normalMap只影响解码完成前的占位颜色
+    TextureHandle acquireTexture(const std::string& path, bool normalMap = false);
+    // 获取模型，网格和纹理在模型析构时释放
+    ModelHandle acquireModel(const std::string& path);
+    // 获取着色器程序，键由两个源文件和插入的宏共同决定
+    // async为true时新建的程序只提交编译，需要调用Shader::poll完成
+    ShaderHandle acquireShader(const std::string& vertexPath, const std::string& fragmentPath,
+                               const std::string& defines = std::string(), bool async = false);
+
+    // 清理过期条目并报告仍被持有的资源，需要在GL上下文销毁前调用
+    void shutdown();
+
+    // 命中统计
+    struct Stats {
+        size_t pathHits = 0;      // 按路径命中
+        size_t contentHits = 0;   // 路径不同但内容相同，合并到已有资源
+        size_t loads = 0;         // 真正创建的资源
+    };
+    const Stats& getStats() const { return stats; }
+
+private:
+    ResourceManager() = default;
+    ResourceManager(const ResourceManager&) = delete;
+    ResourceManager& operator=(const ResourceManager&) = delete;
+
+    // 一类资源的索引
+    template <typename T>
+    struct Cache {
+        struct PathEntry {
+            uint64_t stamp;             // 文件大小和修改时间，变化后重新加载
+            std::weak_ptr<T> resource;
+        };
+        std::unordered_map<std::string, PathEntry> byPath;
+        std::unordered_map<uint64_t, std::weak_ptr<T>> byContent;
+
+        size_t live() const;
+        void purge();
+    };
+
+    // 按路径和文件戳查找，未命中时调用create创建并登记
+    template <typename T, typename Create>
+    std::shared_ptr<T> acquire(Cache<T>& cache, const std::string& key, uint64_t stamp, Create create);
+    // 纹理解码完成后由TextureLoader在GL线程调用，已有内容相同的纹理时合并并返回true
+    // contentHash为0表示读取失败，只注销登记
+    bool mergeTexture(GLuint texture, uint64_t contentHash);
+
+    Cache<TextureResource> textures;
+    // 还在等待解码的纹理，解码完成时按GL名字找回资源
+    std::unordered_map<GLuint, std::weak_ptr<TextureResource>> texturesById;
+    Cache<Model> models;
+    Cache<Shader> shaders;
+    Stats stats;
+};
@@ -1,75 +1,462 @@
 #include "scene.h"
 #include "model.h"
+#include "gl_state.h"
+#include "engine_paths.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "log.h"
 #include <iostream>
 #include <filesystem>
 #include <GLFW/glfw3.h>
-#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <map>
+#include <random>
+// 是否对网格做视锥剔除，关闭时所有网格都绘制（用于对比）
+#define ENABLE_FRUSTUM_CULLING 1
+// 支持GL 4.3且所有网格都在几何池中时，静态网格由计算着色器剔除并生成间接绘制命令
+#define ENABLE_GPU_CULLING 1
+// GPU剔除时再用上一帧的深度金字塔做遮挡剔除
+#define ENABLE_OCCLUSION_CULLING 1
+// scatterPointLights的参数：半径相对场景包围盒对角线的范围、强度和随机种子
+#define POINT_LIGHT_MIN_RADIUS 0.05f
+#define POINT_LIGHT_MAX_RADIUS 0.15f
+#define POINT_LIGHT_INTENSITY 20.0f
+#define POINT_LIGHT_SEED 12345u
 Scene::Scene() : 
     lightPos(5.0f, 5.0f, 5.0f),
     lightColor(300.0f, 300.0f, 300.0f),  // PBR需要更高的光照强度
     lightIntensity(1.0f) {
-    spdlog::info("Scene: 开始初始化");
+    LOG_INFO("Scene: 开始初始化");
 }
 
 Scene::~Scene() {}
 
-bool Scene::loadModel(const std::string& path) {
-    spdlog::info("Scene: 开始加载模型文件 {}", path);
+void Scene::cleanup() {
+    // 释放模型引用，没有其他持有者时网格和纹理随之删除
+    for (auto& group : instanceGroups) {
+        group->release();
+    }
+    instanceGroups.clear();
+    models.clear();
+    modelTransforms.clear();
+    meshRefs.clear();
+    meshBounds.clear();
+    bvh.clear();
+    gpuCuller.release();
+    gpuBatches.clear();
+    gpuObjectRefs.clear();
+    gpuCulling = false;
+    bvhDirty = true;
+    renderQueue.release();
+    lightUBO.release();
+    lightClusterer.release();
+    shadowMap.release();
+    environment.release();
+    shadowMeshes.clear();
+    hasCasters = false;
+    casterBoundsVersion = ~0ull;
+}
+
+// 相对路径从模型目录查找，绝对路径直接使用
+static std::string resolveModelPath(const std::string& path) {
+    return std::filesystem::path(path).is_absolute() ? path : GL_RENDER_MODEL_DIR + path;
+}
+
+bool Scene::loadEnvironment(const std::string& path) {
+    std::string fullPath = std::filesystem::path(path).is_absolute() ? path : GL_RENDER_TEXTURE_DIR + path;
+    if (!environment.load(fullPath)) {
+        LOG_ERROR("Scene: 环境贴图加载失败 {}", fullPath);
+        return false;
+    }
+    return true;
+}
+
+bool Scene::loadModel(const std::string& path, const glm::mat4& transform) {
+    PROFILE_SCOPE("Scene::loadModel");
+    LOG_INFO("Scene: 开始加载模型文件 {}", path);
     try {
-        spdlog::debug("Scene: 创建模型实例");
-        // 使用绝对路径
-        std::string fullPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Assets/Models/" + path;
-        spdlog::info("开始加载模型: {}", fullPath);
+        LOG_DEBUG("Scene: 创建模型实例");
+        std::string fullPath = resolveModelPath(path);
+        LOG_INFO("开始加载模型: {}", fullPath);
         
         // 纹理贴图路径
-        std::string albedoPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Assets/Textures/毛发_albedo.png";
-        std::string normalPath = "c:/Users/dutou/Documents/CppPrograms/GL_Render/Assets/Textures/毛发_normal.png";
+        std::string albedoPath = GL_RENDER_TEXTURE_DIR "毛发_albedo.png";
+        std::string normalPath = GL_RENDER_TEXTURE_DIR "毛发_normal.png";
         
-        auto model = std::make_unique<Model>(fullPath.c_str());
+        ModelHandle model = ResourceManager::get().acquireModel(fullPath);
         // 设置PBR纹理
         model->setTexturePaths(albedoPath, normalPath);
         models.push_back(std::move(model));
-        spdlog::info("Scene: 模型加载完成");
+        modelTransforms.push_back(transform);
+        bvhDirty = true;
+        selectedPasses = 0;
+        LOG_INFO("Scene: 模型加载完成");
         return true;
     } catch (const std::exception& e) {
-        spdlog::error("Assimp加载模型失败: {}", e.what());
+        LOG_ERROR("Assimp加载模型失败: {}", e.what());
         return false;
     }
 }
 
-void Scene::render(Shader& shader, const glm::mat4& view, const glm::mat4& projection) {
+InstanceGroup* Scene::getInstanceGroup(const std::string& path) {
+    ModelHandle model = ResourceManager::get().acquireModel(resolveModelPath(path));
+    if (model->meshes.empty()) {
+        LOG_ERROR("Scene: 无法为空模型创建实例组: {}", path);
+        return nullptr;
+    }
+    for (auto& group : instanceGroups) {
+        if (group->getModel() == model) {
+            return group.get();
+        }
+    }
+    instanceGroups.push_back(std::make_unique<InstanceGroup>(model));
+    selectedPasses = 0;
+    staticVersion++;
+    return instanceGroups.back().get();
+}
+
+void Scene::render(ShaderVariants& shaders, const glm::mat4& view, const glm::mat4& projection) {
+    PROFILE_SCOPE("Scene::render");
     // 更新光源位置，可以根据需要修改
     //lightPos = glm::vec3(5.0f * sin(glfwGetTime()), 5.0f, 5.0f * cos(glfwGetTime()));
 
-    // 设置PBR光照参数
-    shader.setVec3("lightPositions[0]", lightPos);
-    shader.setVec3("lightColors[0]", lightColor * lightIntensity);
-    shader.setVec3("camPos", glm::vec3(view[3]));
-    shader.setFloat("lightIntensity", lightIntensity);
+    // 设置PBR光照参数，每帧上传一次
+    // 第0个是主光源，不衰减；前向渲染的点光源优先放进簇列表，延迟渲染的由光照通道绘制
+    LightBlock lights{};
+    lights.lightPositions[0] = glm::vec4(lightPos, 0.0f);
+    lights.lightColors[0] = glm::vec4(lightColor * lightIntensity, 1.0f);
+    lights.lightCount = glm::ivec4(1, 0, 0, 0);
+    if (environment.isLoaded()) {
+        lights.environment = glm::vec4(environmentIntensity, environment.maxPrefilterLod(), 0.0f, 0.0f);
+        environment.bind();
+    }
+    if (shaders.pass() == ShaderPass::Forward) {
+        if (lightClusterer.update(pointLights, view, projection)) {
+            RenderStats::get().add(RenderCounter::PointLights, lightClusterer.visibleLightCount());
+        } else {
+            // 没有分簇时点光源放在LightBlock里，每个片段遍历全部
+            size_t pointCount = std::min(pointLights.size(), static_cast<size_t>(MAX_LIGHTS - 1));
+            for (size_t i = 0; i < pointCount; i++) {
+                lights.lightPositions[i + 1] = glm::vec4(pointLights[i].position, pointLights[i].radius);
+                lights.lightColors[i + 1] = glm::vec4(pointLights[i].color, 1.0f);
+            }
+            lights.lightCount.x += static_cast<int>(pointCount);
+            RenderStats::get().add(RenderCounter::PointLights, pointCount);
+            if (pointCount < pointLights.size() && !lightsTruncatedWarned) {
+                LOG_WARN("Scene: 没有分簇光照时前向渲染最多 {} 个点光源，忽略其余 {} 个", pointCount,
+                         pointLights.size() - pointCount);
+                lightsTruncatedWarned = true;
+            }
+        }
+    }
+    lightUBO.update(&lights, sizeof(lights));
+    lightUBO.bindBase(LIGHT_BLOCK_BINDING);
+
+    // 完成已经编译好的变体，还没好的网格先用基础变体绘制
+    shaders.poll();
 
-    // 设置变换矩阵
-    shader.setMat4("view", view);
-    shader.setMat4("projection", projection);
+    // 加载新模型后所有通道都要重新选择，每个通道第一次渲染时也要选
+    if (!(selectedPasses & (1u << static_cast<uint32_t>(shaders.pass())))) {
+        selectShaders(shaders);
+    }
+    if (bvhDirty) {
+        rebuildBVH();
+    }
 
-    // 渲染所有模型
-    for (const auto& model : models) {
-        // 传递一个默认的单位模型矩阵
-        glm::mat4 modelMatrix = glm::mat4(1.0f);
-        
-        // 设置PBR材质参数
-        // 注意：这里假设模型只有一个网格，如果模型有多个网格，需要遍历网格并设置每个网格的材质
-        // 更合适的做法是在 Model::draw 或 Mesh::draw 中设置材质 uniform
-        // 但为了快速测试，暂时在这里设置第一个网格的材质
-        if (!model->meshes.empty()) {
-            shader.setVec3("albedoColor", model->meshes[0].material.basecolor);
-            shader.setFloat("ao", model->meshes[0].material.ao);
-            // 如果需要，也可以在这里设置 metallic 和 roughness 的默认值
-            shader.setFloat("metallic", model->meshes[0].material.metallic);
-            shader.setFloat("roughness", model->meshes[0].material.roughness);
+    // 阴影在场景绘制之前更新，ShadowBlock和阴影贴图在本帧的光照中使用
+    renderShadows(view, projection);
+
+    // 只绘制与视锥相交的网格，相机矩阵已由渲染器写入CameraBlock
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    if (gpuCulling) {
+        // CPU不再遍历网格，剔除结果直接作为间接绘制命令
+        if (gpuObjectsDirty) {
+            rebuildGpuObjects();
+        }
+        gpuCuller.cull(frustum, ENABLE_OCCLUSION_CULLING);
+        drawGpuBatches(shaders);
+        visibleMeshes.clear();
+        cullStats = CullStats();
+    } else if (ENABLE_FRUSTUM_CULLING) {
+        bvh.cull(frustum, visibleMeshes, cullStats);
+    } else {
+        visibleMeshes.resize(meshRefs.size());
+        for (uint32_t i = 0; i < meshRefs.size(); i++) visibleMeshes[i] = i;
+        cullStats = CullStats();
+        cullStats.drawn = static_cast<uint32_t>(meshRefs.size());
+    }
+    for (uint32_t index : visibleMeshes) {
+        const MeshRef& ref = meshRefs[index];
+        Mesh& mesh = models[ref.model]->meshes[ref.mesh];
+        // 基础变体也不可用时不绘制
+        Shader* shader = shaders.active(mesh.shaderFor(shaders.pass()));
+        if (!shader) continue;
+        // 相机看向-z，取反得到正向距离
+        float viewDepth = -(view * glm::vec4(ref.center, 1.0f)).z;
+        renderQueue.submit(*shader, mesh, modelTransforms[ref.model], viewDepth);
+    }
+
+    // 实例组：逐实例剔除后每个网格一次实例化绘制
+    instanceCullStats = CullStats();
+    for (auto& group : instanceGroups) {
+        group->update(ENABLE_FRUSTUM_CULLING ? &frustum : nullptr);
+        group->submit(renderQueue, shaders);
+        const CullStats& stats = group->getCullStats();
+        instanceCullStats.drawn += stats.drawn;
+        instanceCullStats.culled += stats.culled;
+        instanceCullStats.nodesVisited += stats.nodesVisited;
+    }
+
+    // 排序后按着色器、贴图、材质的顺序提交，相邻绘制共享的状态不再重复设置
+    renderQueue.flush();
+
+    // 本帧的深度作为下一帧遮挡剔除的依据
+    if (gpuCulling && ENABLE_OCCLUSION_CULLING) {
+        gpuCuller.buildDepthPyramid(projection * view);
+    }
+}
+
+void Scene::selectShaders(ShaderVariants& shaders) {
+    for (auto& model : models) {
+        for (Mesh& mesh : model->meshes) {
+            mesh.selectShader(shaders);
+        }
+    }
+    for (auto& group : instanceGroups) {
+        for (Mesh& mesh : group->getModel()->meshes) {
+            mesh.selectShader(shaders);
+        }
+    }
+    selectedPasses |= 1u << static_cast<uint32_t>(shaders.pass());
+}
+
+void Scene::updateCasterBounds() {
+    if (bvhDirty) {
+        rebuildBVH();
+    }
+    // 版本只增不减，总和没变说明静态网格和所有实例都没变
+    uint64_t version = staticVersion;
+    for (auto& group : instanceGroups) {
+        version += group->getVersion();
+    }
+    if (version == casterBoundsVersion) return;
+    casterBoundsVersion = version;
+
+    // 静态网格和所有实例的世界空间包围盒
+    hasCasters = false;
+    auto addBox = [this](const AABB& box) {
+        if (hasCasters) {
+            casterBounds.expand(box);
+        } else {
+            casterBounds = box;
+            hasCasters = true;
         }
+    };
+    for (const AABB& box : meshBounds) {
+        addBox(box);
+    }
+    for (auto& group : instanceGroups) {
+        for (uint32_t i = 0; i < group->size(); i++) {
+            addBox(group->getModelBounds().transformed(group->getTransform(i)));
+        }
+    }
+}
+
+void Scene::renderShadows(const glm::mat4& view, const glm::mat4& projection) {
+    static_assert(SHADOW_CASCADES == 4, "级联的统计计数和性能区间按4个级联定义");
+    static const char* const kCascadeScopes[SHADOW_CASCADES] = {
+        "Shadow::cascade0", "Shadow::cascade1", "Shadow::cascade2", "Shadow::cascade3",
+    };
+    PROFILE_SCOPE("Scene::renderShadows");
+    updateCasterBounds();
+    if (!shadows || !hasCasters || !shadowMap.init()) {
+        shadowMap.finish(false, shadowFilterRadius);
+        return;
+    }
 
-        model->draw(shader, modelMatrix, view, projection);
+    uint32_t dirty = shadowMap.update(view, projection, lightPos, casterBounds, casterBoundsVersion);
+    RenderStats& renderStats = RenderStats::get();
+    for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+        if (!(dirty & (1u << c))) continue;
+        PROFILE_SCOPE(kCascadeScopes[c]);
+        Shader& shader = shadowMap.beginCascade(c);
+        const Frustum& frustum = shadowMap.cascadeFrustum(c);
+
+        // 静态网格用BVH按级联的光源视锥剔除，池中的网格共用块的深度VAO
+        CullStats stats;
+        bvh.cull(frustum, shadowMeshes, stats);
+        uint64_t draws = 0;
+        for (uint32_t index : shadowMeshes) {
+            const MeshRef& ref = meshRefs[index];
+            models[ref.model]->meshes[ref.mesh].drawDepth(shader, modelTransforms[ref.model]);
+            draws++;
+        }
+        for (auto& group : instanceGroups) {
+            draws += group->drawDepth(frustum, shader);
+        }
+        renderStats.add(static_cast<RenderCounter>(static_cast<uint32_t>(RenderCounter::ShadowCascade0) + c), draws);
+    }
+    shadowMap.finish(true, shadowFilterRadius);
+}
+
+void Scene::scatterPointLights(uint32_t count) {
+    updateCasterBounds();
+    if (!hasCasters) {
+        LOG_WARN("Scene: 场景为空，无法摆放点光源");
+        return;
+    }
+    const AABB& bounds = casterBounds;
+
+    std::mt19937 random(POINT_LIGHT_SEED);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    float diagonal = glm::length(bounds.extent());
+    pointLights.clear();
+    pointLights.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        PointLight light;
+        light.position = bounds.min + bounds.extent() * glm::vec3(unit(random), unit(random), unit(random));
+        light.radius = diagonal * glm::mix(POINT_LIGHT_MIN_RADIUS, POINT_LIGHT_MAX_RADIUS, unit(random));
+        // 随机色相，饱和度和亮度取满
+        float hue = unit(random);
+        glm::vec3 rgb = glm::clamp(glm::abs(glm::fract(glm::vec3(hue) + glm::vec3(1.0f, 2.0f / 3.0f, 1.0f / 3.0f)) * 6.0f - 3.0f) - 1.0f,
+                                   0.0f, 1.0f);
+        light.color = rgb * POINT_LIGHT_INTENSITY;
+        pointLights.push_back(light);
+    }
+    lightsTruncatedWarned = false;
+    LOG_INFO("Scene: 摆放 {} 个点光源", count);
+}
+
+// 用网格的世界空间包围盒重建BVH
+void Scene::rebuildBVH() {
+    meshRefs.clear();
+    meshBounds.clear();
+    std::vector<AABB>& bounds = meshBounds;
+    for (uint32_t m = 0; m < models.size(); m++) {
+        const std::vector<Mesh>& meshes = models[m]->meshes;
+        for (uint32_t i = 0; i < meshes.size(); i++) {
+            // 上传失败的网格不参与绘制
+            if (meshes[i].indexCount == 0) continue;
+            AABB local;
+            local.min = meshes[i].boundsMin;
+            local.max = meshes[i].boundsMax;
+            bounds.push_back(local.transformed(modelTransforms[m]));
+            meshRefs.push_back({m, i, bounds.back().center()});
+        }
+    }
+    bvh.build(bounds);
+    bvhDirty = false;
+    staticVersion++;
+    LOG_INFO("Scene: BVH重建完成，共 {} 个网格", meshRefs.size());
+
+    // 所有网格都在几何池中、数量不超过绘制序号上限时才能整体交给GPU剔除
+    bool pooled = std::all_of(meshRefs.begin(), meshRefs.end(), [this](const MeshRef& ref) {
+        return models[ref.model]->meshes[ref.mesh].geometry.block != nullptr;
+    });
+    gpuCulling = ENABLE_GPU_CULLING && GpuCuller::supported() && GeometryPool::get().multiDrawSupported() &&
+                 pooled && !meshRefs.empty() && meshRefs.size() <= MULTI_DRAW_MAX_DRAWS && gpuCuller.init();
+    gpuObjectsDirty = true;
+    if (gpuCulling) {
+        rebuildGpuObjects();
+    }
+}
+
+void Scene::rebuildGpuObjects() {
+    // 按(几何池块, 贴图组合)分批，同一批连续排列
+    // 贴图组合相同时材质特性也相同，批内网格使用同一个着色器变体
+    std::map<std::pair<const GeometryBlock*, uint16_t>, std::vector<uint32_t>> groups;
+    for (uint32_t i = 0; i < meshRefs.size(); i++) {
+        Mesh& mesh = models[meshRefs[i].model]->meshes[meshRefs[i].mesh];
+        mesh.syncMaterial();
+        groups[{mesh.geometry.block, renderQueue.textureSetId(mesh.material)}].push_back(i);
+    }
+
+    std::vector<GpuCullObject> objects;
+    std::vector<glm::vec4> drawRecords;
+    objects.reserve(meshRefs.size());
+    drawRecords.reserve(meshRefs.size() * DRAW_RECORD_TEXELS);
+    gpuBatches.clear();
+    gpuObjectRefs.clear();
+    for (const auto& group : groups) {
+        uint32_t batch = static_cast<uint32_t>(gpuBatches.size());
+        for (uint32_t refIndex : group.second) {
+            const MeshRef& ref = meshRefs[refIndex];
+            Mesh& mesh = models[ref.model]->meshes[ref.mesh];
+            GpuCullObject object;
+            object.boundsMin = glm::vec4(meshBounds[refIndex].min, 0.0f);
+            object.boundsMax = glm::vec4(meshBounds[refIndex].max, 0.0f);
+            object.indexCount = static_cast<uint32_t>(mesh.indexCount);
+            object.firstIndex = mesh.geometry.firstIndex;
+            object.baseVertex = mesh.geometry.baseVertex;
+            object.batch = batch;
+            objects.push_back(object);
+            appendDrawRecord(mesh, modelTransforms[ref.model], drawRecords);
+            gpuObjectRefs.push_back(refIndex);
+        }
+        Mesh& first = models[meshRefs[group.second[0]].model]->meshes[meshRefs[group.second[0]].mesh];
+        gpuBatches.push_back({&first, group.first.first});
+    }
+    gpuCuller.setObjects(objects, drawRecords, static_cast<uint32_t>(gpuBatches.size()));
+    gpuObjectsDirty = false;
+    LOG_INFO("Scene: GPU剔除 {} 个网格，{} 批", objects.size(), gpuBatches.size());
+}
+
+void Scene::drawGpuBatches(const ShaderVariants& shaders) {
+    GLStateTracker& state = GLStateTracker::get();
+    gpuCuller.bindDrawData(DRAW_DATA_TEXTURE_UNIT);
+    for (uint32_t batch = 0; batch < gpuBatches.size(); batch++) {
+        const Mesh& mesh = *gpuBatches[batch].mesh;
+        Shader* shader = shaders.active(mesh.shaderFor(shaders.pass()));
+        if (!shader) continue;
+        shader->use();
+        shader->setInt(shader->location(ShaderUniform::DrawMode), DRAW_MODE_MULTI);
+        mesh.bindTextures();
+        state.bindVertexArray(gpuBatches[batch].block->vertexArray);
+        gpuCuller.drawBatch(batch, gpuBatches[batch].block->indexType);
+    }
+}
+
+bool Scene::validateGpuCulling(const glm::mat4& view, const glm::mat4& projection) {
+    if (bvhDirty) {
+        rebuildBVH();
+    }
+    if (!gpuCulling) {
+        LOG_WARN("Scene: 当前没有使用GPU剔除，无法对比");
+        return false;
+    }
+    if (gpuObjectsDirty) {
+        rebuildGpuObjects();
+    }
+
+    // 只比较视锥剔除，遮挡剔除依赖上一帧的深度，CPU端没有对应结果
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    gpuCuller.cull(frustum, false);
+    std::vector<uint32_t> gpuVisible;
+    gpuCuller.readVisible(gpuVisible);
+    for (uint32_t& index : gpuVisible) {
+        index = gpuObjectRefs[index];
+    }
+    std::sort(gpuVisible.begin(), gpuVisible.end());
+
+    std::vector<uint32_t> cpuVisible;
+    CullStats stats;
+    bvh.cull(frustum, cpuVisible, stats);
+    std::sort(cpuVisible.begin(), cpuVisible.end());
+
+    std::vector<uint32_t> onlyGpu, onlyCpu;
+    std::set_difference(gpuVisible.begin(), gpuVisible.end(), cpuVisible.begin(), cpuVisible.end(),
+                        std::back_inserter(onlyGpu));
+    std::set_difference(cpuVisible.begin(), cpuVisible.end(), gpuVisible.begin(), gpuVisible.end(),
+                        std::back_inserter(onlyCpu));
+    LOG_INFO("Scene: 剔除对比，GPU可见 {}，CPU可见 {}，仅GPU {}，仅CPU {}",
+                 gpuVisible.size(), cpuVisible.size(), onlyGpu.size(), onlyCpu.size());
+    for (uint32_t index : onlyGpu) {
+        LOG_WARN("Scene: 网格 {}/{} 仅GPU可见", meshRefs[index].model, meshRefs[index].mesh);
+    }
+    for (uint32_t index : onlyCpu) {
+        LOG_WARN("Scene: 网格 {}/{} 仅CPU可见", meshRefs[index].model, meshRefs[index].mesh);
     }
+    return onlyGpu.empty() && onlyCpu.empty();
 }
 
 void Scene::update(float deltaTime) {
@@ -7,6 +7,17 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "shader.h"
+#include "uniform_buffer.h"
+#include "resource_manager.h"
+#include "bvh.h"
+#include "instance_group.h"
+#include "render_queue.h"
+#include "gpu_culler.h"
+#include "geometry_pool.h"
+#include "light_clusterer.h"
+#include "shadow_map.h"
+#include "environment_map.h"
+#include "hdr_pipeline.h"
 
 class Model;
 
@@ -15,17 +26,118 @@ public:
     Scene();
     ~Scene();
 
-    // 加载模型
-    bool loadModel(const std::string& path);
-    // 渲染场景
-    void render(Shader& shader, const glm::mat4& view, const glm::mat4& projection);
+    // 加载模型，transform为模型到世界空间的变换
+    bool loadModel(const std::string& path, const glm::mat4& transform = glm::mat4(1.0f));
+    // 获取模型的实例组，不存在时加载模型并创建，失败返回nullptr
+    // 同一模型摆放多次时用实例组代替多次loadModel，每个网格只有一次绘制调用
+    InstanceGroup* getInstanceGroup(const std::string& path);
+    // 渲染场景，每个网格使用shaders中与其材质匹配的变体
+    void render(ShaderVariants& shaders, const glm::mat4& view, const glm::mat4& projection);
     // 更新场景
     void update(float deltaTime);
+    // 释放场景持有的GL资源，需要在上下文销毁前调用
+    void cleanup();
     // 创建PBR材质
     void createPBRMaterial(Shader& shader);
-    // PBR光照参数
+    // 主光源，方向光：lightPos是从场景指向光源的方向，不衰减，投射级联阴影
     glm::vec3 lightPos{5.0f, 5.0f, 5.0f};
     glm::vec3 lightColor{300.0f, 300.0f, 300.0f};
     float lightIntensity{1.0f};
-    std::vector<std::unique_ptr<Model>> models;
+    // 点光源，数量不限：前向渲染按簇分配给片段，延迟渲染逐个画光源体
+    // 不支持分簇光照时前向渲染只取前MAX_LIGHTS-1个
+    std::vector<PointLight> pointLights;
+    // 在场景包围盒内随机摆放count个点光源，替换已有的点光源；种子固定，每次结果相同
+    void scatterPointLights(uint32_t count);
+    // 使用延迟渲染还是前向渲染，由Renderer每帧读取，可以运行时切换
+    bool deferredShading{false};
+    // 主光源的级联阴影和PCF半径（texel），运行时可以切换
+    bool shadows{true};
+    int shadowFilterRadius{SHADOW_DEFAULT_PCF_RADIUS};
+    // 加载等距柱状HDR环境贴图作为环境光照，相对路径从贴图目录查找；失败时没有环境光
+    bool loadEnvironment(const std::string& path);
+    bool hasEnvironment() const { return environment.isLoaded(); }
+    // 环境光照的强度，0关闭
+    float environmentIntensity{1.0f};
+    // HDR场景目标、自动曝光和色调映射的设置，由Renderer每帧读取
+    HdrSettings hdr;
+    // 模型由ResourceManager共享，同一文件只加载一次
+    std::vector<ModelHandle> models;
+    // 每个模型的世界变换，与models一一对应；修改后需要调用markBoundsDirty
+    std::vector<glm::mat4> modelTransforms;
+
+    // 模型或变换改变后重建BVH
+    void markBoundsDirty() { bvhDirty = true; }
+    // 上一帧的视锥剔除统计（以网格为单位）
+    const CullStats& getCullStats() const { return cullStats; }
+    // 上一帧所有实例组的剔除统计（以实例为单位）
+    const CullStats& getInstanceCullStats() const { return instanceCullStats; }
+    // 上一帧渲染队列的提交统计
+    const RenderQueueStats& getRenderStats() const { return renderQueue.getStats(); }
+    // 修改网格材质后调用，GPU剔除使用的绘制数据需要重新上传
+    void markMaterialsDirty() { gpuObjectsDirty = true; }
+    // 静态网格是否由GPU剔除（此时getCullStats没有数据）
+    bool isGpuCulling() const { return gpuCulling; }
+    // 用同一相机分别做GPU和CPU视锥剔除并比较结果，不一致时输出差异
+    bool validateGpuCulling(const glm::mat4& view, const glm::mat4& projection);
+
+    std::vector<std::unique_ptr<InstanceGroup>> instanceGroups;
+
+private:
+    // BVH中的一项，对应一个模型的一个网格
+    struct MeshRef {
+        uint32_t model;
+        uint32_t mesh;
+        glm::vec3 center;   // 世界空间包围盒中心，用于排序键的深度
+    };
+    void rebuildBVH();
+    // 静态网格或实例变化后重新计算所有投射体的世界空间包围盒
+    void updateCasterBounds();
+    // 为主光源重画需要更新的阴影级联，并上传ShadowBlock
+    void renderShadows(const glm::mat4& view, const glm::mat4& projection);
+    // 为新加载的网格选择着色器变体
+    void selectShaders(ShaderVariants& shaders);
+    // 按批次整理GPU剔除的物体并上传
+    void rebuildGpuObjects();
+    void drawGpuBatches(const ShaderVariants& shaders);
+
+    // GPU剔除的一批：贴图组合和几何池块都相同
+    struct GpuBatch {
+        Mesh* mesh;                     // 批内任一网格，用于绑定贴图
+        const GeometryBlock* block;
+    };
+
+    BVH bvh;
+    std::vector<MeshRef> meshRefs;          // BVH物体下标到网格的映射
+    std::vector<AABB> meshBounds;           // 与meshRefs对应的世界空间包围盒
+    std::vector<uint32_t> visibleMeshes;    // 每帧剔除结果，复用避免分配
+    bool bvhDirty = true;
+    uint32_t selectedPasses = 0;            // 已经为哪些通道（ShaderPass位）选过变体，加载模型后清零
+    bool lightsTruncatedWarned = false;
+    CullStats cullStats;
+    CullStats instanceCullStats;
+    // 每帧收集可见网格，按状态排序后统一绘制
+    RenderQueue renderQueue;
+
+    // GPU剔除，支持时代替BVH剔除静态网格
+    GpuCuller gpuCuller;
+    std::vector<GpuBatch> gpuBatches;
+    std::vector<uint32_t> gpuObjectRefs;    // GPU物体下标到meshRefs下标
+    bool gpuCulling = false;
+    bool gpuObjectsDirty = true;
+
+    // 光源uniform缓冲，每帧更新一次
+    UniformBuffer lightUBO;
+    // 前向渲染的分簇光照，每帧为点光源重建簇列表
+    LightClusterer lightClusterer;
+
+    // 主光源的级联阴影，场景中的几何都是静态的，远处的级联只在投射体或光源变化时重画
+    ShadowMap shadowMap;
+    std::vector<uint32_t> shadowMeshes;     // 每个级联的剔除结果，复用避免分配
+    AABB casterBounds;
+    bool hasCasters = false;
+    uint64_t staticVersion = 0;             // 重建BVH或新增实例组时递增
+    uint64_t casterBoundsVersion = ~0ull;   // casterBounds对应的staticVersion与各实例组版本之和
+
+    // 基于图像的环境光照，预计算结果缓存在环境贴图旁
+    EnvironmentMap environment;
 };
\ No newline at end of file
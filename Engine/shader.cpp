@@ -1,130 +1,513 @@
 #include "shader.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include "light_clusterer.h"
+#include "profiler.h"
+#include "gl_debug.h"
+#include "log.h"
 #include <fstream>
 #include <sstream>
-#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+// GL_KHR_parallel_shader_compile，glad没有生成这个扩展
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// 与ShaderUniform枚举顺序一致
+static const char* kBuiltinUniformNames[] = {
+    "model",
+    "positionScale",
+    "positionBias",
+    "octNormals",
+    "drawMode",
+};
+static_assert(sizeof(kBuiltinUniformNames) / sizeof(kBuiltinUniformNames[0]) == static_cast<size_t>(ShaderUniform::Count),
+    "kBuiltinUniformNames与ShaderUniform不一致");
+
+// 与ShaderFeature的位顺序一致
+static const char* kFeatureDefines[] = {
+    "HAS_ALBEDO_MAP",
+    "HAS_NORMAL_MAP",
+    "HAS_METALLIC_MAP",
+    "HAS_ROUGHNESS_MAP",
+    "HAS_AO_MAP",
+    "HAS_EMISSION_MAP",
+};
+
+std::string shaderFeatureDefines(uint32_t features) {
+    std::string defines;
+    for (size_t i = 0; i < sizeof(kFeatureDefines) / sizeof(kFeatureDefines[0]); i++) {
+        if (features & (1u << i)) {
+            defines += "#define ";
+            defines += kFeatureDefines[i];
+            defines += '\n';
+        }
+    }
+    return defines;
+}
+
+// #version必须是第一条语句，宏插在它的下一行
+static std::string injectDefines(const std::string& source, const std::string& defines) {
+    if (defines.empty()) return source;
+    size_t version = source.find("#version");
+    if (version == std::string::npos) return defines + source;
+    size_t lineEnd = source.find('\n', version);
+    if (lineEnd == std::string::npos) return source + '\n' + defines;
+    return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+// 读取着色器源文件，失败时code为空，编译时报错
+static void readShaderFile(const char* path, std::string& code) {
+    std::ifstream shaderFile;
+    // 保证ifstream对象可以抛出异常
+    shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try {
+        shaderFile.open(path);
+        std::stringstream shaderStream;
+        // 读取文件的缓冲内容到数据流中
+        shaderStream << shaderFile.rdbuf();
+        shaderFile.close();
+        code = shaderStream.str();
+    } catch(std::ifstream::failure& e) {
+        LOG_ERROR("ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: {}: {}", path, e.what());
+    }
+}
+
+// 去掉目录的文件名
+static std::string shaderFileName(const char* path) {
+    std::string name(path);
+    size_t slash = name.find_last_of("/\\");
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
 
 Shader::Shader()
 {
     ID=0;
+    for (GLint& loc : builtinLocations) loc = -1;
 }
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath)
+    : Shader(vertexPath, fragmentPath, std::string())
+{
+}
+
+Shader::Shader(const char *vertexPath, const char *fragmentPath, const std::string& defines)
+    : Shader()
 {
+    // 同步构造：提交后立即等待结果
+    compileAsync(vertexPath, fragmentPath, defines);
+    poll(true);
+}
+
+Shader::Shader(const char* computePath)
+    : Shader()
+{
+    std::string computeCode;
+    readShaderFile(computePath, computeCode);
+    debugName = shaderFileName(computePath);
+    submit({{GL_COMPUTE_SHADER, computeCode}});
+    poll(true);
+}
+
+bool Shader::parallelCompileSupported() {
+    // glad没有生成扩展，直接查扩展字符串；ARB版本的枚举值相同
+    static int supported = -1;
+    if (supported < 0) {
+        supported = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+                         std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0)) {
+                supported = 1;
+                break;
+            }
+        }
+    }
+    return supported != 0;
+}
+
+void Shader::compileAsync(const char* vertexPath, const char* fragmentPath, const std::string& defines) {
     // 1. 从文件路径中获取顶点/片段着色器
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-
-    // 保证ifstream对象可以抛出异常
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    readShaderFile(vertexPath, vertexCode);
+    readShaderFile(fragmentPath, fragmentCode);
+    debugName = shaderFileName(vertexPath) + "+" + shaderFileName(fragmentPath);
+    if (!defines.empty()) {
+        // 宏每行一个，名字里换成空格
+        std::string flat = defines;
+        std::replace(flat.begin(), flat.end(), '\n', ' ');
+        debugName += " [" + flat + "]";
+    }
+    submit({{GL_VERTEX_SHADER, injectDefines(vertexCode, defines)},
+            {GL_FRAGMENT_SHADER, injectDefines(fragmentCode, defines)}});
+}
 
-    try {
-        // 打开文件
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
+void Shader::submit(const std::vector<std::pair<GLenum, std::string>>& stages) {
+    // 上一次提交还没完成时直接丢弃
+    discardPending();
 
-        // 读取文件的缓冲内容到数据流中
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+    // 相同源码和宏链接过的程序直接从二进制缓存创建，不需要等待
+    uint64_t cacheKey = 1469598103934665603ull;
+    for (const auto& stage : stages) {
+        cacheKey = ProgramCache::hashSource(stage.second, cacheKey);
+    }
+    GLuint cached = ProgramCache::get().load(cacheKey);
+    if (cached) {
+        replaceProgram(cached);
+        return;
+    }
 
-        // 关闭文件处理器
-        vShaderFile.close();
-        fShaderFile.close();
+    // 2. 编译和链接只提交给驱动，错误在poll完成时检查
+    pendingProgram = glCreateProgram();
+    for (const auto& stage : stages) {
+        const char* code = stage.second.c_str();
+        GLuint shader = glCreateShader(stage.first);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        glAttachShader(pendingProgram, shader);
+        pendingShaders.push_back({stage.first, shader});
+    }
+    ProgramCache::get().prepareLink(pendingProgram);
+    glLinkProgram(pendingProgram);
+    pendingCacheKey = cacheKey;
+}
 
-        // 转换数据流到string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    } catch(std::ifstream::failure& e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+ShaderStatus Shader::poll(bool allowBlocking) {
+    if (pendingProgram) {
+        // 没有并行编译扩展时查询链接状态会等待驱动完成
+        if (parallelCompileSupported()) {
+            GLint done = GL_FALSE;
+            glGetProgramiv(pendingProgram, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done && !allowBlocking) return ShaderStatus::Pending;
+        } else if (!allowBlocking) {
+            return ShaderStatus::Pending;
+        }
+        finishPending();
     }
+    return status();
+}
 
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+ShaderStatus Shader::status() const {
+    if (pendingProgram) return ShaderStatus::Pending;
+    return ID ? ShaderStatus::Ready : ShaderStatus::Failed;
+}
 
-    // 2. 编译着色器
-    unsigned int vertex, fragment;
+void Shader::finishPending() {
+    bool compiled = true;
+    for (const auto& shader : pendingShaders) {
+        const char* type = shader.first == GL_VERTEX_SHADER ? "VERTEX"
+                         : shader.first == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE";
+        compiled = checkCompileErrors(shader.second, type) && compiled;
+    }
+    bool linked = checkCompileErrors(pendingProgram, "PROGRAM");
 
-    // 顶点着色器
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    // 删除着色器，它们已经链接到程序中，不再需要了
+    for (const auto& shader : pendingShaders) {
+        glDeleteShader(shader.second);
+    }
+    pendingShaders.clear();
 
-    // 片段着色器
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    GLuint program = pendingProgram;
+    pendingProgram = 0;
+    if (!compiled || !linked) {
+        // 热重载失败时保留原来的程序
+        glDeleteProgram(program);
+        return;
+    }
+    ProgramCache::get().store(program, pendingCacheKey);
+    replaceProgram(program);
+}
 
-    // 着色器程序
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+void Shader::discardPending() {
+    for (const auto& shader : pendingShaders) {
+        glDeleteShader(shader.second);
+    }
+    pendingShaders.clear();
+    if (pendingProgram) {
+        glDeleteProgram(pendingProgram);
+        pendingProgram = 0;
+    }
+}
 
-    // 删除着色器，它们已经链接到程序中，不再需要了
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+void Shader::replaceProgram(GLuint program) {
+    if (ID) {
+        GLStateTracker::get().forgetProgram(ID);
+        glDeleteProgram(ID);
+    }
+    ID = program;
+    reflect();
+    GLDebug::get().label(GL_PROGRAM, ID, debugName);
 }
 
 void Shader::use() {
-    glUseProgram(ID);
+    GLStateTracker::get().useProgram(ID);
 }
 
 // 设置布尔类型的uniform变量
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(getUniformLocation(name), (int)value);
 }
 
 // 设置整数类型的uniform变量
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(getUniformLocation(name), value);
+}
+
+// 设置无符号整数类型的uniform变量
+void Shader::setUint(const std::string &name, unsigned int value) const {
+    glUniform1ui(getUniformLocation(name), value);
 }
 
 // 设置浮点数类型的uniform变量
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(getUniformLocation(name), value);
 }
 
 // 设置3维向量类型的uniform变量
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(getUniformLocation(name), 1, &value[0]);
+}
+
+// 设置4维向量类型的uniform变量
+void Shader::setVec4(const std::string &name, const glm::vec4 &value) const {
+    glUniform4fv(getUniformLocation(name), 1, &value[0]);
+}
+
+// 设置2维向量类型的uniform变量
+void Shader::setVec2(const std::string &name, const glm::vec2 &value) const {
+    glUniform2fv(getUniformLocation(name), 1, &value[0]);
+}
+
+// 设置2维整数向量类型的uniform变量
+void Shader::setIVec2(const std::string &name, const glm::ivec2 &value) const {
+    glUniform2i(getUniformLocation(name), value.x, value.y);
 }
 
 // 设置4x4矩阵类型的uniform变量
 void Shader::setMat4(const std::string &name, const glm::mat4 &value) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &value[0][0]);
+    glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &value[0][0]);
+}
+
+void Shader::setInt(GLint location, int value) const {
+    glUniform1i(location, value);
+}
+
+void Shader::setFloat(GLint location, float value) const {
+    glUniform1f(location, value);
+}
+
+void Shader::setVec3(GLint location, const glm::vec3 &value) const {
+    glUniform3fv(location, 1, &value[0]);
+}
+
+void Shader::setMat4(GLint location, const glm::mat4 &value) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+GLint Shader::getUniformLocation(const std::string &name) const {
+    auto it = uniformLocations.find(name);
+    return it != uniformLocations.end() ? it->second : -1;
+}
+
+// 反射活动uniform和uniform块
+void Shader::reflect() {
+    uniformLocations.clear();
+    for (GLint& loc : builtinLocations) loc = -1;
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (!linked) return;
+
+    // 通过状态跟踪器切换，不恢复之前的程序：它可能已被删除，只因为是当前程序才还没释放
+    GLStateTracker::get().useProgram(ID);
+
+    // 活动uniform：块内成员的位置为-1，直接跳过
+    GLint uniformCount = 0, maxNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < uniformCount; i++) {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, i, maxNameLength, nullptr, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data());
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        if (location < 0) continue;
+
+        // 数组会以"name[0]"返回，同时记录不带下标的名字和每个元素
+        size_t bracket = name.find('[');
+        if (bracket != std::string::npos) {
+            std::string baseName = name.substr(0, bracket);
+            uniformLocations[baseName] = location;
+            for (GLint element = 0; element < size; element++) {
+                std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+            }
+        } else {
+            uniformLocations[name] = location;
+        }
+
+        // 采样器绑定到固定的纹理单元，只在链接后设置一次
+        GLint unit = 0;
+        if ((type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE || type == GL_SAMPLER_BUFFER ||
+             type == GL_SAMPLER_2D_ARRAY_SHADOW) && findSamplerUnit(name.c_str(), unit)) {
+            glUniform1i(location, unit);
+        }
+    }
+
+    // uniform块按名字绑定到固定的绑定点
+    GLint blockCount = 0, maxBlockNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+    std::vector<GLchar> blockName(std::max(maxBlockNameLength, 1));
+    for (GLint i = 0; i < blockCount; i++) {
+        glGetActiveUniformBlockName(ID, i, maxBlockNameLength, nullptr, blockName.data());
+        GLuint binding = 0;
+        if (findUniformBlockBinding(blockName.data(), binding)) {
+            glUniformBlockBinding(ID, i, binding);
+        } else {
+            LOG_WARN("WARNING::SHADER::UNKNOWN_UNIFORM_BLOCK: {}", blockName.data());
+        }
+    }
+
+    // 存储块同样按名字绑定，只有GL 4.3的着色器才会用到
+    if (GLAD_GL_VERSION_4_3) {
+        GLint storageCount = 0, maxStorageNameLength = 0;
+        glGetProgramInterfaceiv(ID, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &storageCount);
+        glGetProgramInterfaceiv(ID, GL_SHADER_STORAGE_BLOCK, GL_MAX_NAME_LENGTH, &maxStorageNameLength);
+        std::vector<GLchar> storageName(std::max(maxStorageNameLength, 1));
+        for (GLint i = 0; i < storageCount; i++) {
+            glGetProgramResourceName(ID, GL_SHADER_STORAGE_BLOCK, i, maxStorageNameLength, nullptr, storageName.data());
+            GLuint binding = 0;
+            if (findStorageBlockBinding(storageName.data(), binding)) {
+                glShaderStorageBlockBinding(ID, i, binding);
+            }
+        }
+    }
+
+    for (int i = 0; i < static_cast<int>(ShaderUniform::Count); i++) {
+        builtinLocations[i] = getUniformLocation(kBuiltinUniformNames[i]);
+    }
 }
 
 Shader::Shader(GLuint programId) : ID(programId) {
+    for (GLint& loc : builtinLocations) loc = -1;
     // 检查着色器程序是否有效
     if (!glIsProgram(programId)) {
-        std::cout << "ERROR::SHADER::INVALID_PROGRAM_ID" << std::endl;
+        LOG_ERROR("ERROR::SHADER::INVALID_PROGRAM_ID: {}", programId);
         return;
     }
     
     // 检查程序链接状态
     checkCompileErrors(programId, "PROGRAM");
+    reflect();
 }
 
-void Shader::checkCompileErrors(GLuint shader, std::string type) {
+bool Shader::checkCompileErrors(GLuint shader, std::string type) {
     GLint success;
     GLchar infoLog[1024];
     if (type != "PROGRAM") {
         glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
         if (!success) {
             glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << std::endl;
+            LOG_ERROR("ERROR::SHADER_COMPILATION_ERROR of type: {}\n{}", type, infoLog);
         }
     } else {
         glGetProgramiv(shader, GL_LINK_STATUS, &success);
         if (!success) {
             glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << std::endl;
+            LOG_ERROR("ERROR::PROGRAM_LINKING_ERROR of type: {}\n{}", type, infoLog);
         }
     }
-}
\ No newline at end of file
+    return success != 0;
+}
+
+void ShaderVariants::init(const std::string& vertex, const std::string& fragment, ShaderPass pass) {
+    release();
+    vertexPath = vertex;
+    fragmentPath = fragment;
+    shaderPass = pass;
+    // 基础变体同步编译，其他变体完成之前用它代替
+    baseShader = ResourceManager::get().acquireShader(vertexPath, fragmentPath, definesFor(0));
+    if (!baseShader->ID) {
+        LOG_ERROR("ShaderVariants: 基础变体编译失败");
+    }
+    variants.emplace(0u, baseShader);
+}
+
+Shader* ShaderVariants::get(uint32_t features) {
+    auto it = variants.find(features);
+    if (it != variants.end()) {
+        return it->second.get();
+    }
+
+    // 只提交给驱动，poll发现完成后才可用
+    ShaderHandle shader = ResourceManager::get().acquireShader(vertexPath, fragmentPath,
+                                                               definesFor(features), true);
+    LOG_INFO("ShaderVariants: 提交变体 {:#x}", features);
+    variants.emplace(features, shader);
+    return shader.get();
+}
+
+Shader* ShaderVariants::active(Shader* variant) const {
+    // 重新编译期间旧程序仍然有效，只有从未成功过的变体才用基础变体代替
+    if (variant && variant->ID) return variant;
+    return baseShader && baseShader->ID ? baseShader.get() : nullptr;
+}
+
+void ShaderVariants::poll() {
+    PROFILE_SCOPE("ShaderVariants::poll");
+    int blockingBudget = Shader::parallelCompileSupported() ? 0 : MAX_BLOCKING_SHADER_LINKS_PER_FRAME;
+    for (auto& variant : variants) {
+        Shader& shader = *variant.second;
+        if (shader.status() != ShaderStatus::Pending) continue;
+        bool block = blockingBudget > 0;
+        ShaderStatus status = shader.poll(block);
+        if (status == ShaderStatus::Pending) continue;
+        if (block) blockingBudget--;
+        if (status == ShaderStatus::Ready) {
+            LOG_INFO("ShaderVariants: 变体 {:#x} 已就绪，程序 {}", variant.first, shader.ID);
+        } else {
+            LOG_ERROR("ShaderVariants: 变体 {:#x} 编译失败，使用基础变体", variant.first);
+        }
+    }
+}
+
+size_t ShaderVariants::pendingCount() const {
+    size_t count = 0;
+    for (const auto& variant : variants) {
+        if (variant.second->status() == ShaderStatus::Pending) count++;
+    }
+    return count;
+}
+
+void ShaderVariants::reload() {
+    // 重新提交所有变体，完成前继续使用旧程序，编译失败时保留旧程序
+    for (auto& variant : variants) {
+        variant.second->compileAsync(vertexPath.c_str(), fragmentPath.c_str(), definesFor(variant.first));
+    }
+    LOG_INFO("ShaderVariants: 重新编译 {} 个变体", variants.size());
+}
+
+std::string ShaderVariants::definesFor(uint32_t features) const {
+    std::string defines = shaderFeatureDefines(features);
+    if (shaderPass == ShaderPass::GBuffer) {
+        defines += "#define GBUFFER_PASS\n";
+    } else if (LightClusterer::supported()) {
+        // 前向渲染从簇的光源列表取点光源，需要存储缓冲
+        defines += "#define CLUSTERED_LIGHTING\n";
+    }
+    return defines;
+}
+
+void ShaderVariants::release() {
+    variants.clear();
+    baseShader.reset();
+}
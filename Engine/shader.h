@@ -3,7 +3,59 @@
 
 #include <glad/glad.h>
 #include <string>
+#include <unordered_map>
 #include <glm.hpp>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "resource_manager.h"
+
+// 没有并行编译扩展时，每帧最多等待几个程序链接完成
+#define MAX_BLOCKING_SHADER_LINKS_PER_FRAME 1
+
+// 绘制循环中每次都要设置的uniform，链接时解析好位置，绘制时按下标取用
+enum class ShaderUniform {
+    Model,
+    PositionScale,
+    PositionBias,
+    OctNormals,
+    DrawMode,
+    Count
+};
+
+// 顶点着色器取模型矩阵的方式，对应drawMode uniform
+enum DrawMode : int {
+    DRAW_MODE_SINGLE = 0,       // uniform model
+    DRAW_MODE_INSTANCED = 1,    // 实例属性instanceMatrix
+    DRAW_MODE_MULTI = 2,        // 多重间接绘制，按绘制序号从drawData读取
+};
+
+// 材质特性位，每种组合编译一个着色器变体，片段着色器中对应HAS_*宏
+enum ShaderFeature : uint32_t {
+    SHADER_FEATURE_ALBEDO_MAP = 1u << 0,
+    SHADER_FEATURE_NORMAL_MAP = 1u << 1,
+    SHADER_FEATURE_METALLIC_MAP = 1u << 2,
+    SHADER_FEATURE_ROUGHNESS_MAP = 1u << 3,
+    SHADER_FEATURE_AO_MAP = 1u << 4,
+    SHADER_FEATURE_EMISSION_MAP = 1u << 5,
+};
+
+// 把特性位展开为#define行，插入到#version之后
+std::string shaderFeatureDefines(uint32_t features);
+
+// 按材质选变体的渲染通道，每个网格在每个通道各选一个变体
+enum class ShaderPass {
+    Forward,    // 前向渲染，直接计算光照；支持时定义CLUSTERED_LIGHTING，点光源来自分簇列表
+    GBuffer,    // 延迟渲染的几何通道，只写G-buffer，片段着色器中对应GBUFFER_PASS宏
+    Count
+};
+
+// 异步编译的状态
+enum class ShaderStatus {
+    Pending,    // 已提交，驱动还在编译或链接
+    Ready,      // ID可用
+    Failed,     // 编译或链接失败，且没有可用的旧程序
+};
 
 class Shader {
     //构造函数
@@ -16,22 +68,101 @@ public:
 
     // 构造函数读取并构建着色器
     Shader(const char* vertexPath, const char* fragmentPath);
+    // defines插入到两个源文件的#version之后，用于编译变体
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines);
     // 从现有的着色器程序构造
     Shader(GLuint programId);
+    // 读取并构建计算着色器程序
+    explicit Shader(const char* computePath);
+
+    // 异步编译：只提交编译和链接，不检查结果，之后由poll完成
+    // 已有程序时（热重载）在新程序成功之前ID保持不变
+    void compileAsync(const char* vertexPath, const char* fragmentPath, const std::string& defines = std::string());
+    // 检查异步编译，完成时检查错误、反射并替换ID
+    // 有GL_KHR_parallel_shader_compile时不会等待；没有时只有allowBlocking为true才会等待驱动
+    ShaderStatus poll(bool allowBlocking = false);
+    ShaderStatus status() const;
+    // 丢弃未完成的编译
+    void discardPending();
+    // 驱动是否支持不阻塞地查询编译完成状态
+    static bool parallelCompileSupported();
 
     // 使用/激活程序
     void use();
 
-    // uniform工具函数
+    // uniform工具函数（按名字查反射表，不再调用glGetUniformLocation）
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
+    void setUint(const std::string &name, unsigned int value) const;
+    void setVec2(const std::string &name, const glm::vec2 &value) const;
     void setVec3(const std::string &name, const glm::vec3 &value) const;
+    void setVec4(const std::string &name, const glm::vec4 &value) const;
+    void setIVec2(const std::string &name, const glm::ivec2 &value) const;
     void setMat4(const std::string &name, const glm::mat4 &value) const;
 
+    // 按位置设置uniform，供绘制循环使用
+    void setInt(GLint location, int value) const;
+    void setFloat(GLint location, float value) const;
+    void setVec3(GLint location, const glm::vec3 &value) const;
+    void setMat4(GLint location, const glm::mat4 &value) const;
+
+    // 查询链接时反射得到的uniform位置，不存在返回-1
+    GLint getUniformLocation(const std::string &name) const;
+    // 取常用uniform的位置
+    GLint location(ShaderUniform uniform) const { return builtinLocations[static_cast<int>(uniform)]; }
+
 private:
-    // 检查着色器编译/链接错误的工具函数
-    void checkCompileErrors(GLuint shader, std::string type);
+    // 检查着色器编译/链接错误的工具函数，成功返回true
+    bool checkCompileErrors(GLuint shader, std::string type);
+    // 提交各阶段源码，缓存命中时立即替换程序
+    void submit(const std::vector<std::pair<GLenum, std::string>>& stages);
+    void finishPending();
+    // 删除旧程序，换成新程序并重新反射
+    void replaceProgram(GLuint program);
+    // 链接后反射所有活动uniform和uniform块，绑定块和采样器
+    void reflect();
+
+    // uniform名到位置的映射，链接后只建一次
+    std::unordered_map<std::string, GLint> uniformLocations;
+    GLint builtinLocations[static_cast<int>(ShaderUniform::Count)];
+
+    // 正在编译的程序和着色器
+    GLuint pendingProgram = 0;
+    std::vector<std::pair<GLenum, GLuint>> pendingShaders;
+    uint64_t pendingCacheKey = 0;
+    // 调试工具中显示的程序名：源文件名和宏
+    std::string debugName;
+};
+
+// 同一对源文件按特性位编译的变体表
+// 基础变体（不用贴图）在init时同步编译，其他变体异步编译，完成之前用基础变体绘制
+// 程序由ResourceManager共享，release后表中的指针失效
+class ShaderVariants {
+public:
+    void init(const std::string& vertexPath, const std::string& fragmentPath, ShaderPass pass = ShaderPass::Forward);
+    ShaderPass pass() const { return shaderPass; }
+    // 取特性组合对应的变体，第一次取时提交编译，返回的变体可能还不可用
+    Shader* get(uint32_t features);
+    // 绘制时实际使用的程序：变体可用时是它自己，否则是基础变体；都不可用时返回nullptr
+    Shader* active(Shader* variant) const;
+    // 每帧调用，检查提交的编译是否完成
+    void poll();
+    // 从源文件重新编译所有变体，不等待
+    void reload();
+    size_t size() const { return variants.size(); }
+    size_t pendingCount() const;
+    void release();
+
+private:
+    // 特性宏加上通道宏
+    std::string definesFor(uint32_t features) const;
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    ShaderPass shaderPass = ShaderPass::Forward;
+    ShaderHandle baseShader;
+    std::unordered_map<uint32_t, ShaderHandle> variants;
 };
 
 #endif
\ No newline at end of file
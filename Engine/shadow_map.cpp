@@ -0,0 +1,226 @@
+#include "shadow_map.h"
+#include "gl_state.h"
+#include "engine_paths.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "log.h"
+#include <algorithm>
+#include <cmath>
+#include <gtc/matrix_transform.hpp>
+
+// 深度偏移：光栅化时的斜率和常数偏移（glPolygonOffset），采样时的比较偏移和法线方向偏移（texel）
+#define SHADOW_SLOPE_BIAS 2.0f
+#define SHADOW_CONSTANT_BIAS 4.0f
+#define SHADOW_COMPARE_BIAS 0.0005f
+#define SHADOW_NORMAL_BIAS 1.5f
+
+bool ShadowMap::init() {
+    if (initialized || failed) return initialized;
+    depthShader = ResourceManager::get().acquireShader(GL_RENDER_SHADER_DIR "shadow_depth.vert",
+                                                       GL_RENDER_SHADER_DIR "shadow_depth.frag");
+    if (!depthShader->ID) {
+        LOG_ERROR("ShadowMap: 深度着色器编译失败，关闭阴影");
+        depthShader.reset();
+        failed = true;
+        return false;
+    }
+
+    // 每个级联一层，开启深度比较，着色器用sampler2DArrayShadow采样
+    // 线性过滤时硬件对相邻的2x2个比较结果插值
+    glGenTextures(1, &depthTexture);
+    GLStateTracker::get().bindTexture(SHADOW_MAP_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    static const GLfloat border[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    RenderStats::get().trackMemory(RenderMemory::Textures, depthTexture,
+                                   RenderStats::textureBytes(SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 4, false) * SHADOW_CASCADES);
+    GLDebug::get().label(GL_TEXTURE, depthTexture, "ShadowMap cascades");
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    GLDebug::get().label(GL_FRAMEBUFFER, framebuffer, "ShadowMap");
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    if (!complete) {
+        LOG_ERROR("ShadowMap: 阴影帧缓冲不完整，关闭阴影");
+        release();
+        failed = true;
+        return false;
+    }
+
+    initialized = true;
+    LOG_INFO("ShadowMap: {} 个级联，{}x{}", SHADOW_CASCADES, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    return true;
+}
+
+uint32_t ShadowMap::update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection,
+                           const AABB& casterBounds, uint64_t casterVersion) {
+    glm::vec3 direction = glm::normalize(lightDirection);
+    bool lightChanged = direction != cachedLightDirection;
+    bool castersChanged = casterVersion != cachedCasterVersion;
+    cachedLightDirection = direction;
+    cachedCasterVersion = casterVersion;
+
+    // glm::perspective的投影矩阵中取出近远平面
+    float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+    float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+    float shadowFar = std::min(zFar, SHADOW_DISTANCE);
+
+    // 视锥近远平面的世界空间角点，切片的角点在两者之间按视空间深度线性插值
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    glm::vec3 nearCorners[4], farCorners[4];
+    for (int i = 0; i < 4; i++) {
+        float x = (i & 1) ? 1.0f : -1.0f;
+        float y = (i & 2) ? 1.0f : -1.0f;
+        glm::vec4 nearCorner = inverseViewProjection * glm::vec4(x, y, -1.0f, 1.0f);
+        glm::vec4 farCorner = inverseViewProjection * glm::vec4(x, y, 1.0f, 1.0f);
+        nearCorners[i] = glm::vec3(nearCorner) / nearCorner.w;
+        farCorners[i] = glm::vec3(farCorner) / farCorner.w;
+    }
+
+    // 光源空间沿光的传播方向看，不带平移，级联的位置由正交投影的范围决定
+    glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), -direction, up);
+
+    uint32_t dirty = 0;
+    float sliceNear = zNear;
+    for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+        // 实用分割方案：对数分割和均匀分割的加权
+        float ratio = static_cast<float>(c + 1) / SHADOW_CASCADES;
+        float logSplit = zNear * std::pow(shadowFar / zNear, ratio);
+        float uniformSplit = zNear + (shadowFar - zNear) * ratio;
+        float sliceFar = glm::mix(uniformSplit, logSplit, SHADOW_SPLIT_LAMBDA);
+
+        // 切片的包围球，半径只取决于切片的形状，取整后相机旋转时不变
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        float nearT = (sliceNear - zNear) / (zFar - zNear);
+        float farT = (sliceFar - zNear) / (zFar - zNear);
+        for (int i = 0; i < 4; i++) {
+            corners[i] = glm::mix(nearCorners[i], farCorners[i], nearT);
+            corners[i + 4] = glm::mix(nearCorners[i], farCorners[i], farT);
+            center += corners[i] + corners[i + 4];
+        }
+        center /= 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - center));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        Cascade& cascade = cascades[c];
+        cascade.splitFar = sliceFar;
+        sliceNear = sliceFar;
+        bool cached = c >= SHADOW_FIRST_CACHED_CASCADE;
+        if (cached && cascade.valid && !lightChanged && !castersChanged &&
+            glm::length(center - cascade.center) + radius <= cascade.radius) {
+            continue;
+        }
+        // 缓存的级联多覆盖一圈，相机移动一段距离内都不用重画
+        cascade.center = center;
+        cascade.radius = cached ? radius * SHADOW_CACHE_MARGIN : radius;
+        fitCascade(cascade, lightRotation, casterBounds);
+        cascade.valid = cached;
+        dirty |= 1u << c;
+    }
+    return dirty;
+}
+
+void ShadowMap::fitCascade(Cascade& cascade, const glm::mat4& lightRotation, const AABB& casterBounds) const {
+    // 中心在光源空间按texel对齐，相机移动时阴影贴图整texel平移，边缘不闪烁
+    float radius = cascade.radius;
+    float texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+    glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(cascade.center, 1.0f));
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    // 深度方向覆盖所有投射体，切片外朝向光源一侧的物体也能投下阴影
+    // 光源空间看向-z，近远平面是-z方向的距离
+    AABB lightBounds = casterBounds.transformed(lightRotation);
+    float zMax = std::max(lightBounds.max.z, lightCenter.z + radius) + texelSize;
+    float zMin = std::min(lightBounds.min.z, lightCenter.z - radius) - texelSize;
+    glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+                                           lightCenter.y - radius, lightCenter.y + radius, -zMax, -zMin);
+    cascade.lightViewProjection = lightProjection * lightRotation;
+    cascade.frustum = Frustum::fromMatrix(cascade.lightViewProjection);
+    cascade.texelSize = texelSize;
+}
+
+Shader& ShadowMap::beginCascade(uint32_t cascade) {
+    if (!targetSaved) {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(SHADOW_SLOPE_BIAS, SHADOW_CONSTANT_BIAS);
+        targetSaved = true;
+    }
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, static_cast<GLint>(cascade));
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    depthShader->use();
+    depthShader->setMat4("lightViewProjection", cascades[cascade].lightViewProjection);
+    return *depthShader;
+}
+
+void ShadowMap::finish(bool enabled, int pcfRadius) {
+    if (targetSaved) {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        targetSaved = false;
+    }
+
+    ShadowBlock block{};
+    if (enabled && initialized) {
+        for (uint32_t c = 0; c < SHADOW_CASCADES; c++) {
+            block.lightViewProjection[c] = cascades[c].lightViewProjection;
+            block.cascadeSplits[c] = cascades[c].splitFar;
+            block.cascadeTexelSizes[c] = cascades[c].texelSize;
+        }
+        block.params = glm::ivec4(SHADOW_CASCADES, std::clamp(pcfRadius, 0, SHADOW_MAX_PCF_RADIUS), 0, 0);
+        block.bias = glm::vec4(SHADOW_COMPARE_BIAS, SHADOW_NORMAL_BIAS, 0.0f, 0.0f);
+        GLStateTracker::get().bindTexture(SHADOW_MAP_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, depthTexture);
+    } else {
+        // 关闭期间没有重画，重新打开时所有级联都要重画
+        for (Cascade& cascade : cascades) {
+            cascade.valid = false;
+        }
+    }
+    shadowUBO.update(&block, sizeof(block));
+    shadowUBO.bindBase(SHADOW_BLOCK_BINDING);
+}
+
+void ShadowMap::release() {
+    if (depthTexture) {
+        GLStateTracker::get().forgetTexture(depthTexture);
+        RenderStats::get().releaseMemory(RenderMemory::Textures, depthTexture);
+        glDeleteTextures(1, &depthTexture);
+        depthTexture = 0;
+    }
+    if (framebuffer) {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+    depthShader.reset();
+    shadowUBO.release();
+    for (Cascade& cascade : cascades) {
+        cascade.valid = false;
+    }
+    targetSaved = false;
+    initialized = false;
+    failed = false;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <glm.hpp>
+#include "shader.h"
+#include "uniform_buffer.h"
+#include "resource_manager.h"
+#include "bvh.h"
+
+// 级联数SHADOW_CASCADES和ShadowBlock见uniform_buffer.h
+// 每个级联的分辨率
+#define SHADOW_MAP_SIZE 2048
+// 阴影覆盖的最远视空间距离，超出的部分不投影
+#define SHADOW_DISTANCE 60.0f
+// 实用分割方案中对数分割的权重，其余为均匀分割
+#define SHADOW_SPLIT_LAMBDA 0.75f
+// 从这一级开始的级联缓存静态几何，光源和静态几何不变、相机没有移出缓存范围时不重画
+#define SHADOW_FIRST_CACHED_CASCADE 2
+// 缓存级联的覆盖半径相对所需半径的倍数，越大重画越少，分辨率越低
+#define SHADOW_CACHE_MARGIN 1.5f
+// 默认的PCF半径（texel），0为单次硬件比较（线性过滤时相当于2x2 PCF）
+#define SHADOW_DEFAULT_PCF_RADIUS 1
+#define SHADOW_MAX_PCF_RADIUS 3
+
+// 方向光的级联阴影
+// 视锥按实用分割方案切成SHADOW_CASCADES段，每段取包围球，半径取整、中心在光源空间
+// 按texel对齐，相机平移和旋转时阴影边缘不闪烁。深度范围覆盖所有投射体，近处的
+// 投射体在视锥外也能投影。深度通道只使用网格的位置流（见Mesh::createDepthVertexArray）。
+// 远处的级联以更大的半径缓存，光源方向、投射体和缓存范围都没变时直接沿用上一次的结果。
+class ShadowMap {
+public:
+    // 创建阴影贴图和深度着色器，失败后不再重试
+    bool init();
+
+    // 计算本帧的级联，返回需要重画的级联（按位）
+    // lightDirection指向光源，casterVersion在投射体变化时改变
+    uint32_t update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightDirection,
+                    const AABB& casterBounds, uint64_t casterVersion);
+    // 开始绘制一个级联：绑定对应的层并清空深度，返回已设置光源矩阵的深度着色器
+    Shader& beginCascade(uint32_t cascade);
+    // 级联的光源视锥，用于剔除投射体
+    const Frustum& cascadeFrustum(uint32_t cascade) const { return cascades[cascade].frustum; }
+    // 结束本帧：恢复帧缓冲和视口，上传ShadowBlock并绑定阴影贴图
+    // enabled为false时着色器不采样阴影
+    void finish(bool enabled, int pcfRadius);
+
+    void release();
+
+private:
+    struct Cascade {
+        glm::mat4 lightViewProjection{1.0f};
+        Frustum frustum;
+        glm::vec3 center{0.0f};     // 覆盖范围的世界空间包围球
+        float radius = 0.0f;
+        float splitFar = 0.0f;
+        float texelSize = 0.0f;     // 一个texel对应的世界空间大小
+        bool valid = false;         // 缓存的内容是否可以沿用
+    };
+    // 按包围球和投射体范围计算光源矩阵
+    void fitCascade(Cascade& cascade, const glm::mat4& lightRotation, const AABB& casterBounds) const;
+
+    bool initialized = false;
+    bool failed = false;
+    GLuint depthTexture = 0;        // GL_TEXTURE_2D_ARRAY，每个级联一层
+    GLuint framebuffer = 0;
+    ShaderHandle depthShader;
+    Cascade cascades[SHADOW_CASCADES];
+    glm::vec3 cachedLightDirection{0.0f};
+    uint64_t cachedCasterVersion = 0;
+
+    // beginCascade之前绑定的帧缓冲和视口，finish时恢复
+    bool targetSaved = false;
+    GLint savedFramebuffer = 0;
+    GLint savedViewport[4] = {};
+    UniformBuffer shadowUBO;
+};
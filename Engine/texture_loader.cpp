@@ -0,0 +1,328 @@
+#include "texture_loader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stb_image.h>
+#include "gl_state.h"
+#include "profiler.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+#include "mesh_cache.h"
+#include "log.h"
+
+// 暂存PBO的数量，GPU读取一个时CPU可以写下一个
+#define STAGING_BUFFER_COUNT 4
+
+TextureLoader& TextureLoader::get() {
+    static TextureLoader instance;
+    return instance;
+}
+
+TextureLoader::TextureLoader() : pending(0), stopping(false), nextStaging(0), persistentMapping(false) {}
+
+TextureLoader::~TextureLoader() {
+    // 正常流程应当已经调用过shutdown，这里只保证线程被回收
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void TextureLoader::startWorkers() {
+    // 留一个核心给GL线程，hardware_concurrency可能返回0
+    unsigned int cores = std::thread::hardware_concurrency();
+    unsigned int workerCount = cores > 1 ? cores - 1 : 1;
+    stopping = false;
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&TextureLoader::workerLoop, this);
+    }
+    staging.resize(STAGING_BUFFER_COUNT);
+    // 4.4起可以用持久映射的PBO，省掉每次上传的映射/解除映射
+    persistentMapping = GLAD_GL_VERSION_4_4 != 0;
+    LOG_INFO("TextureLoader: {} 个解码线程，{}PBO上传", workerCount, persistentMapping ? "持久映射" : "");
+}
+
+GLuint TextureLoader::request(const std::string& filename, uint32_t placeholderRGBA) {
+    if (workers.empty()) {
+        startWorkers();
+    }
+
+    // 先创建1x1占位纹理，材质可以立即绑定
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    GLStateTracker::get().bindTexture(0, GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholderRGBA);
+    RenderStats::get().trackMemory(RenderMemory::Textures, texture, 4);
+    // 加载完成后仍是同一个纹理对象，名字不变
+    GLDebug::get().label(GL_TEXTURE, texture, filename);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back({texture, filename});
+        pending++;
+    }
+    jobAvailable.notify_one();
+    return texture;
+}
+
+void TextureLoader::workerLoop() {
+    for (;;) {
+        DecodeJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            decoding.insert(job.texture);
+        }
+
+        DecodedImage image;
+        image.texture = job.texture;
+        image.filename = std::move(job.filename);
+        image.pixels = nullptr;
+        image.contentHash = 0;
+        // 文件只读一次：同一份字节先算内容哈希供去重，再从内存解码
+        std::ifstream file(image.filename, std::ios::binary);
+        if (file) {
+            std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            MeshCache::hashBytes(bytes.data(), bytes.size(), image.contentHash);
+            image.pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()),
+                                                 &image.width, &image.height, &image.channels, 0);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        decoding.erase(image.texture);
+        decoded.push_back(std::move(image));
+    }
+}
+
+void TextureLoader::pump(int maxUploads) {
+    PROFILE_SCOPE("TextureLoader::pump");
+    for (int uploaded = 0; uploaded < maxUploads; uploaded++) {
+        DecodedImage image;
+        bool orphan = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (decoded.empty()) return;
+            image = decoded.front();
+            decoded.pop_front();
+            orphan = orphaned.erase(image.texture) > 0;
+            if (orphan) pending--;
+        }
+
+        // 内容与已有纹理相同时，持有者已改用那张纹理，这张不必上传
+        // 读取失败时哈希为0，回调只用它清理登记
+        bool merged = !orphan && decodedCallback &&
+                      decodedCallback(image.texture, image.pixels ? image.contentHash : 0);
+        if (orphan || merged) {
+            // 纹理在解码期间已被释放或合并，现在可以安全删除，不计入上传数量
+            stbi_image_free(image.pixels);
+            GLStateTracker::get().forgetTexture(image.texture);
+            RenderStats::get().releaseMemory(RenderMemory::Textures, image.texture);
+            glDeleteTextures(1, &image.texture);
+            if (merged) {
+                LOG_DEBUG("Texture merged with identical content: {}", image.filename);
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+            uploaded--;
+            continue;
+        }
+
+        if (!image.pixels) {
+            LOG_ERROR("Texture failed to load at path: {}", image.filename);
+        } else if (!upload(image)) {
+            // 暂存缓冲都还在被GPU读取，放回队首下一帧再传，不阻塞
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_front(image);
+            return;
+        } else {
+            LOG_DEBUG("Texture loaded at path: {}", image.filename);
+        }
+
+        stbi_image_free(image.pixels);
+        std::lock_guard<std::mutex> lock(mutex);
+        pending--;
+    }
+}
+
+bool TextureLoader::acquireStaging(GLsizeiptr bytes, StagingBuffer*& buffer) {
+    StagingBuffer& slot = staging[nextStaging];
+
+    // GPU还没读完这个缓冲，不等待；带上刷新标志，保证栅栏一定会提交给GPU
+    if (slot.fence) {
+        GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) return false;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+    if (slot.pbo == 0 || slot.capacity < bytes) {
+        // 容量不够时重新创建（不可变存储不能扩容）
+        if (slot.pbo) {
+            if (slot.mapped) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            RenderStats::get().releaseMemory(RenderMemory::Buffers, slot.pbo);
+            glDeleteBuffers(1, &slot.pbo);
+            slot.mapped = nullptr;
+        }
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        slot.capacity = bytes;
+        if (persistentMapping) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot.capacity, nullptr, flags);
+            slot.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot.capacity, flags);
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.capacity, nullptr, GL_STREAM_DRAW);
+        }
+        RenderStats::get().trackMemory(RenderMemory::Buffers, slot.pbo, slot.capacity);
+    }
+
+    nextStaging = (nextStaging + 1) % staging.size();
+    buffer = &slot;
+    return true;
+}
+
+bool TextureLoader::upload(const DecodedImage& image) {
+    GLsizeiptr bytes = static_cast<GLsizeiptr>(image.width) * image.height * image.channels;
+    StagingBuffer* buffer = nullptr;
+    if (!acquireStaging(bytes, buffer)) {
+        return false;
+    }
+
+    // 把像素写入PBO，PBO当前已绑定到GL_PIXEL_UNPACK_BUFFER
+    if (buffer->mapped) {
+        std::memcpy(buffer->mapped, image.pixels, bytes);
+    } else {
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!dst) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+        std::memcpy(dst, image.pixels, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    // 格式必须与PBO中每像素的字节数一致，否则会读出缓冲区
+    GLenum format = (image.channels == 1) ? GL_RED :
+                    (image.channels == 2) ? GL_RG :
+                    (image.channels == 3) ? GL_RGB : GL_RGBA;
+
+    // 从PBO偏移0处读取像素，驱动可以异步拷贝
+    GLStateTracker::get().bindTexture(0, GL_TEXTURE_2D, image.texture);
+    // 双通道图是灰度加alpha，采样时展开成(L, L, L, A)
+    const GLint greyAlphaSwizzle[4] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+    const GLint identitySwizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA,
+                     image.channels == 2 ? greyAlphaSwizzle : identitySwizzle);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    RenderStats::get().trackMemory(RenderMemory::Textures, image.texture,
+                                   RenderStats::textureBytes(image.width, image.height, image.channels, true));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // 立即提交，否则没有交换缓冲的时候（无头初始化）栅栏可能永远不会完成
+    glFlush();
+    return true;
+}
+
+void TextureLoader::release(GLuint texture) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 解码线程正在读这个纹理的文件，名字暂时不能还给GL，避免被新纹理复用
+        if (decoding.count(texture)) {
+            orphaned.insert(texture);
+            return;
+        }
+        auto job = std::find_if(jobs.begin(), jobs.end(),
+                                [texture](const DecodeJob& j) { return j.texture == texture; });
+        if (job != jobs.end()) {
+            jobs.erase(job);
+            pending--;
+        } else {
+            auto image = std::find_if(decoded.begin(), decoded.end(),
+                                      [texture](const DecodedImage& i) { return i.texture == texture; });
+            if (image != decoded.end()) {
+                stbi_image_free(image->pixels);
+                decoded.erase(image);
+                pending--;
+            }
+        }
+    }
+    GLStateTracker::get().forgetTexture(texture);
+    RenderStats::get().releaseMemory(RenderMemory::Textures, texture);
+    glDeleteTextures(1, &texture);
+}
+
+void TextureLoader::finishAll() {
+    while (pendingCount() > 0) {
+        pump(STAGING_BUFFER_COUNT);
+        // 暂存缓冲全部占用时等待GPU读完，先把已提交的上传推给GPU
+        glFlush();
+        std::this_thread::yield();
+    }
+}
+
+size_t TextureLoader::pendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+void TextureLoader::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+    workers.clear();
+
+    // 丢弃尚未上传的数据
+    for (auto& image : decoded) {
+        stbi_image_free(image.pixels);
+    }
+    decoded.clear();
+    jobs.clear();
+    decoding.clear();
+    // 解码途中被释放的纹理已经没有持有者，这里补上删除
+    for (GLuint texture : orphaned) {
+        GLStateTracker::get().forgetTexture(texture);
+        RenderStats::get().releaseMemory(RenderMemory::Textures, texture);
+        glDeleteTextures(1, &texture);
+    }
+    orphaned.clear();
+    pending = 0;
+
+    for (auto& slot : staging) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (slot.pbo) {
+            if (slot.mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            RenderStats::get().releaseMemory(RenderMemory::Buffers, slot.pbo);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+    }
+    staging.clear();
+    nextStaging = 0;
+}
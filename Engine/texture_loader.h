@@ -0,0 +1,89 @@
+#pragma once
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// 异步纹理加载器
+// 工作线程池负责读文件、计算内容哈希和解码，GL线程每帧通过像素缓冲对象(PBO)上传有限数量的纹理。
+// request立即返回一个内容为1x1占位像素的纹理对象，真实数据上传后仍是同一个对象，
+// 材质里保存的纹理ID不需要更新。
+class TextureLoader {
+public:
+    static TextureLoader& get();
+
+    // 请求加载纹理，placeholderRGBA为真实数据到达前显示的颜色（0xAABBGGRR）
+    GLuint request(const std::string& filename, uint32_t placeholderRGBA = 0xFFFFFFFFu);
+    // 解码完成、上传之前在GL线程调用，参数为纹理和文件内容哈希；
+    // 返回true表示已有内容相同的纹理接管了它，跳过上传并删除这个纹理
+    using DecodedCallback = std::function<bool(GLuint texture, uint64_t contentHash)>;
+    void setDecodedCallback(DecodedCallback callback) { decodedCallback = std::move(callback); }
+    // GL线程每帧调用，最多上传maxUploads张已解码的纹理
+    void pump(int maxUploads);
+    // 阻塞直到所有请求都上传完成
+    void finishAll();
+    // 删除纹理；仍在排队或解码中的请求会被丢弃，解码线程正在处理的纹理等其完成后再删除
+    void release(GLuint texture);
+    // 尚未上传完成的请求数
+    size_t pendingCount() const;
+    // 停止工作线程并释放PBO，需要在GL上下文销毁前调用
+    void shutdown();
+
+private:
+    TextureLoader();
+    ~TextureLoader();
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    // 解码任务
+    struct DecodeJob {
+        GLuint texture;
+        std::string filename;
+    };
+
+    // 已解码等待上传的图像
+    struct DecodedImage {
+        GLuint texture;
+        std::string filename;
+        unsigned char* pixels;
+        int width;
+        int height;
+        int channels;
+        uint64_t contentHash;       // 文件内容的哈希，读不到文件时pixels为空
+    };
+
+    // 上传用的暂存PBO，环形使用，用栅栏判断GPU是否已经读完
+    struct StagingBuffer {
+        GLuint pbo = 0;
+        void* mapped = nullptr;     // 持久映射时的指针
+        GLsizeiptr capacity = 0;
+        GLsync fence = nullptr;
+    };
+
+    void startWorkers();
+    void workerLoop();
+    // 上传一张图像，暂存缓冲仍被GPU占用时返回false，留到下一帧
+    bool upload(const DecodedImage& image);
+    bool acquireStaging(GLsizeiptr bytes, StagingBuffer*& buffer);
+
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<DecodeJob> jobs;
+    std::deque<DecodedImage> decoded;
+    std::unordered_set<GLuint> decoding;    // 解码线程正在处理的纹理
+    std::unordered_set<GLuint> orphaned;    // 解码途中被释放的纹理，解码完成后直接删除
+    size_t pending;
+    bool stopping;
+
+    std::vector<StagingBuffer> staging;
+    size_t nextStaging;
+    bool persistentMapping;
+    DecodedCallback decodedCallback;
+};
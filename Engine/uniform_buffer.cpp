@@ -0,0 +1,114 @@
+#include "uniform_buffer.h"
+#include <cstring>
+#include "gl_state.h"
+#include "render_stats.h"
+#include "gl_debug.h"
+
+// 块名到绑定点的映射
+static const struct {
+    const char* name;
+    GLuint binding;
+} kUniformBlockBindings[] = {
+    {"CameraBlock", CAMERA_BLOCK_BINDING},
+    {"LightBlock", LIGHT_BLOCK_BINDING},
+    {"MaterialBlock", MATERIAL_BLOCK_BINDING},
+    {"ClusterBlock", CLUSTER_BLOCK_BINDING},
+    {"ShadowBlock", SHADOW_BLOCK_BINDING},
+};
+
+// 存储块名到绑定点的映射
+static const struct {
+    const char* name;
+    GLuint binding;
+} kStorageBlockBindings[] = {
+    {"ClusterLightBuffer", CLUSTER_LIGHT_BINDING},
+    {"ClusterGridBuffer", CLUSTER_GRID_BINDING},
+    {"ClusterIndexBuffer", CLUSTER_INDEX_BINDING},
+    {"LuminanceHistogram", LUMINANCE_HISTOGRAM_BINDING},
+    {"ExposureBuffer", EXPOSURE_BINDING},
+};
+
+// 采样器名到纹理单元的映射
+static const struct {
+    const char* name;
+    GLint unit;
+} kSamplerUnits[] = {
+    {"albedoMap", ALBEDO_TEXTURE_UNIT},
+    {"normalMap", NORMAL_TEXTURE_UNIT},
+    {"metallicMap", METALLIC_TEXTURE_UNIT},
+    {"roughnessMap", ROUGHNESS_TEXTURE_UNIT},
+    {"aoMap", AO_TEXTURE_UNIT},
+    {"emissionMap", EMISSION_TEXTURE_UNIT},
+    {"drawData", DRAW_DATA_TEXTURE_UNIT},
+    {"depthPyramid", DEPTH_PYRAMID_TEXTURE_UNIT},
+    {"sceneDepth", DEPTH_PYRAMID_TEXTURE_UNIT},
+    {"gAlbedoAO", GBUFFER_ALBEDO_TEXTURE_UNIT},
+    {"gNormalMaterial", GBUFFER_NORMAL_TEXTURE_UNIT},
+    {"gDepth", GBUFFER_DEPTH_TEXTURE_UNIT},
+    {"lightAccum", LIGHT_ACCUM_TEXTURE_UNIT},
+    {"hdrScene", HDR_SCENE_TEXTURE_UNIT},
+    {"shadowMap", SHADOW_MAP_TEXTURE_UNIT},
+    {"irradianceMap", IRRADIANCE_TEXTURE_UNIT},
+    {"prefilterMap", PREFILTER_TEXTURE_UNIT},
+    {"brdfLUT", BRDF_LUT_TEXTURE_UNIT},
+};
+
+void UniformBuffer::update(const void* data, GLsizeiptr bytes) {
+    bool created = id == 0;
+    if (created) {
+        glGenBuffers(1, &id);
+    }
+    size = bytes;
+    // 重新指定整块存储，驱动可以直接换一块新内存，不用等上一帧用完
+    glBindBuffer(GL_UNIFORM_BUFFER, id);
+    if (created) {
+        GLDebug::get().label(GL_BUFFER, id, "UniformBuffer");
+    }
+    glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    RenderStats::get().trackMemory(RenderMemory::Buffers, id, size);
+}
+
+void UniformBuffer::bindBase(GLuint binding) const {
+    GLStateTracker::get().bindUniformBuffer(binding, id);
+}
+
+void UniformBuffer::release() {
+    if (id) {
+        GLStateTracker::get().forgetUniformBuffer(id);
+        RenderStats::get().releaseMemory(RenderMemory::Buffers, id);
+        glDeleteBuffers(1, &id);
+    }
+    id = 0;
+    size = 0;
+}
+
+bool findUniformBlockBinding(const char* blockName, GLuint& binding) {
+    for (const auto& entry : kUniformBlockBindings) {
+        if (std::strcmp(entry.name, blockName) == 0) {
+            binding = entry.binding;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool findStorageBlockBinding(const char* blockName, GLuint& binding) {
+    for (const auto& entry : kStorageBlockBindings) {
+        if (std::strcmp(entry.name, blockName) == 0) {
+            binding = entry.binding;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool findSamplerUnit(const char* samplerName, GLint& unit) {
+    for (const auto& entry : kSamplerUnits) {
+        if (std::strcmp(entry.name, samplerName) == 0) {
+            unit = entry.unit;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm.hpp>
+#include <cstdint>
+
+// uniform块绑定点，着色器链接后按块名绑定
+enum UniformBlockBinding : GLuint {
+    CAMERA_BLOCK_BINDING = 0,   // 相机数据，每帧更新一次
+    LIGHT_BLOCK_BINDING = 1,    // 光源数据，每帧更新一次
+    MATERIAL_BLOCK_BINDING = 2, // 材质数据，材质改变时更新
+    CLUSTER_BLOCK_BINDING = 3,  // 分簇光照的网格参数，每帧更新一次
+    SHADOW_BLOCK_BINDING = 4,   // 级联阴影的光源矩阵和参数，每帧更新一次
+};
+
+// 着色器存储块绑定点，链接后按块名绑定（需要GL 4.3）
+// 计算着色器用layout(binding)直接指定，与这里一致
+enum StorageBlockBinding : GLuint {
+    CLUSTER_LIGHT_BINDING = 4,      // 视锥内的点光源
+    CLUSTER_GRID_BINDING = 5,       // 每个簇在索引列表中的起点和数量
+    CLUSTER_INDEX_BINDING = 6,      // 所有簇的光源索引列表
+    LUMINANCE_HISTOGRAM_BINDING = 7,    // HDR：每帧的log亮度直方图
+    EXPOSURE_BINDING = 8,               // HDR：适应后的平均亮度和曝光
+};
+
+// 材质贴图使用的纹理单元，着色器链接后按采样器名设置一次
+enum TextureUnit : GLint {
+    ALBEDO_TEXTURE_UNIT = 0,
+    NORMAL_TEXTURE_UNIT = 1,
+    METALLIC_TEXTURE_UNIT = 2,
+    ROUGHNESS_TEXTURE_UNIT = 3,
+    AO_TEXTURE_UNIT = 4,
+    EMISSION_TEXTURE_UNIT = 5,
+    MATERIAL_TEXTURE_UNIT_COUNT = 6,
+    DRAW_DATA_TEXTURE_UNIT = 6,     // 多重间接绘制的每绘制数据（纹理缓冲）
+    DEPTH_PYRAMID_TEXTURE_UNIT = 7, // GPU剔除的深度金字塔及其来源深度
+    GBUFFER_ALBEDO_TEXTURE_UNIT = 8,    // 延迟渲染：反照率和AO
+    GBUFFER_NORMAL_TEXTURE_UNIT = 9,    // 延迟渲染：八面体法线、粗糙度和金属度
+    GBUFFER_DEPTH_TEXTURE_UNIT = 10,    // 延迟渲染：深度，用于重建位置
+    LIGHT_ACCUM_TEXTURE_UNIT = 11,      // 延迟渲染：光照累加结果
+    HDR_SCENE_TEXTURE_UNIT = 11,        // HDR：解析后的场景颜色，合成之后才使用，与光照累加共用
+    SHADOW_MAP_TEXTURE_UNIT = 12,       // 级联阴影贴图（深度比较）
+    IRRADIANCE_TEXTURE_UNIT = 13,       // IBL：漫反射辐照度立方体贴图
+    PREFILTER_TEXTURE_UNIT = 14,        // IBL：按粗糙度预过滤的镜面立方体贴图
+    BRDF_LUT_TEXTURE_UNIT = 15,         // IBL：分裂求和的BRDF查找表
+};
+
+// 与pbrshader.frag中的MAX_LIGHTS保持一致
+// 第0个是主光源；不支持分簇光照时其余是场景的点光源，前向渲染每个片段遍历所有光源
+#define MAX_LIGHTS 256
+// 与pbrshader.frag和deferred_light.frag中的SHADOW_CASCADES保持一致
+#define SHADOW_CASCADES 4
+
+// 以下结构体与着色器中的std140布局逐字节对应
+
+// 相机数据
+struct alignas(16) CameraBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 camPos;           // xyz: 相机位置
+};
+
+// 光源数据
+struct alignas(16) LightBlock {
+    glm::vec4 lightPositions[MAX_LIGHTS];   // xyz: 位置，w: 影响半径，0表示方向光（xyz为指向光源的方向）
+    glm::vec4 lightColors[MAX_LIGHTS];      // rgb: 颜色（已乘强度）
+    glm::ivec4 lightCount;                  // x: 光源数量
+    glm::vec4 environment;                  // x: IBL强度，0表示没有环境光，y: 预过滤贴图的最大mip
+};
+
+// 材质数据，贴图开关由着色器变体决定，不在缓冲中
+struct alignas(16) MaterialBlock {
+    glm::vec4 albedoColor;      // rgb: 基础颜色
+    glm::vec4 emissionColor;    // rgb: 自发光颜色
+    float metallic;
+    float roughness;
+    float ao;
+};
+
+// 分簇光照的网格参数，与pbrshader.frag中的ClusterBlock一致
+struct alignas(16) ClusterBlock {
+    glm::uvec4 gridSize;        // xyz: 簇的数量，w: 为0时簇列表不可用，只用LightBlock
+    glm::vec4 screenToTile;     // xy: 视口原点，zw: 每像素对应的簇数（1 / 簇的像素大小）
+    glm::vec4 depthSlicing;     // x, y: 深度切片 = log(视空间深度) * x + y
+};
+
+// 级联阴影参数，与着色器中的ShadowBlock一致
+struct alignas(16) ShadowBlock {
+    glm::mat4 lightViewProjection[SHADOW_CASCADES];
+    glm::vec4 cascadeSplits;        // 每个级联的视空间远端距离
+    glm::vec4 cascadeTexelSizes;    // 每个级联一个texel对应的世界空间大小，用于法线偏移
+    glm::ivec4 params;              // x: 级联数，0表示没有阴影，y: PCF半径（texel）
+    glm::vec4 bias;                 // x: 深度偏移，y: 法线偏移（texel）
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock必须符合std140布局");
+static_assert(sizeof(LightBlock) == MAX_LIGHTS * 32 + 32, "LightBlock必须符合std140布局");
+static_assert(sizeof(MaterialBlock) == 48, "MaterialBlock必须符合std140布局");
+static_assert(sizeof(ClusterBlock) == 48, "ClusterBlock必须符合std140布局");
+static_assert(sizeof(ShadowBlock) == SHADOW_CASCADES * 64 + 64, "ShadowBlock必须符合std140布局");
+
+// uniform缓冲对象
+struct UniformBuffer {
+    GLuint id = 0;
+    GLsizeiptr size = 0;
+
+    void update(const void* data, GLsizeiptr bytes); // 上传数据，首次调用时创建缓冲
+    void bindBase(GLuint binding) const;             // 绑定到绑定点
+    void release();                                  // 释放缓冲
+};
+
+// 按块名查找绑定点，未知的块返回false
+bool findUniformBlockBinding(const char* blockName, GLuint& binding);
+// 按存储块名查找绑定点，未知的块返回false
+bool findStorageBlockBinding(const char* blockName, GLuint& binding);
+// 按采样器名查找纹理单元，未知的采样器返回false
+bool findSamplerUnit(const char* samplerName, GLint& unit);
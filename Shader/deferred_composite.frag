@@ -0,0 +1,18 @@
+#version 330 core
+// 把延迟渲染的光照结果和深度写回目标帧缓冲，背景像素不写
+
+uniform sampler2D lightAccum;
+uniform sampler2D gDepth;
+// 目标视口的原点，G-buffer从(0, 0)开始
+uniform ivec2 viewportOrigin;
+
+out vec4 FragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy) - viewportOrigin;
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth >= 1.0) discard;
+    FragColor = vec4(texelFetch(lightAccum, pixel, 0).rgb, 1.0);
+    // 深度测试照常进行，之前画的网格和坐标轴按深度遮挡
+    gl_FragDepth = depth;
+}
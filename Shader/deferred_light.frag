@@ -0,0 +1,179 @@
+#version 330 core
+#define PI 3.141592653589793
+#define MAX_LIGHTS 256
+#define SHADOW_CASCADES 4
+// 从G-buffer读出材质，由深度重建位置，计算一个光源的PBR光照并加法混合到累加目标
+// 定义POINT_LIGHTS时光源来自实例属性，否则是LightBlock中的主光源
+
+// 相机数据，每帧更新一次
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+};
+
+#ifdef POINT_LIGHTS
+flat in vec4 LightPositionRadius;   // xyz: 位置，w: 半径
+flat in vec3 LightColor;            // 已乘强度
+#else
+// 光源数据，与pbrshader.frag一致，这里只用第0个
+layout (std140) uniform LightBlock {
+    vec4 lightPositions[MAX_LIGHTS];
+    vec4 lightColors[MAX_LIGHTS];
+    ivec4 lightCount;
+    vec4 environment;
+};
+
+// 主光源的级联阴影，格式见uniform_buffer.h中的ShadowBlock
+layout (std140) uniform ShadowBlock {
+    mat4 lightViewProjection[SHADOW_CASCADES];
+    vec4 cascadeSplits;       // 每个级联的视空间远端距离
+    vec4 cascadeTexelSizes;   // 每个级联一个texel对应的世界空间大小
+    ivec4 shadowParams;       // x: 级联数，0表示没有阴影，y: PCF半径（texel）
+    vec4 shadowBias;          // x: 深度比较偏移，y: 法线偏移（texel）
+};
+uniform sampler2DArrayShadow shadowMap;
+// 环境光照，见environment_map.h
+uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+#endif
+
+// G-buffer，格式见deferred_renderer.h
+uniform sampler2D gAlbedoAO;
+uniform sampler2D gNormalMaterial;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+out vec4 FragColor;
+
+// 八面体解码
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// pbrshader.frag中packRoughnessMetallic的逆过程
+void unpackRoughnessMetallic(vec2 encoded, out float roughness, out float metallic) {
+    int bits = (int(round(encoded.x * 1023.0)) << 2) | int(round(encoded.y * 3.0));
+    roughness = float(bits >> 6) / 63.0;
+    metallic = float(bits & 63) / 63.0;
+}
+
+// 以下两个函数与pbrshader.frag一致，两条路径的结果才能对比
+float pointLightAttenuation(float distance, float radius) {
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (distance * distance + 1.0);
+}
+
+vec3 calculatePBR(vec3 albedo, float metallic, float roughness, vec3 lightColor, vec3 N, vec3 V, vec3 L) {
+    vec3 diffuseColor = albedo * (1.0 - metallic);
+    vec3 specularColor = mix(vec3(0.04), albedo, metallic);
+    float alpha = roughness * roughness;
+
+    vec3 H = normalize(V + L);
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotH = max(dot(N, H), 0.0);
+    float VdotH = max(dot(V, H), 0.0);
+
+    // 法线分布函数 (Trowbridge-Reitz GGX)
+    float D = (alpha * alpha) / (PI * pow((NdotH * NdotH * (alpha * alpha - 1.0) + 1.0), 2.0));
+    // 几何遮蔽函数 (Smith-Schlick GGX)
+    float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+    float G = (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+    // 菲涅尔方程 (Fresnel-Schlick)
+    vec3 F = specularColor + (1.0 - specularColor) * pow(1.0 - VdotH, 5.0);
+
+    vec3 diffuse = diffuseColor / PI;
+    vec3 specular = (D * G * F) / max(4.0 * NdotV * NdotL, 0.0001);
+    return (diffuse + specular) * lightColor * NdotL;
+}
+
+#ifndef POINT_LIGHTS
+// 与pbrshader.frag一致
+float shadowFactor(vec3 position, vec3 N) {
+    int cascadeCount = shadowParams.x;
+    if (cascadeCount == 0) return 1.0;
+    float viewDepth = -(view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade]) cascade++;
+    // 超出阴影距离
+    if (cascade >= cascadeCount) return 1.0;
+
+    vec3 offsetPosition = position + N * cascadeTexelSizes[cascade] * shadowBias.y;
+    vec4 lightClip = lightViewProjection[cascade] * vec4(offsetPosition, 1.0);
+    vec3 coord = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    if (coord.z >= 1.0) return 1.0;
+    float reference = coord.z - shadowBias.x;
+    int radius = shadowParams.y;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), reference));
+        }
+    }
+    return lit / float((2 * radius + 1) * (2 * radius + 1));
+}
+
+// 与pbrshader.frag一致，只在主光源的全屏通道里加一次
+vec3 environmentLight(vec3 albedo, float metallic, float roughness, vec3 N, vec3 V) {
+    if (environment.x == 0.0) return vec3(0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+    // 粗糙表面掠射角的菲涅尔峰值较低
+    vec3 F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotV, 5.0);
+    vec3 diffuse = texture(irradianceMap, N).rgb * albedo * (1.0 - F) * (1.0 - metallic);
+    vec3 prefiltered = textureLod(prefilterMap, reflect(-V, N), roughness * environment.y).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+    vec3 specular = prefiltered * (F0 * brdf.x + brdf.y);
+    return (diffuse + specular) * environment.x;
+}
+#endif
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // 背景没有几何
+    if (depth >= 1.0) discard;
+
+    // 像素中心的NDC坐标反投影回世界空间
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(textureSize(gDepth, 0));
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 position = world.xyz / world.w;
+
+#ifdef POINT_LIGHTS
+    vec3 toLight = LightPositionRadius.xyz - position;
+    float distance = length(toLight);
+    // 光源体是包围球的外接多面体，角上的像素在影响范围之外
+    if (distance >= LightPositionRadius.w) discard;
+    vec3 lightColor = LightColor * pointLightAttenuation(distance, LightPositionRadius.w);
+#else
+    // 主光源是方向光，xyz为指向光源的方向
+    vec3 toLight = normalize(lightPositions[0].xyz);
+    float distance = 1.0;
+    vec3 lightColor = lightColors[0].rgb;
+#endif
+
+    vec4 albedoAO = texelFetch(gAlbedoAO, pixel, 0);
+    vec4 normalMaterial = texelFetch(gNormalMaterial, pixel, 0);
+    vec3 normal = octDecode(normalMaterial.xy * 2.0 - 1.0);
+    float roughness, metallic;
+    unpackRoughnessMetallic(normalMaterial.zw, roughness, metallic);
+
+    vec3 viewDir = normalize(camPos.xyz - position);
+#ifndef POINT_LIGHTS
+    lightColor *= shadowFactor(position, normal);
+#endif
+    vec3 color = calculatePBR(albedoAO.rgb, metallic, roughness, lightColor, normal, viewDir, toLight / distance);
+#ifndef POINT_LIGHTS
+    color += environmentLight(albedoAO.rgb, metallic, roughness, normal, viewDir);
+#endif
+    // 与前向渲染一样只有光照乘AO，自发光已在几何通道写入
+    FragColor = vec4(color * albedoAO.a, 1.0);
+}
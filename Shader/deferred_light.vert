@@ -0,0 +1,34 @@
+#version 330 core
+// 延迟渲染的光照和合成通道共用
+// 定义POINT_LIGHTS时绘制实例化的光源体，否则绘制覆盖整个视口的三角形
+
+// 相机数据，每帧更新一次
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+};
+
+#ifdef POINT_LIGHTS
+// 内切球为单位球的二十面体
+layout (location = 0) in vec3 aPos;
+// 每个实例一个光源，与LightVolumeInstance一致
+layout (location = 1) in vec4 aLightPositionRadius;
+layout (location = 2) in vec4 aLightColor;
+
+flat out vec4 LightPositionRadius;
+flat out vec3 LightColor;
+#endif
+
+void main() {
+#ifdef POINT_LIGHTS
+    LightPositionRadius = aLightPositionRadius;
+    LightColor = aLightColor.rgb;
+    vec3 position = aLightPositionRadius.xyz + aPos * aLightPositionRadius.w;
+    gl_Position = projection * view * vec4(position, 1.0);
+#else
+    // 顶点为(-1, -1)、(3, -1)、(-1, 3)，不需要顶点缓冲
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+#endif
+}
@@ -0,0 +1,11 @@
+#version 330 core
+// 画覆盖整个视口的三角形，TexCoords在视口内为[0, 1]，IBL预计算和色调映射共用
+
+out vec2 TexCoords;
+
+void main() {
+    // 顶点为(-1, -1)、(3, -1)、(-1, 3)，不需要顶点缓冲
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoords = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
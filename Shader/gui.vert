@@ -2,12 +2,16 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
 
-uniform mat4 projection;
-uniform mat4 view;
+// 相机数据，与PBR着色器共用
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+};
 
 out vec3 Color;
 
 void main() {
     gl_Position = projection * view * vec4(aPos, 1.0);
     Color = aColor;
-}
\ No newline at end of file
+}
@@ -0,0 +1,147 @@
+#version 330 core
+#define PI 3.141592653589793
+// IBL预计算，由宏选择一步：
+//   EQUIRECT_TO_CUBE  等距柱状图转成立方体贴图的一个面
+//   IRRADIANCE        余弦加权卷积，得到漫反射辐照度（已除以PI）
+//   PREFILTER         按roughness做GGX重要性采样，得到预过滤的镜面反射
+//   BRDF_LUT          分裂求和的第二项，x: NdotV，y: 粗糙度，输出F0的系数和偏移
+// 采样数，越多噪声越小，只在没有缓存时执行一次
+#define IRRADIANCE_SAMPLES 2048u
+#define PREFILTER_SAMPLES 1024u
+#define BRDF_SAMPLES 1024u
+
+in vec2 TexCoords;
+out vec4 FragColor;
+
+#ifndef BRDF_LUT
+// 立方体贴图面的基，方向 = faceX * s + faceY * t + faceZ，与environment_map.cpp中的kCubeFaces一致
+uniform vec3 faceX;
+uniform vec3 faceY;
+uniform vec3 faceZ;
+
+vec3 faceDirection() {
+    vec2 st = TexCoords * 2.0 - 1.0;
+    return normalize(faceX * st.x + faceY * st.y + faceZ);
+}
+#endif
+
+#ifdef EQUIRECT_TO_CUBE
+uniform sampler2D equirectMap;
+#endif
+#if defined(IRRADIANCE) || defined(PREFILTER)
+// 带完整mip链的环境立方体贴图，按采样点覆盖的立体角选mip
+uniform samplerCube environmentMap;
+uniform float sourceSize;   // environmentMap第0级的边长
+
+// 一个采样点覆盖的立体角对应的mip，多1级让相邻采样点的覆盖范围重叠
+float sampleLod(float pdf, uint sampleCount) {
+    float texelSolidAngle = 4.0 * PI / (6.0 * sourceSize * sourceSize);
+    float sampleSolidAngle = 1.0 / (float(sampleCount) * pdf + 0.0001);
+    return max(0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0, 0.0);
+}
+#endif
+#ifdef PREFILTER
+uniform float roughness;
+uniform float faceSize;     // 输出mip的边长
+#endif
+
+// Hammersley低差异序列
+float radicalInverse(uint bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10;
+}
+
+vec2 hammersley(uint i, uint count) {
+    return vec2(float(i) / float(count), radicalInverse(i));
+}
+
+// 切空间到世界空间，N为z轴
+vec3 tangentToWorld(vec3 v, vec3 N) {
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+    return tangent * v.x + bitangent * v.y + N * v.z;
+}
+
+// 按GGX法线分布采样半程向量（切空间）
+vec3 importanceSampleGGX(vec2 xi, float alpha) {
+    float phi = 2.0 * PI * xi.x;
+    float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (alpha * alpha - 1.0) * xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    return vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+}
+
+float distributionGGX(float NdotH, float alpha) {
+    float a2 = alpha * alpha;
+    float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+void main() {
+#ifdef EQUIRECT_TO_CUBE
+    // 第一行是+Y方向；显式指定lod，经度环绕处没有导数跳变
+    vec3 dir = faceDirection();
+    vec2 uv = vec2(atan(dir.z, dir.x) / (2.0 * PI) + 0.5, acos(clamp(dir.y, -1.0, 1.0)) / PI);
+    FragColor = vec4(textureLod(equirectMap, uv, 0.0).rgb, 1.0);
+#elif defined(IRRADIANCE)
+    // 余弦加权采样，pdf = cos / PI，平均值就是辐照度 / PI
+    vec3 N = faceDirection();
+    vec3 sum = vec3(0.0);
+    for (uint i = 0u; i < IRRADIANCE_SAMPLES; i++) {
+        vec2 xi = hammersley(i, IRRADIANCE_SAMPLES);
+        float phi = 2.0 * PI * xi.x;
+        float cosTheta = sqrt(1.0 - xi.y);
+        float sinTheta = sqrt(xi.y);
+        vec3 L = tangentToWorld(vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta), N);
+        sum += textureLod(environmentMap, L, sampleLod(cosTheta / PI, IRRADIANCE_SAMPLES)).rgb;
+    }
+    FragColor = vec4(sum / float(IRRADIANCE_SAMPLES), 1.0);
+#elif defined(PREFILTER)
+    // 假设N = V = R（Karis 2013），按NdotL加权
+    vec3 N = faceDirection();
+    if (roughness == 0.0) {
+        // 镜面反射，直接取分辨率相同的mip
+        FragColor = vec4(textureLod(environmentMap, N, log2(sourceSize / faceSize)).rgb, 1.0);
+        return;
+    }
+    float alpha = roughness * roughness;
+    vec3 sum = vec3(0.0);
+    float weight = 0.0;
+    for (uint i = 0u; i < PREFILTER_SAMPLES; i++) {
+        vec3 H = tangentToWorld(importanceSampleGGX(hammersley(i, PREFILTER_SAMPLES), alpha), N);
+        float VdotH = dot(N, H);
+        vec3 L = 2.0 * VdotH * H - N;
+        float NdotL = dot(N, L);
+        if (NdotL <= 0.0) continue;
+        // N = V时pdf = D * NdotH / (4 * VdotH) = D / 4
+        float pdf = distributionGGX(max(VdotH, 0.0), alpha) * 0.25;
+        sum += textureLod(environmentMap, L, sampleLod(pdf, PREFILTER_SAMPLES)).rgb * NdotL;
+        weight += NdotL;
+    }
+    FragColor = vec4(sum / max(weight, 0.0001), 1.0);
+#elif defined(BRDF_LUT)
+    // 镜面反射积分 = F0 * A + B，几何项使用IBL的k = alpha / 2
+    float NdotV = TexCoords.x;
+    float alpha = TexCoords.y * TexCoords.y;
+    float k = alpha * 0.5;
+    vec3 V = vec3(sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
+    vec2 result = vec2(0.0);
+    for (uint i = 0u; i < BRDF_SAMPLES; i++) {
+        vec3 H = importanceSampleGGX(hammersley(i, BRDF_SAMPLES), alpha);
+        vec3 L = 2.0 * dot(V, H) * H - V;
+        float NdotL = L.z;
+        if (NdotL <= 0.0) continue;
+        float NdotH = max(H.z, 0.0);
+        float VdotH = max(dot(V, H), 0.0);
+        float G = (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+        float visibility = G * VdotH / max(NdotH * NdotV, 0.0001);
+        float fresnel = pow(1.0 - VdotH, 5.0);
+        result += vec2(1.0 - fresnel, fresnel) * visibility;
+    }
+    FragColor = vec4(result / float(BRDF_SAMPLES), 0.0, 1.0);
+#endif
+}
@@ -1,41 +1,185 @@
 #version 330 core
+#ifdef CLUSTERED_LIGHTING
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
 #define PI 3.141592653589793
+#define MAX_LIGHTS 256
+#define SHADOW_CASCADES 4
+// 每个多重间接绘制的数据占的texel数，材质从第6个开始
+#define DRAW_RECORD_TEXELS 9
+#define DRAW_RECORD_MATERIAL 6
 in vec3 Normal;
 in vec3 FragPos;
-in vec3 LightPos;
 in vec2 TexCoords;
+flat in int DrawIndex;
 
+#ifdef GBUFFER_PASS
+// 延迟渲染的几何通道，格式见deferred_renderer.h
+layout (location = 0) out vec4 gAlbedoAO;        // RGBA8: 反照率、AO
+layout (location = 1) out vec4 gNormalMaterial;  // RGB10_A2: 八面体法线、粗糙度和金属度
+layout (location = 2) out vec4 gLight;           // 光照累加目标，先写入自发光
+#else
 out vec4 FragColor;
+#endif
 
-// PBR材质属性
-uniform vec3 albedoColor;    // 基础颜色
-uniform float metallic;      // 金属度
-uniform float roughness;     // 粗糙度
-uniform float ao;            // 环境光遮蔽
-uniform vec3 emissionColor;  // 自发光颜色
+// 相机数据，每帧更新一次
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+};
 
-// 纹理贴图
+// 光源数据，每帧更新一次
+layout (std140) uniform LightBlock {
+    vec4 lightPositions[MAX_LIGHTS];  // xyz: 位置，w: 影响半径，0表示方向光（xyz为指向光源的方向）
+    vec4 lightColors[MAX_LIGHTS];     // rgb: 颜色（已乘强度）
+    ivec4 lightCount;                 // x: 光源数量
+    vec4 environment;                 // x: IBL强度，0表示没有环境光，y: 预过滤贴图的最大mip
+};
+
+#ifdef CLUSTERED_LIGHTING
+// 分簇光照，点光源按所在的簇从存储缓冲读取，格式见light_clusterer.h
+layout (std140) uniform ClusterBlock {
+    uvec4 clusterGridSize;   // xyz: 簇的数量，w: 为0时簇列表不可用，只用LightBlock
+    vec4 screenToTile;       // xy: 视口原点，zw: 1 / 簇的像素大小
+    vec4 depthSlicing;       // 深度切片 = log(视空间深度) * x + y
+};
+
+struct ClusterLight {
+    vec4 positionRadius;    // xyz: 位置，w: 半径
+    vec4 color;             // rgb: 颜色（已乘强度）
+};
+
+layout (std430) buffer ClusterLightBuffer {
+    ClusterLight clusterLights[];
+};
+// 每个簇在索引列表中的起点和数量
+layout (std430) buffer ClusterGridBuffer {
+    uvec2 clusters[];
+};
+layout (std430) buffer ClusterIndexBuffer {
+    uint clusterIndexCount;
+    uint clusterLightIndices[];
+};
+#endif
+
+#ifndef GBUFFER_PASS
+// 主光源的级联阴影，格式见uniform_buffer.h中的ShadowBlock
+layout (std140) uniform ShadowBlock {
+    mat4 lightViewProjection[SHADOW_CASCADES];
+    vec4 cascadeSplits;       // 每个级联的视空间远端距离
+    vec4 cascadeTexelSizes;   // 每个级联一个texel对应的世界空间大小
+    ivec4 shadowParams;       // x: 级联数，0表示没有阴影，y: PCF半径（texel）
+    vec4 shadowBias;          // x: 深度比较偏移，y: 法线偏移（texel）
+};
+uniform sampler2DArrayShadow shadowMap;
+// 环境光照，见environment_map.h
+uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+#endif
+
+// PBR材质属性，材质改变时更新
+layout (std140) uniform MaterialBlock {
+    vec4 albedoColor;    // 基础颜色
+    vec4 emissionColor;  // 自发光颜色
+    float metallic;      // 金属度
+    float roughness;     // 粗糙度
+    float ao;            // 环境光遮蔽
+};
+
+// 纹理贴图，纹理单元在链接后设置
+// 用到哪些贴图由编译变体时插入的HAS_*宏决定，未使用的贴图不声明也不采样
+#ifdef HAS_ALBEDO_MAP
 uniform sampler2D albedoMap;    // 反照率贴图
+#endif
+#ifdef HAS_NORMAL_MAP
 uniform sampler2D normalMap;    // 法线贴图
+#endif
+#ifdef HAS_METALLIC_MAP
 uniform sampler2D metallicMap; // 金属度贴图
+#endif
+#ifdef HAS_ROUGHNESS_MAP
 uniform sampler2D roughnessMap; // 粗糙度贴图
+#endif
+#ifdef HAS_AO_MAP
 uniform sampler2D aoMap;       // 环境光遮蔽贴图
+#endif
+#ifdef HAS_EMISSION_MAP
 uniform sampler2D emissionMap; // 自发光贴图
-//是否启用纹理贴图
-uniform bool useAlbedoMap;//反照率贴图
-uniform bool useNormalMap;//法线贴图
-uniform bool useMetallicMap;
-uniform bool useRoughnessMap;
-uniform bool useAOMap;
-uniform bool useEmissionMap;
-// 光源属性
-uniform vec3 lightColor;     // 光源颜色
-
-// 相机位置
-uniform vec3 viewPos;        // 观察者位置
+#endif
+
+// 为2时材质参数从drawData读取，否则使用MaterialBlock
+uniform int drawMode;
+uniform samplerBuffer drawData;
+
+// 平方反比衰减，乘上窗口函数使光照在半径处平滑降为0
+float pointLightAttenuation(float distance, float radius) {
+    float ratio = distance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (distance * distance + 1.0);
+}
+
+#ifdef CLUSTERED_LIGHTING
+// 片段所在的簇：屏幕位置决定xy，视空间深度按对数决定切片
+uint findCluster() {
+    uvec2 tile = uvec2(max((gl_FragCoord.xy - screenToTile.xy) * screenToTile.zw, vec2(0.0)));
+    tile = min(tile, clusterGridSize.xy - 1u);
+    float viewDepth = max(-(view * vec4(FragPos, 1.0)).z, 0.0001);
+    uint slice = uint(clamp(log(viewDepth) * depthSlicing.x + depthSlicing.y, 0.0, float(clusterGridSize.z - 1u)));
+    return tile.x + clusterGridSize.x * (tile.y + clusterGridSize.y * slice);
+}
+#endif
+
+#ifndef GBUFFER_PASS
+// 主光源的可见度：按视空间深度选级联，沿法线偏移后在(2r+1)^2个点上做深度比较
+// 阴影贴图是线性过滤的比较纹理，每个点已经是硬件的2x2 PCF
+float shadowFactor(vec3 position, vec3 N) {
+    int cascadeCount = shadowParams.x;
+    if (cascadeCount == 0) return 1.0;
+    float viewDepth = -(view * vec4(position, 1.0)).z;
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade]) cascade++;
+    // 超出阴影距离
+    if (cascade >= cascadeCount) return 1.0;
+
+    vec3 offsetPosition = position + N * cascadeTexelSizes[cascade] * shadowBias.y;
+    vec4 lightClip = lightViewProjection[cascade] * vec4(offsetPosition, 1.0);
+    vec3 coord = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    if (coord.z >= 1.0) return 1.0;
+    float reference = coord.z - shadowBias.x;
+    int radius = shadowParams.y;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), reference));
+        }
+    }
+    return lit / float((2 * radius + 1) * (2 * radius + 1));
+}
+#endif
+
+#ifdef GBUFFER_PASS
+// 八面体编码，结果在[-1, 1]
+vec2 octEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0) {
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return e;
+}
+
+// 粗糙度和金属度各量化为6位，拼成12位后分到b(10位)和a(2位)
+vec2 packRoughnessMetallic(float roughness, float metallic) {
+    int bits = (int(round(clamp(roughness, 0.0, 1.0) * 63.0)) << 6) | int(round(clamp(metallic, 0.0, 1.0) * 63.0));
+    return vec2(float(bits >> 2) / 1023.0, float(bits & 3) / 3.0);
+}
+#endif
 
 // PBR光照计算函数
-vec3 calculatePBR(vec3 albedo, float metallic, float roughness, float ao, vec3 emission, vec3 N, vec3 V, vec3 L) {
+vec3 calculatePBR(vec3 albedo, float metallic, float roughness, vec3 lightColor, vec3 N, vec3 V, vec3 L) {
     // 金属度影响
     vec3 diffuseColor = albedo * (1.0 - metallic);
     vec3 specularColor = mix(vec3(0.04), albedo, metallic);
@@ -72,29 +216,119 @@ vec3 calculatePBR(vec3 albedo, float metallic, float roughness, float ao, vec3 e
     vec3 specular = (D * G * F) / denominator;
     
     // 组合结果
-    vec3 color = (diffuse + specular) * lightColor * NdotL;
-    color = color * ao + emission;
-    
-    return color;
+    return (diffuse + specular) * lightColor * NdotL;
 }
 
+// 一个光源的光照，半径为0时是方向光，不衰减
+vec3 calculateLight(vec4 positionRadius, vec3 lightColor, vec3 albedo, float metallic, float roughness, vec3 N, vec3 V) {
+    float radius = positionRadius.w;
+    if (radius == 0.0) {
+        return calculatePBR(albedo, metallic, roughness, lightColor, N, V, normalize(positionRadius.xyz));
+    }
+    vec3 toLight = positionRadius.xyz - FragPos;
+    float distance = length(toLight);
+    if (distance >= radius) return vec3(0.0);
+    return calculatePBR(albedo, metallic, roughness, lightColor * pointLightAttenuation(distance, radius), N, V,
+                        toLight / distance);
+}
+
+#ifndef GBUFFER_PASS
+// 基于图像的环境光照（分裂求和近似），environment.x为0时没有环境贴图
+vec3 environmentLight(vec3 albedo, float metallic, float roughness, vec3 N, vec3 V) {
+    if (environment.x == 0.0) return vec3(0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+    // 粗糙表面掠射角的菲涅尔峰值较低
+    vec3 F = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotV, 5.0);
+    vec3 diffuse = texture(irradianceMap, N).rgb * albedo * (1.0 - F) * (1.0 - metallic);
+    vec3 prefiltered = textureLod(prefilterMap, reflect(-V, N), roughness * environment.y).rgb;
+    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+    vec3 specular = prefiltered * (F0 * brdf.x + brdf.y);
+    return (diffuse + specular) * environment.x;
+}
+#endif
+
 void main() {
-    // 获取材质参数（根据是否使用贴图选择贴图或默认值）
-    vec3 albedo = useAlbedoMap ? texture(albedoMap, TexCoords).rgb * albedoColor : albedoColor;
-    vec3 normal = useNormalMap ? texture(normalMap, TexCoords).rgb * 2.0 - 1.0 : Normal;
+    // 材质参数，多重间接绘制时每个绘制不同
+    vec3 baseColor = albedoColor.rgb;
+    vec3 emissive = emissionColor.rgb;
+    float metallicFactor = metallic;
+    float roughnessFactor = roughness;
+    float aoFactor = ao;
+    if (drawMode == 2) {
+        int base = DrawIndex * DRAW_RECORD_TEXELS + DRAW_RECORD_MATERIAL;
+        baseColor = texelFetch(drawData, base).rgb;
+        emissive = texelFetch(drawData, base + 1).rgb;
+        vec4 factors = texelFetch(drawData, base + 2);
+        metallicFactor = factors.x;
+        roughnessFactor = factors.y;
+        aoFactor = factors.z;
+    }
+
+    // 获取材质参数，有贴图时乘上贴图
+#ifdef HAS_ALBEDO_MAP
+    vec3 albedo = texture(albedoMap, TexCoords).rgb * baseColor;
+#else
+    vec3 albedo = baseColor;
+#endif
+#ifdef HAS_NORMAL_MAP
+    vec3 normal = texture(normalMap, TexCoords).rgb * 2.0 - 1.0;
+#else
+    vec3 normal = Normal;
+#endif
     // 这里假设法线贴图已经是世界空间法线，如果是切线空间法线需要转换
     normal = normalize(normal); 
-    float metallicVal = useMetallicMap ? texture(metallicMap, TexCoords).r * metallic : metallic;
-    float roughnessVal = useRoughnessMap ? texture(roughnessMap, TexCoords).r * roughness : roughness;
-    float aoVal = useAOMap ? texture(aoMap, TexCoords).r * ao : ao;
-    vec3 emissionVal = useEmissionMap ? texture(emissionMap, TexCoords).rgb * emissionColor : emissionColor;
+#ifdef HAS_METALLIC_MAP
+    float metallicVal = texture(metallicMap, TexCoords).r * metallicFactor;
+#else
+    float metallicVal = metallicFactor;
+#endif
+#ifdef HAS_ROUGHNESS_MAP
+    float roughnessVal = texture(roughnessMap, TexCoords).r * roughnessFactor;
+#else
+    float roughnessVal = roughnessFactor;
+#endif
+#ifdef HAS_AO_MAP
+    float aoVal = texture(aoMap, TexCoords).r * aoFactor;
+#else
+    float aoVal = aoFactor;
+#endif
+#ifdef HAS_EMISSION_MAP
+    vec3 emissionVal = texture(emissionMap, TexCoords).rgb * emissive;
+#else
+    vec3 emissionVal = emissive;
+#endif
     
+#ifdef GBUFFER_PASS
+    // 光照在光照通道中计算，这里只保存材质；位置由深度重建
+    gAlbedoAO = vec4(albedo, aoVal);
+    gNormalMaterial = vec4(octEncode(normal) * 0.5 + 0.5, packRoughnessMetallic(roughnessVal, metallicVal));
+    gLight = vec4(emissionVal, 1.0);
+#else
     // 标准化向量
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 lightDir = normalize(LightPos - FragPos);
+    vec3 viewDir = normalize(camPos.xyz - FragPos);
     
-    // 计算PBR光照
-    vec3 color = calculatePBR(albedo, metallicVal, roughnessVal, aoVal, emissionVal, normal, viewDir, lightDir);
+    // 计算PBR光照，累加LightBlock中的光源（分簇时只有主光源）
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < lightCount.x; i++) {
+        vec3 contribution = calculateLight(lightPositions[i], lightColors[i].rgb, albedo, metallicVal, roughnessVal, normal, viewDir);
+        // 只有第0个主光源投射阴影
+        if (i == 0) contribution *= shadowFactor(FragPos, normal);
+        color += contribution;
+    }
+#ifdef CLUSTERED_LIGHTING
+    // 点光源只遍历所在簇的列表，开销取决于局部的光源密度
+    if (clusterGridSize.w != 0u) {
+        uvec2 cluster = clusters[findCluster()];
+        for (uint i = 0u; i < cluster.y; i++) {
+            ClusterLight light = clusterLights[clusterLightIndices[cluster.x + i]];
+            color += calculateLight(light.positionRadius, light.color.rgb, albedo, metallicVal, roughnessVal, normal, viewDir);
+        }
+    }
+#endif
+    color += environmentLight(albedo, metallicVal, roughnessVal, normal, viewDir);
+    color = color * aoVal + emissionVal;
     
-    FragColor = vec4(normal, 1.0);
+    FragColor = vec4(color, 1.0);
+#endif
 }
\ No newline at end of file
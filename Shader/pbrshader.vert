@@ -1,24 +1,71 @@
 #version 330 core
+// 每个多重间接绘制的数据占的texel数，与render_queue.h一致
+#define DRAW_RECORD_TEXELS 9
+// 浮点格式直接是模型空间数据；压缩格式下aPos是[-1, 1]的量化位置，
+// aNormal.xy是八面体编码的法线，aTexCoords由硬件从半精度转换
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// 实例化绘制时每个实例的模型矩阵，占用位置3~6
+layout (location = 3) in mat4 instanceMatrix;
+// 多重间接绘制时的绘制序号，由baseInstance给出
+layout (location = 7) in uint drawIndex;
+
+// 相机数据，每帧更新一次
+layout (std140) uniform CameraBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 camPos;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform float time;
-uniform vec3 lightPos;
+// 0: 使用model，1: 使用instanceMatrix，2: 模型矩阵和解码参数从drawData读取
+uniform int drawMode;
+// 顶点解码参数，浮点格式下为(1, 0, false)
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+uniform bool octNormals;
+// 多重间接绘制的每绘制数据
+uniform samplerBuffer drawData;
 
 out vec3 Normal;
 out vec3 FragPos;
-out vec3 LightPos;
 out vec2 TexCoords;
+// 片段着色器按它读取材质参数
+flat out int DrawIndex;
+
+// 八面体解码
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    LightPos = lightPos;
+    mat4 world = drawMode == 1 ? instanceMatrix : model;
+    vec3 scale = positionScale;
+    vec3 bias = positionBias;
+    bool oct = octNormals;
+    DrawIndex = 0;
+    if (drawMode == 2) {
+        DrawIndex = int(drawIndex);
+        int base = DrawIndex * DRAW_RECORD_TEXELS;
+        world = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),
+                     texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+        vec4 scaleData = texelFetch(drawData, base + 4);
+        scale = scaleData.xyz;
+        oct = scaleData.w > 0.5;
+        bias = texelFetch(drawData, base + 5).xyz;
+    }
+
+    vec3 position = aPos * scale + bias;
+    vec3 normal = oct ? octDecode(aNormal.xy) : aNormal;
+
+    FragPos = vec3(world * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(world))) * normal;
     TexCoords = aTexCoords;
     
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+// 阴影深度通道，顶点数组只有位置流（见Mesh::createDepthVertexArray）
+// 压缩格式下aPos是[-1, 1]的量化位置，用positionScale/positionBias还原
+layout (location = 0) in vec3 aPos;
+// 实例化绘制时每个实例的模型矩阵，与pbrshader.vert一致
+layout (location = 3) in mat4 instanceMatrix;
+
+uniform mat4 lightViewProjection;
+uniform mat4 model;
+// 0: 使用model，1: 使用instanceMatrix
+uniform int drawMode;
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+
+void main() {
+    mat4 world = drawMode == 1 ? instanceMatrix : model;
+    vec3 position = aPos * positionScale + positionBias;
+    gl_Position = lightViewProjection * world * vec4(position, 1.0);
+}
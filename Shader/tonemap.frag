@@ -0,0 +1,42 @@
+#version 330 core
+#ifdef AUTO_EXPOSURE
+#extension GL_ARB_shader_storage_buffer_object : require
+#endif
+// 色调映射：场景颜色乘曝光，用Hable的电影曲线压到[0, 1]，再做gamma校正写入LDR帧缓冲
+// 定义AUTO_EXPOSURE时曝光来自亮度直方图（见hdr_pipeline.h），否则只有曝光补偿
+// 白点，这个亮度及以上映射为1
+#define WHITE_POINT 11.2
+
+in vec2 TexCoords;
+out vec4 FragColor;
+
+uniform sampler2D hdrScene;
+uniform float exposureScale;    // 2^曝光补偿
+
+#ifdef AUTO_EXPOSURE
+// 由luminance_average.comp写入
+layout (std430) readonly buffer ExposureBuffer {
+    float adaptedLuminance;
+    float exposure;
+};
+#endif
+
+// Uncharted 2的电影曲线（Hable 2010）：趾部压暗部，肩部柔和地压高光
+vec3 filmicCurve(vec3 x) {
+    const float A = 0.15;   // 肩部强度
+    const float B = 0.50;   // 线性段强度
+    const float C = 0.10;   // 线性段角度
+    const float D = 0.20;   // 趾部强度
+    const float E = 0.02;   // 趾部分子
+    const float F = 0.30;   // 趾部分母
+    return (x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F) - E / F;
+}
+
+void main() {
+    vec3 color = texture(hdrScene, TexCoords).rgb * exposureScale;
+#ifdef AUTO_EXPOSURE
+    color *= exposure;
+#endif
+    vec3 mapped = filmicCurve(color * 2.0) / filmicCurve(vec3(WHITE_POINT));
+    FragColor = vec4(pow(clamp(mapped, 0.0, 1.0), vec3(1.0 / 2.2)), 1.0);
+}
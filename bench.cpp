@@ -0,0 +1,151 @@
+#include "render.h"
+#include <algorithm>
+#include <chrono>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+#include "profiler.h"
+#include "render_stats.h"
+#include "log.h"
+
+// 无头帧时间基准测试
+// 用法: GL_Render_bench [--frames N] [--warmup N] [--width W] [--height H] [--model 路径] [--instances N]
+//                       [--check-culling] [--trace 输出.json] [--deferred] [--lights N]
+//                       [--no-shadows] [--shadow-pcf R] [--environment 环境贴图.hdr]
+//                       [--no-hdr] [--hdr-format r11g11b10f|rgba16f] [--fixed-exposure]
+int main(int argc, char** argv) {
+    setlocale(LC_ALL, "");
+    Log::Session logSession;
+
+    int frames = 300;
+    int warmupFrames = 30;
+    int width = 1920;
+    int height = 1080;
+    std::string modelPath = "test_room.obj";
+    int instances = 0;
+    bool checkCulling = false;
+    std::string tracePath;
+    bool deferred = false;
+    int pointLights = 0;
+    bool shadows = true;
+    int shadowPcf = SHADOW_DEFAULT_PCF_RADIUS;
+    std::string environmentPath;
+    bool hdr = true;
+    HdrFormat hdrFormat = HDR_DEFAULT_FORMAT;
+    bool autoExposure = true;
+
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--frames") == 0 && hasValue) {
+            frames = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue) {
+            warmupFrames = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--width") == 0 && hasValue) {
+            width = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--height") == 0 && hasValue) {
+            height = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--model") == 0 && hasValue) {
+            modelPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--instances") == 0 && hasValue) {
+            instances = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--check-culling") == 0) {
+            checkCulling = true;
+        } else if (std::strcmp(argv[i], "--trace") == 0 && hasValue) {
+            tracePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--deferred") == 0) {
+            deferred = true;
+        } else if (std::strcmp(argv[i], "--lights") == 0 && hasValue) {
+            pointLights = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--no-shadows") == 0) {
+            shadows = false;
+        } else if (std::strcmp(argv[i], "--shadow-pcf") == 0 && hasValue) {
+            shadowPcf = std::clamp(std::atoi(argv[++i]), 0, SHADOW_MAX_PCF_RADIUS);
+        } else if (std::strcmp(argv[i], "--environment") == 0 && hasValue) {
+            environmentPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-hdr") == 0) {
+            hdr = false;
+        } else if (std::strcmp(argv[i], "--hdr-format") == 0 && hasValue &&
+                   (std::strcmp(argv[i + 1], "r11g11b10f") == 0 || std::strcmp(argv[i + 1], "rgba16f") == 0)) {
+            hdrFormat = std::strcmp(argv[++i], "rgba16f") == 0 ? HdrFormat::RGBA16F : HdrFormat::R11G11B10F;
+        } else if (std::strcmp(argv[i], "--fixed-exposure") == 0) {
+            autoExposure = false;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--frames N] [--warmup N] [--width W] [--height H] [--model path] [--instances N] [--check-culling]"
+                      << " [--trace output.json] [--deferred] [--lights N] [--no-shadows] [--shadow-pcf R]"
+                      << " [--environment file.hdr] [--no-hdr] [--hdr-format r11g11b10f|rgba16f] [--fixed-exposure]"
+                      << std::endl;
+            return -1;
+        }
+    }
+
+    Renderer renderer;
+    if (!renderer.initHeadless(width, height, modelPath, instances)) {
+        std::cerr << "Failed to initialize headless renderer" << std::endl;
+        return -1;
+    }
+
+    // 同一组点光源分别用两条路径跑，对比前向和延迟渲染
+    if (pointLights > 0) {
+        renderer.scatterPointLights(pointLights);
+    }
+    renderer.setShadows(shadows, shadowPcf);
+    renderer.setHdr(hdr, hdrFormat, autoExposure);
+    // 第一次运行时预计算IBL，之后从缓存加载，都在预热之前完成
+    if (!environmentPath.empty() && !renderer.loadEnvironment(environmentPath)) {
+        std::cerr << "Failed to load environment map " << environmentPath << std::endl;
+        return -1;
+    }
+    if (deferred && !renderer.setDeferredShading(true)) {
+        std::cerr << "Deferred shading is not available" << std::endl;
+        return -1;
+    }
+
+    // GPU剔除与CPU剔除的结果必须一致
+    if (checkCulling && !renderer.validateGpuCulling()) {
+        std::cerr << "GPU culling does not match CPU culling" << std::endl;
+        return -1;
+    }
+
+    // 预热，排除着色器编译和首帧上传的影响
+    for (int i = 0; i < warmupFrames; i++) {
+        renderer.renderHeadlessFrame();
+    }
+
+    // 记录每帧耗时（毫秒）
+    std::vector<double> frameTimes;
+    frameTimes.reserve(frames);
+    for (int i = 0; i < frames; i++) {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        renderer.renderHeadlessFrame();
+        auto frameEnd = std::chrono::high_resolution_clock::now();
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+    }
+
+    std::vector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double minTime = sorted.front();
+    double avgTime = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+    size_t p99Index = static_cast<size_t>(std::ceil(0.99 * sorted.size())) - 1;
+    double p99Time = sorted[std::min(p99Index, sorted.size() - 1)];
+
+    LOG_INFO("Benchmark: {} frames at {}x{}, model {}, instances {}, {} shading, {} point lights, shadows {} (PCF {}), environment {}, HDR {}",
+             frames, width, height, modelPath, instances, deferred ? "deferred" : "forward", pointLights,
+             shadows ? "on" : "off", shadowPcf, environmentPath.empty() ? "none" : environmentPath,
+             hdr ? HdrPipeline::formatName(hdrFormat) : "off");
+    LOG_INFO("frame time min {:.3f} ms, avg {:.3f} ms, p99 {:.3f} ms", minTime, avgTime, p99Time);
+    // 最后一帧的绘制调用、三角形、状态切换和显存，与窗口模式的性能面板相同
+    RenderStats::get().logLastFrame();
+
+    // 每个区间的CPU和GPU时间，chrome://tracing或Perfetto打开
+    if (!tracePath.empty() && !Profiler::get().writeTrace(tracePath)) {
+        return -1;
+    }
+    return 0;
+}
@@ -1,16 +1,22 @@
 #include "render.h"
+#include "log.h"
 #include <iostream>
 #include <chrono>
 #include <clocale>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 // 主函数入口点
 int main() {
+#ifdef _WIN32
     //设置控制台使用UTF-8编码
     SetConsoleOutputCP(CP_UTF8);
     SetConsoleCP(CP_UTF8);
+#endif
     setlocale(LC_ALL, "");
-    
+    // 异步日志，控制台和文件的写入不占用渲染线程
+    Log::Session logSession;
 
     // 创建渲染器实例
     Renderer renderer;